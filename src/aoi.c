@@ -0,0 +1,79 @@
+#include "core.h"
+#include "aoi.h"
+#include <math.h>
+
+static cs_uint16 viewDistance = 0;
+
+void AOI_SetViewDistance(cs_uint16 dist) {
+	viewDistance = dist;
+}
+
+cs_bool AOI_IsEnabled(void) {
+	return viewDistance > 0;
+}
+
+cs_bool AOI_InRange(const Vec *a, const Vec *b, cs_bool visible) {
+	if(viewDistance == 0) return true;
+	cs_float dist = (cs_float)viewDistance + (visible ? AOI_HYSTERESIS : 0),
+	dx = a->x - b->x, dz = a->z - b->z;
+	return dx * dx + dz * dz <= dist * dist;
+}
+
+INL static cs_int32 GetCell(cs_float coord) {
+	cs_float size = (cs_float)(viewDistance + AOI_HYSTERESIS);
+	return (cs_int32)floorf(coord / size);
+}
+
+INL static cs_byte GetBucket(cs_int32 cx, cs_int32 cz) {
+	return (cs_byte)((((cs_uint32)cx * 73856093u) ^ ((cs_uint32)cz * 19349663u)) % AOI_BUCKETS);
+}
+
+void AOI_Remove(AOIGrid *grid, ClientID id) {
+	if(!grid->present[id]) return;
+	cs_byte prev = grid->prev[id], next = grid->next[id];
+
+	if(prev) grid->next[prev - 1] = next;
+	else grid->head[grid->bucket[id]] = next;
+	if(next) grid->prev[next - 1] = prev;
+
+	grid->present[id] = false;
+}
+
+void AOI_Update(AOIGrid *grid, ClientID id, const Vec *pos) {
+	cs_byte bucket = GetBucket(GetCell(pos->x), GetCell(pos->z));
+	if(grid->present[id]) {
+		if(grid->bucket[id] == bucket) return;
+		AOI_Remove(grid, id);
+	}
+
+	cs_byte head = grid->head[bucket];
+	grid->prev[id] = 0;
+	grid->next[id] = head;
+	if(head) grid->prev[head - 1] = id + 1;
+	grid->head[bucket] = id + 1;
+	grid->bucket[id] = bucket;
+	grid->present[id] = true;
+}
+
+cs_uint32 AOI_Query(AOIGrid *grid, const Vec *pos, ClientID *ids) {
+	cs_int32 cx = GetCell(pos->x), cz = GetCell(pos->z);
+	cs_byte buckets[9];
+	cs_uint32 nbuckets = 0, count = 0;
+
+	for(cs_int32 x = -1; x <= 1; x++) {
+		for(cs_int32 z = -1; z <= 1; z++) {
+			cs_byte bucket = GetBucket(cx + x, cz + z);
+			cs_bool dup = false;
+			// Разные ячейки могут попасть в одну корзину
+			for(cs_uint32 i = 0; i < nbuckets; i++)
+				if(buckets[i] == bucket) dup = true;
+			if(!dup) buckets[nbuckets++] = bucket;
+		}
+	}
+
+	for(cs_uint32 i = 0; i < nbuckets; i++)
+		for(cs_byte ent = grid->head[buckets[i]]; ent; ent = grid->next[ent - 1])
+			ids[count++] = ent - 1;
+
+	return count;
+}
@@ -0,0 +1,66 @@
+#ifndef AOI_H
+#define AOI_H
+#include "core.h"
+#include "vector.h"
+#include "types/aoi.h"
+
+#ifndef CORE_BUILD_PLUGIN
+	/**
+	 * @brief Устанавливает дальность прорисовки сущностей.
+	 *
+	 * @param dist дальность в блоках, 0 - без ограничений
+	 */
+	void AOI_SetViewDistance(cs_uint16 dist);
+
+	/**
+	 * @brief Проверяет, ограничена ли дальность прорисовки сущностей.
+	 *
+	 * @return true - ограничена, false - все сущности мира видны всем
+	 */
+	cs_bool AOI_IsEnabled(void);
+
+	/**
+	 * @brief Проверяет, должна ли сущность быть видна с указанной позиции.
+	 * Уже видимая сущность пропадает только за пределами дальности
+	 * прорисовки с запасом в AOI_HYSTERESIS блоков, чтобы игроки на
+	 * границе не спавнились и не деспавнились на каждом шаге.
+	 *
+	 * @param a позиция наблюдателя
+	 * @param b позиция сущности
+	 * @param visible видна ли сущность сейчас
+	 * @return true - сущность должна быть видна
+	 */
+	cs_bool AOI_InRange(const Vec *a, const Vec *b, cs_bool visible);
+
+	/**
+	 * @brief Добавляет сущность в сетку мира или переносит
+	 * её в новую ячейку, если она туда переместилась.
+	 *
+	 * @param grid сетка мира
+	 * @param id идентификатор сущности
+	 * @param pos позиция сущности
+	 */
+	void AOI_Update(AOIGrid *grid, ClientID id, const Vec *pos);
+
+	/**
+	 * @brief Удаляет сущность из сетки мира.
+	 *
+	 * @param grid сетка мира
+	 * @param id идентификатор сущности
+	 */
+	void AOI_Remove(AOIGrid *grid, ClientID id);
+
+	/**
+	 * @brief Собирает сущности из ячеек вокруг позиции. Ячейки
+	 * не меньше дальности прорисовки, поэтому все сущности в
+	 * её пределах гарантированно попадут в результат.
+	 *
+	 * @param grid сетка мира
+	 * @param pos позиция наблюдателя
+	 * @param ids массив размером не меньше MAX_CLIENTS
+	 * @return количество найденных сущностей
+	 */
+	cs_uint32 AOI_Query(AOIGrid *grid, const Vec *pos, ClientID *ids);
+#endif
+
+#endif
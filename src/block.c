@@ -4,6 +4,7 @@
 #include "block.h"
 #include "platform.h"
 #include "list.h"
+#include "remap.h"
 
 static cs_str const defaultBlockNames[BLOCK_DEFAULT_COUNT] = {
 	"Air", "Stone", "Grass", "Dirt",
@@ -34,7 +35,7 @@ cs_bool Block_IsValid(World *world, BlockID id) {
 	return id < BLOCK_DEFAULT_COUNT || world->info.bdefines[id] != NULL;
 }
 
-BlockID Block_GetFallbackFor(World *world, BlockID id) {
+static BlockID FallbackFor(World *world, BlockID id) {
 	if(world->info.bdefines[id])
 		return world->info.bdefines[id]->fallback;
 
@@ -59,6 +60,28 @@ BlockID Block_GetFallbackFor(World *world, BlockID id) {
 	}
 }
 
+// Таблица перестраивается при первом обращении
+// после изменения определений блоков мира
+INL static void DropFallback(World *world) {
+	world->fallback.ready = false;
+}
+
+const RemapTable *Block_GetFallbackTable(World *world) {
+	RemapTable *rt = &world->fallback.table;
+	if(!world->fallback.ready) {
+		for(cs_uint16 id = 0; id < 256; id++)
+			rt->lut[id] = FallbackFor(world, (BlockID)id);
+		Remap_Update(rt);
+		world->fallback.ready = true;
+	}
+
+	return rt;
+}
+
+BlockID Block_GetFallbackFor(World *world, BlockID id) {
+	return Block_GetFallbackTable(world)->lut[id];
+}
+
 cs_str Block_GetName(World *world, BlockID id) {
 	if(!Block_IsValid(world, id))
 		return "Unknown block";
@@ -82,6 +105,7 @@ cs_bool Block_Define(World *world, BlockID id, BlockDef *bdef) {
 	if(Block_GetIDFor(world, bdef) > 0) return false;
 	bdef->flags &= ~(BDF_UPDATED | BDF_UNDEFINED);
 	world->info.bdefines[id] = bdef;
+	DropFallback(world);
 	return true;
 }
 
@@ -92,12 +116,10 @@ BlockDef *Block_GetDefinition(World *world, BlockID id) {
 cs_bool Block_Undefine(World *world, BlockDef *bdef) {
 	BlockID bid = Block_GetIDFor(world, bdef);
 	if(bid < 1) return false;
-	for(ClientID id = 0; id < MAX_CLIENTS; id++) {
-		Client *client = Clients_List[id];
-		if(client && Client_IsInWorld(client, world))
-			Client_UndefineBlock(client, bid);
-	}
+	for(cs_uint16 i = 0; i < world->clients.count; i++)
+		Client_UndefineBlock(world->clients.list[i], bid);
 	world->info.bdefines[bid] = NULL;
+	DropFallback(world);
 	return true;
 }
 
@@ -117,19 +139,15 @@ void Block_UpdateDefinition(BlockDef *bdef) {
 		World *world = (World *)tmp->value.ptr;
 		BlockID bid = Block_GetIDFor(world, bdef);
 		if(bid > BLOCK_AIR) {
+			// Блок мог получить другой фоллбек
+			DropFallback(world);
 			if(bdef->flags & BDF_UNDEFINED) {
-				for(ClientID id = 0; id < MAX_CLIENTS; id++) {
-					Client *client = Clients_List[id];
-					if(client && Client_IsInWorld(client, world))
-						Client_UndefineBlock(client, bid);
-				}
+				for(cs_uint16 i = 0; i < world->clients.count; i++)
+					Client_UndefineBlock(world->clients.list[i], bid);
 				world->info.bdefines[bid] = NULL;
 			} else {
-				for(ClientID id = 0; id < MAX_CLIENTS; id++) {
-					Client *client = Clients_List[id];
-					if(client && Client_IsInWorld(client, world))
-						Client_DefineBlock(client, bid, bdef);
-				}
+				for(cs_uint16 i = 0; i < world->clients.count; i++)
+					Client_DefineBlock(world->clients.list[i], bid, bdef);
 			}
 		}
 	}
@@ -152,11 +170,8 @@ cs_bool Block_BulkUpdateAdd(BulkBlockUpdate *bbu, cs_uint32 offset, BlockID id)
 cs_bool Block_BulkUpdateSend(BulkBlockUpdate *bbu) {
 	if(!bbu->world) return false;
 
-	for(ClientID cid = 0; cid < MAX_CLIENTS; cid++) {
-		Client *client = Clients_List[cid];
-		if(client && Client_IsInWorld(client, bbu->world))
-			Client_BulkBlockUpdate(client, bbu);
-	}
+	for(cs_uint16 i = 0; i < bbu->world->clients.count; i++)
+		Client_BulkBlockUpdate(bbu->world->clients.list[i], bbu);
 
 	return true;
 }
@@ -4,9 +4,20 @@
 #include "types/world.h"
 #include "types/cpe.h"
 #include "types/block.h"
+#include "types/remap.h"
 
 #ifndef CORE_BUILD_PLUGIN
 	BlockDef *Block_GetDefinition(World *world, BlockID id);
+
+	/**
+	 * @brief Возвращает таблицу фоллбек блоков мира для
+	 * клиентов без поддержки дополнений CPE. Таблица
+	 * перестраивается после изменения определений блоков.
+	 * 
+	 * @param world целевой мир
+	 * @return таблица замены блоков
+	 */
+	const RemapTable *Block_GetFallbackTable(World *world);
 #endif
 
 /**
@@ -0,0 +1,213 @@
+#include "core.h"
+#include "platform.h"
+#include "bricks.h"
+
+#define BRICK_MASK (BRICK_SIZE - 1)
+#define BRICK_PACKED (BRICK_VOLUME / 2)
+
+INL static cs_uint32 DataSize(cs_byte bits) {
+	return bits == 4 ? BRICK_PACKED : (bits == 8 ? BRICK_VOLUME : 0);
+}
+
+INL static cs_byte GetIndex(const BlockID *data, cs_uint32 i) {
+	return (data[i >> 1] >> ((i & 1) << 2)) & 0x0F;
+}
+
+INL static void SetIndex(BlockID *data, cs_uint32 i, cs_byte idx) {
+	cs_byte shift = (cs_byte)((i & 1) << 2);
+	data[i >> 1] = (BlockID)((data[i >> 1] & ~(0x0F << shift)) | (idx << shift));
+}
+
+// Находит брик и положение блока внутри него
+// по смещению блока в плоском массиве мира
+INL static Brick *Locate(BrickStore *store, cs_uint32 offset, cs_uint32 *inner) {
+	cs_uint32 dx = (cs_uint32)store->dims.x, dz = (cs_uint32)store->dims.z,
+	x = offset % dx, z = (offset / dx) % dz, y = offset / dx / dz;
+	*inner = (((y & BRICK_MASK) << BRICK_SHIFT | (z & BRICK_MASK)) << BRICK_SHIFT) | (x & BRICK_MASK);
+	return &store->list[((y >> BRICK_SHIFT) * store->bz + (z >> BRICK_SHIFT)) * store->bx + (x >> BRICK_SHIFT)];
+}
+
+INL static cs_uint32 BrickCount(cs_int16 dim) {
+	return ((cs_uint32)dim + BRICK_MASK) >> BRICK_SHIFT;
+}
+
+// Границы брика, обрезанные по размерам мира
+typedef struct _BrickBounds {
+	cs_uint32 x, y, z; // Начало брика в мире
+	cs_uint32 w, h, d; // Размеры видимой части брика
+} BrickBounds;
+
+INL static void GetBounds(BrickStore *store, cs_uint32 bx, cs_uint32 by, cs_uint32 bz, BrickBounds *bb) {
+	bb->x = bx << BRICK_SHIFT, bb->y = by << BRICK_SHIFT, bb->z = bz << BRICK_SHIFT;
+	bb->w = min((cs_uint32)store->dims.x - bb->x, BRICK_SIZE);
+	bb->h = min((cs_uint32)store->dims.y - bb->y, BRICK_SIZE);
+	bb->d = min((cs_uint32)store->dims.z - bb->z, BRICK_SIZE);
+}
+
+static cs_bool PackBrick(BrickStore *store, Brick *brick, BrickBounds *bb, const BlockID *blocks) {
+	cs_uint32 dx = (cs_uint32)store->dims.x, dz = (cs_uint32)store->dims.z;
+	cs_int16 map[256];
+	cs_bool overflow = false;
+
+	// Собираем палитру, пока в ней хватает места
+	Memory_Fill(map, sizeof(map), 0xFF);
+	for(cs_uint32 y = 0; y < bb->h && !overflow; y++) {
+		for(cs_uint32 z = 0; z < bb->d && !overflow; z++) {
+			const BlockID *row = blocks + ((bb->y + y) * dz + bb->z + z) * dx + bb->x;
+			for(cs_uint32 x = 0; x < bb->w; x++) {
+				if(brick->count > 0 && row[x] == brick->palette[brick->count - 1]) continue;
+				if(map[row[x]] >= 0) continue;
+				if(brick->count == BRICK_PALETTE) {
+					overflow = true;
+					break;
+				}
+				map[row[x]] = brick->count;
+				brick->palette[brick->count++] = row[x];
+			}
+		}
+	}
+
+	if(brick->count < 2) return true;
+
+	brick->bits = overflow ? 8 : 4;
+	if((brick->data = Memory_TryAlloc(1, DataSize(brick->bits))) == NULL)
+		return false;
+	store->memory += DataSize(brick->bits);
+
+	for(cs_uint32 y = 0; y < bb->h; y++) {
+		for(cs_uint32 z = 0; z < bb->d; z++) {
+			const BlockID *row = blocks + ((bb->y + y) * dz + bb->z + z) * dx + bb->x;
+			cs_uint32 inner = (y << BRICK_SHIFT | z) << BRICK_SHIFT;
+			if(brick->bits == 8)
+				Memory_Copy(brick->data + inner, row, bb->w);
+			else for(cs_uint32 x = 0; x < bb->w; x++)
+				SetIndex(brick->data, inner + x, (cs_byte)map[row[x]]);
+		}
+	}
+
+	return true;
+}
+
+cs_bool Bricks_Pack(BrickStore *store, const SVec *dims, const BlockID *blocks) {
+	store->dims = *dims;
+	store->bx = BrickCount(dims->x);
+	store->bz = BrickCount(dims->z);
+	store->count = store->bx * store->bz * BrickCount(dims->y);
+	if((store->list = Memory_TryAlloc(store->count, sizeof(Brick))) == NULL)
+		return false;
+	store->memory = (cs_uint64)store->count * sizeof(Brick);
+
+	Brick *brick = store->list;
+	for(cs_uint32 by = 0; by < BrickCount(dims->y); by++) {
+		for(cs_uint32 bz = 0; bz < store->bz; bz++) {
+			for(cs_uint32 bx = 0; bx < store->bx; bx++, brick++) {
+				BrickBounds bb;
+				GetBounds(store, bx, by, bz, &bb);
+				if(!PackBrick(store, brick, &bb, blocks)) {
+					Bricks_Free(store);
+					return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+void Bricks_Flatten(BrickStore *store, BlockID *blocks) {
+	cs_uint32 dx = (cs_uint32)store->dims.x, dz = (cs_uint32)store->dims.z;
+	Brick *brick = store->list;
+
+	for(cs_uint32 by = 0; by < BrickCount(store->dims.y); by++) {
+		for(cs_uint32 bz = 0; bz < store->bz; bz++) {
+			for(cs_uint32 bx = 0; bx < store->bx; bx++, brick++) {
+				BrickBounds bb;
+				GetBounds(store, bx, by, bz, &bb);
+				for(cs_uint32 y = 0; y < bb.h; y++) {
+					for(cs_uint32 z = 0; z < bb.d; z++) {
+						BlockID *row = blocks + ((bb.y + y) * dz + bb.z + z) * dx + bb.x;
+						cs_uint32 inner = (y << BRICK_SHIFT | z) << BRICK_SHIFT;
+						switch(brick->bits) {
+							case 0:
+								Memory_Fill(row, bb.w, brick->palette[0]);
+								break;
+							case 4:
+								for(cs_uint32 x = 0; x < bb.w; x++)
+									row[x] = brick->palette[GetIndex(brick->data, inner + x)];
+								break;
+							default:
+								Memory_Copy(row, brick->data + inner, bb.w);
+								break;
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+BlockID Bricks_Get(BrickStore *store, cs_uint32 offset) {
+	cs_uint32 inner;
+	Brick *brick = Locate(store, offset, &inner);
+	switch(brick->bits) {
+		case 0: return brick->palette[0];
+		case 4: return brick->palette[GetIndex(brick->data, inner)];
+		default: return brick->data[inner];
+	}
+}
+
+// Брику не хватило палитры, дальше он хранит блоки как есть
+static cs_bool Expand(BrickStore *store, Brick *brick) {
+	BlockID *data = Memory_TryAlloc(1, BRICK_VOLUME);
+	if(!data) return false;
+	for(cs_uint32 i = 0; i < BRICK_VOLUME; i++)
+		data[i] = brick->palette[GetIndex(brick->data, i)];
+	Memory_Free(brick->data);
+	store->memory += BRICK_VOLUME - BRICK_PACKED;
+	brick->data = data;
+	brick->bits = 8;
+	return true;
+}
+
+cs_bool Bricks_Set(BrickStore *store, cs_uint32 offset, BlockID id) {
+	cs_uint32 inner;
+	Brick *brick = Locate(store, offset, &inner);
+
+	if(brick->bits == 0) {
+		if(brick->palette[0] == id) return true;
+		// Нулевые индексы указывают на прежний блок брика
+		if((brick->data = Memory_TryAlloc(1, BRICK_PACKED)) == NULL)
+			return false;
+		store->memory += BRICK_PACKED;
+		brick->palette[1] = id;
+		brick->count = 2;
+		brick->bits = 4;
+		SetIndex(brick->data, inner, 1);
+		return true;
+	}
+
+	if(brick->bits == 4) {
+		cs_byte idx = 0;
+		while(idx < brick->count && brick->palette[idx] != id) idx++;
+		if(idx < brick->count || brick->count < BRICK_PALETTE) {
+			if(idx == brick->count) brick->palette[brick->count++] = id;
+			SetIndex(brick->data, inner, idx);
+			return true;
+		}
+		if(!Expand(store, brick)) return false;
+	}
+
+	brick->data[inner] = id;
+	return true;
+}
+
+void Bricks_Free(BrickStore *store) {
+	if(store->list) {
+		for(cs_uint32 i = 0; i < store->count; i++)
+			if(store->list[i].data) Memory_Free(store->list[i].data);
+		Memory_Free(store->list);
+		store->list = NULL;
+	}
+	store->count = 0;
+	store->memory = 0;
+}
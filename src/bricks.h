@@ -0,0 +1,56 @@
+#ifndef BRICKS_H
+#define BRICKS_H
+#include "core.h"
+#include "types/bricks.h"
+
+#ifndef CORE_BUILD_PLUGIN
+	/**
+	 * @brief Упаковывает плоский массив блоков в брики 16x16x16.
+	 * Однородные брики хранятся одним значением, брики до 16
+	 * разных блоков - 4-битными индексами палитры.
+	 *
+	 * @param store указатель на хранилище бриков
+	 * @param dims размеры мира
+	 * @param blocks массив блоков в порядке Y-Z-X
+	 * @return true - массив упакован, false - не хватило памяти
+	 */
+	cs_bool Bricks_Pack(BrickStore *store, const SVec *dims, const BlockID *blocks);
+
+	/**
+	 * @brief Распаковывает брики обратно в плоский массив.
+	 *
+	 * @param store указатель на хранилище бриков
+	 * @param blocks массив, в который будут записаны блоки
+	 */
+	void Bricks_Flatten(BrickStore *store, BlockID *blocks);
+
+	/**
+	 * @brief Возвращает блок по его смещению в плоском массиве.
+	 *
+	 * @param store указатель на хранилище бриков
+	 * @param offset смещение блока
+	 * @return идентификатор блока
+	 */
+	BlockID Bricks_Get(BrickStore *store, cs_uint32 offset);
+
+	/**
+	 * @brief Устанавливает блок по его смещению в плоском массиве.
+	 * Брику может потребоваться палитра больше, в таком случае
+	 * его данные будут перевыделены.
+	 *
+	 * @param store указатель на хранилище бриков
+	 * @param offset смещение блока
+	 * @param id идентификатор блока
+	 * @return true - блок установлен, false - не хватило памяти
+	 */
+	cs_bool Bricks_Set(BrickStore *store, cs_uint32 offset, BlockID id);
+
+	/**
+	 * @brief Освобождает все брики хранилища.
+	 *
+	 * @param store указатель на хранилище бриков
+	 */
+	void Bricks_Free(BrickStore *store);
+#endif
+
+#endif
@@ -10,9 +10,13 @@
 #include "strstor.h"
 #include "compr.h"
 #include "world.h"
+#include "mapcache.h"
+#include "aoi.h"
 #include "websock.h"
 #include "groups.h"
 #include "cpe.h"
+#include "log.h"
+#include "remap.h"
 
 Client *Clients_List[MAX_CLIENTS] = {NULL};
 
@@ -45,6 +49,29 @@ void Client_Init(Client *client, Socket fd, cs_ulong addr) {
 	String_Copy(client->cpeData.appName, MAX_STR_LEN, "Vanilla client");
 }
 
+static void SetPlayerWorld(Client *client, World *world) {
+	World *prev = client->playerData.world;
+	if(prev == world) return;
+
+	if(prev) {
+		struct _WorldClients *wc = &prev->clients;
+		Client *last = wc->list[--wc->count];
+		wc->list[client->playerData.worldSlot] = last;
+		last->playerData.worldSlot = client->playerData.worldSlot;
+		wc->list[wc->count] = NULL;
+		if(!Client_IsBot(client)) wc->players--;
+	}
+
+	if(world) {
+		struct _WorldClients *wc = &world->clients;
+		client->playerData.worldSlot = wc->count;
+		wc->list[wc->count++] = client;
+		if(!Client_IsBot(client)) wc->players++;
+	}
+
+	client->playerData.world = world;
+}
+
 Client *Client_NewBot(void) {
 	ClientID botid = FindFreeID();
 	if(botid == CLIENT_SELF)
@@ -52,7 +79,7 @@ Client *Client_NewBot(void) {
 
 	Client *client = Memory_Alloc(1, sizeof(Client));
 	Client_Init(client, INVALID_SOCKET, 0xFFFFFFFF);
-	client->playerData.world = World_Main;
+	SetPlayerWorld(client, World_Main);
 	client->state = CLIENT_STATE_INGAME;
 	client->id = botid;
 
@@ -195,6 +222,10 @@ cs_float Client_GetClickDistanceInBlocks(Client *client) {
 cs_int32 Client_GetExtVer(Client *client, cs_ulong exthash) {
 	if(Client_IsBot(client)) return 0;
 
+	cs_int16 idx = CPE_GetExtIndex(exthash);
+	if(idx >= 0) return client->cpeData.extensions.versions[idx];
+
+	// Дополнения, не зарегистрированные сервером, ищем по списку
 	for(cs_int16 i = 0; i < client->cpeData.extensions.count; i++)
 		if(client->cpeData.extensions.list[i].hash == exthash)
 			return client->cpeData.extensions.list[i].version;
@@ -202,14 +233,38 @@ cs_int32 Client_GetExtVer(Client *client, cs_ulong exthash) {
 	return 0;
 }
 
+// Собирает сущности, связанные с игроком видимостью хотя бы
+// в одну сторону: заспавненные у него и те, у кого заспавнен он
+static cs_uint32 CollectLinked(Client *client, ClientID *ids) {
+	cs_uint32 count = 0;
+	for(cs_uint32 i = 0; i < AOI_SEEN_SIZE; i++) {
+		cs_byte bits = client->playerData.seen[i] | client->playerData.seenby[i];
+		for(cs_byte j = 0; bits; j++, bits >>= 1)
+			if(bits & 1) ids[count++] = (ClientID)(i * 8 + j);
+	}
+
+	return count;
+}
+
 cs_bool Client_Despawn(Client *client) {
 	if(!client->playerData.spawned)
 		return false;
 	client->playerData.spawned = false;
-	for(cs_uint32 i = 0; i < MAX_CLIENTS; i++) {
-		Client *other = Clients_List[i];
-		if(other) Vanilla_WriteDespawn(other, client);
+	Vanilla_BroadcastDespawn(client);
+
+	ClientID ids[MAX_CLIENTS];
+	cs_uint32 count = CollectLinked(client, ids);
+	for(cs_uint32 i = 0; i < count; i++) {
+		Client *other = Clients_List[ids[i]];
+		if(!other) continue;
+		other->playerData.seen[client->id / 8] &= (cs_byte)~BIT(client->id % 8);
+		other->playerData.seenby[client->id / 8] &= (cs_byte)~BIT(client->id % 8);
 	}
+	Memory_Fill(client->playerData.seen, AOI_SEEN_SIZE, 0);
+	Memory_Fill(client->playerData.seenby, AOI_SEEN_SIZE, 0);
+
+	World *world = client->playerData.world;
+	if(world) AOI_Remove(&world->aoi, client->id);
 	Event_Call(EVT_ONDESPAWN, client);
 	return true;
 }
@@ -217,7 +272,7 @@ cs_bool Client_Despawn(Client *client) {
 cs_bool Client_ChangeWorld(Client *client, World *world) {
 	if(Client_IsBot(client)) {
 		Client_Despawn(client);
-		client->playerData.world = world;
+		SetPlayerWorld(client, world);
 		client->playerData.position = world->info.spawnVec;
 		client->playerData.angle = world->info.spawnAng;
 		return true;
@@ -313,15 +368,8 @@ cs_bool Client_TeleportTo(Client *client, Vec *pos, Ang *ang) {
 		Vanilla_WriteTeleport(client, pos, ang);
 		client->playerData.position = *pos;
 		client->playerData.angle = *ang;
-		if(Client_IsBot(client)) {
-			for(ClientID i = 0; i < MAX_CLIENTS; i++) {
-				Client *other = Clients_List[i];
-				if(!other || Client_IsBot(other)) continue;
-				if(!Client_CheckState(other, CLIENT_STATE_INGAME)) continue;
-				if(!Client_IsInSameWorld(other, client)) continue;
-				Vanilla_WritePosAndOrient(other, client);
-			}
-		}
+		if(Client_IsBot(client))
+			client->playerData.moved = true;
 		return true;
 	}
 	return false;
@@ -373,31 +421,58 @@ INL static cs_uint32 CopyMessagePart(cs_str msg, cs_char *part, cs_uint32 i, cs_
 	return len;
 }
 
-void Client_Chat(Client *client, EMesgType type, cs_str message) {
-	if(client && Client_IsBot(client)) return;
+static cs_bool WriteChatParts(Client *client, SharedPacket *sp, cs_byte var, cs_str message) {
+	cs_bool sanitize = sp ? var != 0 : !client->cpeData.markedAsCPE;
+	cs_char color = 0, part[MAX_STR_LEN] = {0};
+	cs_bool next = false;
 
-	if(client && type == MESSAGE_TYPE_CHAT) {
-		cs_char color = 0, part[MAX_STR_LEN] = {0};
-		cs_bool next = false;
-		while(*message != '\0') {
-			cs_uint32 len = CopyMessagePart(message, part, next, &color, !client->cpeData.markedAsCPE);
-			if(len > 0) {
-				if((!next && *part != '\0') || (next && *(part + 2) != '\0'))
-					Vanilla_WriteChat(client, type, part);
-				message += len;
-				next = true;
+	while(*message != '\0') {
+		cs_uint32 len = CopyMessagePart(message, part, next, &color, sanitize);
+		if(len > 0) {
+			if((!next && *part != '\0') || (next && *(part + 2) != '\0')) {
+				if(!sp) Vanilla_WriteChat(client, MESSAGE_TYPE_CHAT, part);
+				else if(!Vanilla_SharedChat(sp, var, MESSAGE_TYPE_CHAT, part))
+					return false;
 			}
+			message += len;
+			next = true;
 		}
+	}
+
+	return true;
+}
 
+void Client_Chat(Client *client, EMesgType type, cs_str message) {
+	if(client && Client_IsBot(client)) return;
+
+	if(client && type == MESSAGE_TYPE_CHAT) {
+		WriteChatParts(client, NULL, 0, message);
 		return;
 	}
 
 	if(client == CLIENT_BROADCAST) {
+		SharedPacket sp = {0};
 		for(ClientID i = 0; i < MAX_CLIENTS; i++) {
 			Client *bclient = Clients_List[i];
-			if(bclient) Client_Chat(bclient, type, message);
+			if(!bclient || Client_IsBot(bclient)) continue;
+
+			// Сообщение нарезается по-разному только
+			// для клиентов с поддержкой CPE и без неё
+			cs_byte var = type == MESSAGE_TYPE_CHAT && !bclient->cpeData.markedAsCPE;
+			if(!Proto_SharedIsReady(&sp, var)) {
+				cs_bool encoded = type == MESSAGE_TYPE_CHAT ?
+				WriteChatParts(NULL, &sp, var, message) :
+				Vanilla_SharedChat(&sp, var, type, message);
+				if(!encoded) {
+					Client_Chat(bclient, type, message);
+					continue;
+				}
+			}
+
+			Proto_SharedSend(&sp, var, bclient);
 		}
 
+		Proto_SharedFree(&sp);
 		return;
 	}
 
@@ -421,6 +496,11 @@ cs_bool Client_IsInSameWorld(Client *client, Client *other) {
 	return Client_GetWorld(client) == Client_GetWorld(other);
 }
 
+cs_bool Client_CanSee(Client *client, Client *other) {
+	if(client == other) return true;
+	return (client->playerData.seen[other->id / 8] & BIT(other->id % 8)) != 0;
+}
+
 cs_bool Client_IsInWorld(Client *client, World *world) {
 	return Client_GetWorld(client) == world;
 }
@@ -437,10 +517,14 @@ cs_bool Client_IsFirstSpawn(Client *client) {
 	return client->playerData.firstSpawn;
 }
 
+cs_bool Client_IsFallbackNeeded(Client *client) {
+	return Client_GetExtVer(client, EXT_CUSTOMBLOCKS) < 1 ||
+	(Client_GetExtVer(client, EXT_BLOCKDEF) || Client_GetExtVer(client, EXT_BLOCKDEF2)) < 1;
+}
+
 void Client_SetBlock(Client *client, SVec *pos, BlockID id) {
-	if(Client_GetExtVer(client, EXT_CUSTOMBLOCKS) < 1 ||
-	(Client_GetExtVer(client, EXT_BLOCKDEF) || Client_GetExtVer(client, EXT_BLOCKDEF2)) < 1)
-		id = Block_GetFallbackFor(Client_GetWorld(client), id);
+	if(Client_IsFallbackNeeded(client))
+		id = Block_GetFallbackTable(Client_GetWorld(client))->lut[id];
 
 	Vanilla_WriteSetBlock(client, pos, id);
 }
@@ -665,6 +749,14 @@ cs_bool Client_SendHacks(Client *client, CPEHacks *hacks) {
 }
 
 void Client_BulkBlockUpdate(Client *client, BulkBlockUpdate *bbu) {
+	BulkBlockUpdate fbbu;
+	if(Client_IsFallbackNeeded(client)) {
+		fbbu = *bbu;
+		Remap_Apply(Block_GetFallbackTable(Client_GetWorld(client)),
+			bbu->data.ids, fbbu.data.ids, bbu->data.count);
+		bbu = &fbbu;
+	}
+
 	if(Client_GetExtVer(client, EXT_BULKUPDATE)) {
 		CPE_WriteBulkBlockUpdate(client, bbu);
 	} else {
@@ -740,7 +832,7 @@ cs_bool Client_Update(Client *client) {
 				client->cpeData.updates |= CPE_EMODVAL_ENTITY;
 				PushClientName(other, client);
 			}
-			if(Client_IsInSameWorld(client, other)) {
+			if(Client_CanSee(other, client)) {
 				if(client->cpeData.updates & CPE_EMODVAL_ENTITY && hasplsupport) {
 					client->cpeData.updates |= CPE_EMODVAL_MODEL;
 					SendCPEEntity(other, client);
@@ -776,6 +868,10 @@ void Client_Free(Client *client) {
 		Memory_Free(client->websock);
 		client->websock = NULL;
 	}
+	if(client->packetData.partial) {
+		Memory_Free(client->packetData.partial);
+		client->packetData.partial = NULL;
+	}
 	if(client->kickReason) {
 		Memory_Free((void *)client->kickReason);
 		client->kickReason = false;
@@ -791,7 +887,11 @@ void Client_Free(Client *client) {
 	}
 
 	NetBuffer_ForceClose(&client->netbuf);
-	Compr_Cleanup(&client->mapData.compr);
+	SetPlayerWorld(client, NULL);
+	if(client->mapData.cache) {
+		MapCache_Release(client->mapData.cache);
+		World_EndTask(client->mapData.world);
+	}
 	Memory_Free(client);
 }
 
@@ -819,42 +919,95 @@ INL static cs_uint16 GetPacketSizeFor(Packet *packet, Client *client, cs_bool *e
 	return packet->size;
 }
 
-INL static void PacketReceiverWs(Client *client) {
-	wsrecvmark:
-	if(WebSock_Tick(client->websock, &client->netbuf)) {
-		if(client->websock->opcode == 0x08) {
-			NetBuffer_ForceClose(&client->netbuf);
-			return;
+INL static cs_bool BeginPacket(Client *client, EPacketID packetId) {
+	PacketData *pdata = &client->packetData;
+	pdata->packet = Packet_Get(packetId);
+	if(!pdata->packet) {
+		Client_KickFormat(client, Sstor_Get("KICK_PERR_NOHANDLER"), packetId);
+		return false;
+	}
+
+	pdata->psize = GetPacketSizeFor(pdata->packet, client, &pdata->isExtended);
+	return true;
+}
+
+INL static void FinishPacket(Client *client, cs_char *data) {
+	HandlePacket(client, data);
+	client->lastmsg = Time_GetMSec();
+	client->packetData.packet = NULL;
+	client->packetData.psize = 0;
+}
+
+/*
+ * Полезная нагрузка фреймов идёт в тот же автомат,
+ * что и данные обычного сокета. Пакет, целиком
+ * лежащий во фрейме, обрабатывается прямо в буфере
+ * сокета, а разрезанный между фреймами собирается
+ * в отдельном буфере по мере прихода фреймов.
+*/
+static cs_bool FeedPayload(Client *client, cs_char *data, cs_uint32 avail) {
+	PacketData *pdata = &client->packetData;
+
+	while(avail > 0) {
+		if(!pdata->packet) {
+			if(!BeginPacket(client, (EPacketID)*data++)) return false;
+			avail -= 1;
 		}
 
-		cs_char *data = client->websock->payload;
-		cs_uint16 availpay = client->websock->paylen;
-		PacketData *pdata = &client->packetData;
+		if(pdata->partlen == 0 && avail >= pdata->psize) {
+			cs_uint16 psize = pdata->psize;
+			FinishPacket(client, data);
+			data += psize, avail -= psize;
+			continue;
+		}
 
-		while(availpay > 0) {
-			EPacketID packetId = (EPacketID)*data++;
-			pdata->packet = Packet_Get(packetId);
-			if(!pdata->packet) {
-				Client_KickFormat(client, Sstor_Get("KICK_PERR_NOHANDLER"), packetId);
-				return;
-			}
-			pdata->psize = GetPacketSizeFor(pdata->packet, client, &pdata->isExtended);
-			availpay -= 1;
-
-			if(availpay >= pdata->psize) {
-				HandlePacket(client, data);
-				client->lastmsg = Time_GetMSec();
-				availpay -= pdata->psize;
-				data += pdata->psize;
+		if(pdata->partcap < pdata->psize) {
+			cs_char *partial = pdata->partial ? Memory_TryRealloc(pdata->partial, pdata->psize)
+			: Memory_TryAlloc(1, pdata->psize);
+			if(!partial) {
+				Client_Kick(client, Sstor_Get("KICK_INT"));
+				return false;
 			}
+			pdata->partial = partial;
+			pdata->partcap = pdata->psize;
 		}
 
-		goto wsrecvmark;
-	} else if(client->websock->error != WEBSOCK_ERROR_CONTINUE) {
-		if(client->websock->error == WEBSOCK_ERROR_SOCKET)
+		cs_uint32 part = min(avail, (cs_uint32)(pdata->psize - pdata->partlen));
+		Memory_Copy(pdata->partial + pdata->partlen, data, part);
+		pdata->partlen += (cs_uint16)part;
+		data += part, avail -= part;
+		if(pdata->partlen == pdata->psize) {
+			pdata->partlen = 0;
+			FinishPacket(client, pdata->partial);
+		}
+	}
+
+	return true;
+}
+
+INL static void PacketReceiverWs(Client *client) {
+	WebSock *ws = client->websock;
+
+	while(WebSock_Tick(ws, &client->netbuf)) {
+		switch(ws->opcode) {
+			case 0x08:
+				NetBuffer_ForceClose(&client->netbuf);
+				return;
+			// Пинги и понги не несут игровых данных
+			case 0x09:
+			case 0x0A:
+				continue;
+		}
+
+		if(!FeedPayload(client, ws->payload, ws->paylen))
+			return;
+	}
+
+	if(ws->error != WEBSOCK_ERROR_CONTINUE) {
+		if(ws->error == WEBSOCK_ERROR_SOCKET)
 			NetBuffer_ForceClose(&client->netbuf);
 		else
-			Client_KickFormat(client, WebSock_GetError(client->websock));
+			Client_KickFormat(client, WebSock_GetError(ws));
 	}
 }
 
@@ -864,22 +1017,13 @@ INL static void PacketReceiverRaw(Client *client) {
 
 	if(!pdata->packet) {
 		if(NetBuffer_AvailRead(&client->netbuf) >= 1) {
-			EPacketID packetId = (EPacketID)*NetBuffer_Read(&client->netbuf, 1);
-			pdata->packet = Packet_Get(packetId);
-			if(!pdata->packet) {
-				Client_KickFormat(client, Sstor_Get("KICK_PERR_NOHANDLER"), packetId);
+			if(!BeginPacket(client, (EPacketID)*NetBuffer_Read(&client->netbuf, 1)))
 				return;
-			}
-
-			pdata->psize = GetPacketSizeFor(pdata->packet, client, &pdata->isExtended);
 		} else return;
 	}
 
 	if(NetBuffer_AvailRead(&client->netbuf) >= pdata->psize) {
-		HandlePacket(client, NetBuffer_Read(&client->netbuf, pdata->psize));
-		client->lastmsg = Time_GetMSec();
-		pdata->packet = NULL;
-		pdata->psize = 0;
+		FinishPacket(client, NetBuffer_Read(&client->netbuf, pdata->psize));
 		goto recvmark;
 	}
 }
@@ -887,14 +1031,25 @@ INL static void PacketReceiverRaw(Client *client) {
 NOINL static cs_bool SendWorldTick(Client *client) {
 	MapData *md = &client->mapData;
 
+	// Блоки мира читаются в фоне, сервер
+	// тем временем продолжает работать
+	if(World_IsLoading(md->world)) return false;
 	if(!World_IsReadyToPlay(md->world)) {
-		if(!World_Load(md->world)) {
+		// Мир уже загружали, но он так и не стал доступен
+		if(md->loading || !World_Load(md->world)) {
+			EWorldExtra extra = WORLD_EXTRA_NOINFO;
+			EWorldError code = World_PopError(md->world, &extra);
+			Log_Error(Sstor_Get("SV_WLOAD_ERR"), "load", World_GetName(md->world), code, extra);
+			md->loading = false;
 			Client_Kick(client, Sstor_Get("KICK_INT"));
 			return true;
 		}
+		md->loading = true;
+		return false;
 	}
+	md->loading = false;
 
-	if(md->sent == 0) { // Передача только началась
+	if(md->cache == NULL) { // Передача только началась
 		World_StartTask(md->world);
 		if(md->world != client->playerData.world) {
 			if(Client_GetExtVer(client, EXT_BLOCKDEF)) {
@@ -910,99 +1065,94 @@ NOINL static cs_bool SendWorldTick(Client *client) {
 			}
 		}
 
-		md->fastmap = Client_GetExtVer(client, EXT_FASTMAP) == 1;
-		md->fback = Client_GetExtVer(client, EXT_BLOCKDEF) < 1 ||
+		cs_bool fastmap = Client_GetExtVer(client, EXT_FASTMAP) == 1;
+		cs_bool fback = Client_GetExtVer(client, EXT_BLOCKDEF) < 1 ||
 		Client_GetExtVer(client, EXT_BLOCKDEF2) < 1 ||
 		Client_GetExtVer(client, EXT_CUSTOMBLOCKS) < 1;
-		if(md->fastmap) {
-			if(Compr_Init(&md->compr, COMPR_TYPE_DEFLATE)) {
-				md->cbptr = World_GetBlockArray(md->world, &md->size);
-				CPE_WriteFastMapInit(client, md->size);
-			} else goto mapfail;
-		} else {
-			if(Compr_Init(&md->compr, COMPR_TYPE_GZIP)) {
-				md->cbptr = World_GetData(md->world, &md->size);
-				Vanilla_WriteLvlInit(client);
-			} else goto mapfail;
+		// Сжатая карта общая для всех клиентов с одинаковым
+		// набором дополнений, так что мир сжимается один раз
+		if((md->cache = MapCache_Acquire(md->world, fastmap, fback)) == NULL) {
+			Client_Kick(client, Sstor_Get("KICK_INT"));
+			goto mapend;
 		}
+
+		if(fastmap)
+			CPE_WriteFastMapInit(client, World_GetBlockArraySize(md->world));
+		else
+			Vanilla_WriteLvlInit(client);
 	}
 
-	if(md->sent <= md->size) {
-		cs_uint64 markStart = Time_GetMSec();
-		cs_byte indata[10240] = {0};
-
-		while(NetBuffer_IsAlive(&client->netbuf)) {
-			cs_uint32 avail;
-			comprstep:
-			avail = min(md->size - md->sent, 10240);
-			if(avail > 0) {
-				if(md->fback) {
-					for(cs_uint32 i = 0; i < avail; i++) {
-						cs_uint32 offset = md->sent + i;
-						if(offset < 4 && !md->fastmap)
-							indata[i] = md->cbptr[offset];
-						else
-							indata[i] = Block_GetFallbackFor(md->world, md->cbptr[offset]);
-					}
-				} else
-					Memory_Copy(indata, md->cbptr + md->sent, avail);
-				Compr_SetInBuffer(&md->compr, indata, avail);
-				md->sent += avail;
-			}
+	cs_uint64 markStart = Time_GetMSec();
+	while(NetBuffer_IsAlive(&client->netbuf)) {
+		const cs_byte *chunk = NULL;
+		cs_uint32 avail = MapCache_Peek(md->cache, md->sent, &chunk);
 
+		if(avail > 0) {
 			Mutex_Lock(client->mutex);
-			while(true) {
-				cs_byte *data = (cs_byte *)NetBuffer_StartWrite(&client->netbuf, 1030);
-				Compr_SetOutBuffer(&md->compr, data + 3, 1024);
+			// Новые куски карты кладём в очередь только когда
+			// сокет успел отправить предыдущие, так на клиента
+			// не копится вся карта, а чат и перемещения других
+			// игроков не стоят за ней в очереди
+			while(avail > 0 && NetBuffer_IsWriteLow(&client->netbuf)) {
+				cs_uint16 len = (cs_uint16)min(avail, 1024);
+				cs_byte *data = (cs_byte *)NetBuffer_StartWrite(&client->netbuf, 1028);
+				if(!data) {
+					NetBuffer_ForceClose(&client->netbuf);
+					Mutex_Unlock(client->mutex);
+					goto mapend;
+				}
 				*data = 0x03;
-
-				if(Compr_Update(&md->compr)) {
-					if(md->compr.written > 0) {
-						*((cs_uint16 *)(data + 1)) = htons((cs_uint16)md->compr.written);
-						*(data + 1028) = (cs_byte)(((cs_float)md->sent / md->size) * 100);
-						if(!NetBuffer_EndWrite(&client->netbuf, 1028)) {
-							Mutex_Unlock(client->mutex);
-							goto mapend;
-						}
-					} else break;
-				} else {
+				*((cs_uint16 *)(data + 1)) = htons(len);
+				Memory_Copy(data + 3, chunk, len);
+				if(len < 1024) Memory_Zero(data + 3 + len, 1024 - len);
+				md->sent += len;
+				*(data + 1027) = MapCache_GetProgress(md->cache, md->sent);
+				if(!NetBuffer_EndWrite(&client->netbuf, 1028)) {
 					Mutex_Unlock(client->mutex);
-					goto mapfail;
+					goto mapend;
 				}
+				chunk += len;
+				avail -= len;
 			}
+			NetBuffer_Flush(&client->netbuf);
+			cs_bool backlog = !NetBuffer_IsWriteLow(&client->netbuf);
 			Mutex_Unlock(client->mutex);
-
-			if(Compr_IsInState(&md->compr, COMPR_STATE_DONE))
-				break;
-
-			// Не даём серверу слишком долго сжимать карту для клиента
-			// Поле taskc хранит в себе количество подключающихся в данный момент клиентов к данному миру
-			if(Time_GetMSec() - markStart < (TICKS_PER_SECOND / md->world->taskc))
-				goto comprstep;
-			else
-				return false;
+			if(backlog) return false;
+			continue;
 		}
 
-		if(!NetBuffer_IsAlive(&client->netbuf)) {
-			goto mapfail;
-		} else {
+		if(MapCache_IsDone(md->cache)) {
 			Vanilla_WriteLvlFin(client, &md->world->info.dimensions);
-			client->playerData.world = md->world;
+			SetPlayerWorld(client, md->world);
 			client->state = CLIENT_STATE_INGAME;
 			Client_Spawn(client);
 			goto mapend;
 		}
+
+		if(!MapCache_Step(md->cache))
+			goto mapfail;
+		if(MapCache_IsBusy(md->cache))
+			return false;
+
+		// Не даём серверу слишком долго сжимать карту для клиента
+		// Поле taskc хранит в себе количество подключающихся в данный момент клиентов к данному миру
+		if(Time_GetMSec() - markStart >= (TICKS_PER_SECOND / md->world->taskc))
+			return false;
 	}
 
+	goto mapend;
+
 	mapfail:
-	Client_KickFormat(client, Sstor_Get("KICK_ZERR"), Compr_GetLastError(&md->compr));
+	Client_KickFormat(client, Sstor_Get("KICK_ZERR"), MapCache_GetError(md->cache));
 
 	mapend:
 	World_EndTask(md->world);
-	Compr_Reset(&md->compr);
+	if(md->cache) {
+		MapCache_Release(md->cache);
+		md->cache = NULL;
+	}
 	md->world = NULL;
 	md->sent = 0;
-	md->size = 0;
 	return true;
 }
 
@@ -1023,6 +1173,75 @@ INL static void SendSpawnPacket(Client *client, Client *other) {
 		Vanilla_WriteSpawn(client, other);
 }
 
+static void ShowEntity(Client *client, Client *other) {
+	if(Client_IsBot(client) || Client_CanSee(client, other)) return;
+	client->playerData.seen[other->id / 8] |= (cs_byte)BIT(other->id % 8);
+	other->playerData.seenby[client->id / 8] |= (cs_byte)BIT(client->id % 8);
+	SendSpawnPacket(client, other);
+	if(Client_GetExtVer(client, EXT_CHANGEMODEL))
+		CPE_WriteSetModel(client, other);
+	// Новый наблюдатель знает о текущей позиции other, а
+	// остальные о разосланной, их надо синхронизировать
+	other->playerData.absolute = true;
+}
+
+static void HideEntity(Client *client, Client *other) {
+	if(client == other || !Client_CanSee(client, other)) return;
+	client->playerData.seen[other->id / 8] &= (cs_byte)~BIT(other->id % 8);
+	other->playerData.seenby[client->id / 8] &= (cs_byte)~BIT(client->id % 8);
+	Vanilla_WriteDespawn(client, other);
+}
+
+static void UpdateVisibility(Client *client) {
+	World *world = client->playerData.world;
+	Vec *pos = &client->playerData.position;
+	AOI_Update(&world->aoi, client->id, pos);
+	if(!AOI_IsEnabled()) return;
+
+	ClientID ids[MAX_CLIENTS];
+	cs_uint32 count = AOI_Query(&world->aoi, pos, ids);
+	for(cs_uint32 i = 0; i < count; i++) {
+		Client *other = Clients_List[ids[i]];
+		if(!other || other == client || !other->playerData.spawned) continue;
+		if(AOI_InRange(pos, &other->playerData.position, false)) {
+			ShowEntity(other, client);
+			ShowEntity(client, other);
+		}
+	}
+
+	// Пропасть могут только уже связанные с игроком сущности,
+	// поэтому остальных жителей мира не перебираем
+	count = CollectLinked(client, ids);
+	for(cs_uint32 i = 0; i < count; i++) {
+		Client *other = Clients_List[ids[i]];
+		if(!other || other == client) continue;
+		if(!AOI_InRange(pos, &other->playerData.position, true)) {
+			HideEntity(other, client);
+			HideEntity(client, other);
+		}
+	}
+}
+
+void Clients_SendMovement(void) {
+	// Сначала рассылаем передвижения тем, кто уже видит
+	// сущности, и только потом спавним их у новых наблюдателей,
+	// чтобы те получили позицию, совпадающую с разосланной
+	for(ClientID i = 0; i < MAX_CLIENTS; i++) {
+		Client *client = Clients_List[i];
+		if(!client || !client->playerData.moved) continue;
+		if(client->playerData.spawned && Client_CheckState(client, CLIENT_STATE_INGAME))
+			Vanilla_BroadcastMovement(client);
+	}
+
+	for(ClientID i = 0; i < MAX_CLIENTS; i++) {
+		Client *client = Clients_List[i];
+		if(!client || !client->playerData.moved) continue;
+		client->playerData.moved = false;
+		if(client->playerData.spawned && Client_CheckState(client, CLIENT_STATE_INGAME))
+			UpdateVisibility(client);
+	}
+}
+
 cs_bool Client_Spawn(Client *client) {
 	if(client->playerData.spawned)
 		return false;
@@ -1038,34 +1257,38 @@ cs_bool Client_Spawn(Client *client) {
 	if(evt.updateenv) Client_UpdateWorldInfo(client, client->playerData.world, true);
 	client->cpeData.updates = CPE_EMODVAL_NONE;
 
-	for(ClientID i = 0; i < MAX_CLIENTS; i++) {
-		Client *other = Clients_List[i];
-		if(!other || !Client_CheckState(other, CLIENT_STATE_INGAME)) continue;
-
-		if(client->playerData.firstSpawn) {
+	if(client->playerData.firstSpawn) {
+		for(ClientID i = 0; i < MAX_CLIENTS; i++) {
+			Client *other = Clients_List[i];
+			if(!other || !Client_CheckState(other, CLIENT_STATE_INGAME)) continue;
 			if(Client_GetExtVer(other, EXT_PLAYERLIST))
 				PushClientName(other, client);
 			if(Client_GetExtVer(client, EXT_PLAYERLIST) && client != other)
 				PushClientName(client, other);
 		}
+	}
 
-		if(Client_IsInSameWorld(client, other)) {
-			SendSpawnPacket(other, client);
-
-			if(Client_GetExtVer(other, EXT_CHANGEMODEL))
-				CPE_WriteSetModel(other, client);
-
-			if(client != other && !Client_IsBot(client)) {
-				SendSpawnPacket(client, other);
+	World *world = client->playerData.world;
+	if(world) {
+		for(cs_uint16 i = 0; i < world->clients.count; i++) {
+			Client *other = world->clients.list[i];
+			if(!Client_CheckState(other, CLIENT_STATE_INGAME)) continue;
 
+			if(client == other) {
+				SendSpawnPacket(client, client);
 				if(Client_GetExtVer(client, EXT_CHANGEMODEL))
-					CPE_WriteSetModel(client, other);
+					CPE_WriteSetModel(client, client);
+			} else if(AOI_InRange(&client->playerData.position, &other->playerData.position, false)) {
+				ShowEntity(other, client);
+				ShowEntity(client, other);
 			}
 		}
-	}
 
+		AOI_Update(&world->aoi, client->id, &client->playerData.position);
+	}
 	client->playerData.spawned = true;
 	client->playerData.firstSpawn = false;
+	client->playerData.absolute = true;
 	return true;
 }
 
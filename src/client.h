@@ -18,6 +18,8 @@
 
 	NOINL cs_bool Client_DefineBlock(Client *client, BlockID id, BlockDef *block);
 	NOINL cs_bool Client_UndefineBlock(Client *client, BlockID id);
+	cs_bool Client_IsFallbackNeeded(Client *client);
+	void Clients_SendMovement(void);
 #endif
 
 
@@ -51,6 +53,7 @@ API cs_bool Client_CheckState(Client *client, EClientState state);
 API cs_bool Client_IsClosed(Client *client);
 API cs_bool Client_IsLocal(Client *client);
 API cs_bool Client_IsInSameWorld(Client *client, Client *other);
+API cs_bool Client_CanSee(Client *client, Client *other);
 API cs_bool Client_IsInWorld(Client *client, World *world);
 API cs_bool Client_IsOP(Client *client);
 API cs_bool Client_IsSpawned(Client *client);
@@ -15,25 +15,139 @@ static struct _ZLib {
 	void *lib;
 
 	unsigned long(CCONV *crc32)(unsigned long start, const unsigned char *data, unsigned int len);
+	unsigned long(CCONV *crc32comb)(unsigned long crc1, unsigned long crc2, long len2);
 	unsigned long(CCONV *zflags)(void);
 	char *(CCONV *error)(int code);
 
 	int(CCONV *definit)(z_streamp strm, int level, int meth, int bits, int memlvl, int strat, const char *ver, int size);
 	int(CCONV *deflate)(z_streamp strm, int flush);
+	int(CCONV *defreset)(z_streamp strm);
+	int(CCONV *defparams)(z_streamp strm, int level, int strat);
+	int(CCONV *defdict)(z_streamp strm, const unsigned char *dict, unsigned int size);
 	int(CCONV *defend)(z_streamp strm);
 
 	int(CCONV *infinit)(z_streamp strm, int bits, const char *ver, int size);
 	int(CCONV *inflate)(z_streamp strm, int flush);
+	int(CCONV *infreset)(z_streamp strm);
 	int(CCONV *infend)(z_streamp strm);
 } zlib;
 
 static cs_str zsmylist[] = {
-	"crc32", "zlibCompileFlags", "zError",
-	"deflateInit2_", "deflate", "deflateEnd",
-	"inflateInit2_", "inflate", "inflateEnd",
+	"crc32", "crc32_combine", "zlibCompileFlags", "zError",
+	"deflateInit2_", "deflate", "deflateReset", "deflateParams",
+	"deflateSetDictionary", "deflateEnd",
+	"inflateInit2_", "inflate", "inflateReset", "inflateEnd",
 	NULL
 };
 
+// libdeflate не умеет сжимать потоком, зато данные,
+// лежащие в памяти целиком, сжимает в разы быстрее zlib
+static struct _LibDeflate {
+	void *lib;
+
+	void *(CCONV *alloc)(int level);
+	cs_size(CCONV *deflate)(void *c, const void *in, cs_size insize, void *out, cs_size outsize);
+	cs_size(CCONV *gzip)(void *c, const void *in, cs_size insize, void *out, cs_size outsize);
+	void(CCONV *free)(void *c);
+} libdeflate;
+
+static cs_str ldsymlist[] = {
+	"libdeflate_alloc_compressor",
+	"libdeflate_deflate_compress",
+	"libdeflate_gzip_compress",
+	"libdeflate_free_compressor",
+	NULL
+};
+
+static cs_str libdeflatedll[] = {
+#if defined(CORE_USE_WINDOWS)
+	"libdeflate.dll",
+	"deflate.dll",
+#elif defined(CORE_USE_UNIX)
+	"libdeflate." DLIB_EXT ".0",
+	"libdeflate." DLIB_EXT,
+#endif
+	NULL
+};
+
+// Кадровые кодеки для формата миров с независимыми кадрами
+static struct _LibZstd {
+	void *lib;
+
+	cs_size(CCONV *compress)(void *dst, cs_size cap, const void *src, cs_size size, int level);
+	cs_size(CCONV *decompress)(void *dst, cs_size cap, const void *src, cs_size size);
+	cs_size(CCONV *bound)(cs_size size);
+	unsigned(CCONV *iserror)(cs_size code);
+} libzstd;
+
+static cs_str zstdsymlist[] = {
+	"ZSTD_compress", "ZSTD_decompress",
+	"ZSTD_compressBound", "ZSTD_isError",
+	NULL
+};
+
+static cs_str libzstddll[] = {
+#if defined(CORE_USE_WINDOWS)
+	"libzstd.dll",
+	"zstd.dll",
+#elif defined(CORE_USE_UNIX)
+	"libzstd." DLIB_EXT ".1",
+	"libzstd." DLIB_EXT,
+#endif
+	NULL
+};
+
+static struct _LibLZ4 {
+	void *lib;
+
+	int(CCONV *compress)(const char *src, char *dst, int size, int cap);
+	int(CCONV *decompress)(const char *src, char *dst, int size, int cap);
+	int(CCONV *bound)(int size);
+} liblz4;
+
+static cs_str lz4symlist[] = {
+	"LZ4_compress_default", "LZ4_decompress_safe",
+	"LZ4_compressBound",
+	NULL
+};
+
+static cs_str liblz4dll[] = {
+#if defined(CORE_USE_WINDOWS)
+	"liblz4.dll",
+	"lz4.dll",
+#elif defined(CORE_USE_UNIX)
+	"liblz4." DLIB_EXT ".1",
+	"liblz4." DLIB_EXT,
+#endif
+	NULL
+};
+
+static cs_int32 levels[COMPR_USE_COUNT] = {
+	COMPR_LEVEL_DEFAULT, COMPR_LEVEL_DEFAULT
+};
+
+typedef struct _ComprEntry {
+	z_stream stream; // Должен идти первым, Compr::stream указывает сюда
+	cs_int32 level; // Уровень сжатия, с которым работает deflate
+	struct _ComprEntry *next;
+} ComprEntry;
+
+// Инициализация deflate с MAX_MEM_LEVEL стоит сотни
+// килобайт памяти, поэтому готовые контексты не
+// уничтожаются, а сбрасываются и ждут следующего
+// архиватора того же типа (тип определяет окно,
+// уровень сжатия у всех архиваторов одинаковый)
+static struct _ComprPool {
+	Mutex *mutex;
+	ComprEntry *head[COMPR_TYPE_GZIP + 1];
+	void *compressors[COMPR_LEVEL_MAX + 1]; // По одному свободному libdeflate компрессору на уровень
+	cs_bool fasttried; // Была ли попытка загрузить libdeflate
+	cs_bool codectried[COMPR_CODEC_COUNT]; // Была ли попытка загрузить библиотеку кодека
+	ComprPoolStats stats;
+} pool = {
+	.stats.limit = COMPR_POOL_DEFAULT
+};
+
 static cs_str zlibdll[] = {
 #if defined(CORE_USE_WINDOWS)
 #	ifdef CORE_BUILD_DEBUG
@@ -76,6 +190,101 @@ INL static cs_bool InitBackend(void) {
 	return true;
 }
 
+INL static cs_bool IsDeflate(ComprType type) {
+	return type == COMPR_TYPE_DEFLATE || type == COMPR_TYPE_GZIP;
+}
+
+INL static cs_bool IsInflate(ComprType type) {
+	return type == COMPR_TYPE_INFLATE || type == COMPR_TYPE_UNGZIP;
+}
+
+static void FreeEntry(ComprEntry *entry, ComprType type) {
+	if(IsDeflate(type) && zlib.defend)
+		zlib.defend(&entry->stream);
+	else if(IsInflate(type) && zlib.infend)
+		zlib.infend(&entry->stream);
+	Memory_Free(entry);
+}
+
+static ComprEntry *TakeEntry(ComprType type) {
+	ComprEntry *entry = NULL;
+	if(!pool.mutex) return NULL;
+
+	Mutex_Lock(pool.mutex);
+	if((entry = pool.head[type]) != NULL) {
+		pool.head[type] = entry->next;
+		pool.stats.idle--;
+		pool.stats.hits++;
+	} else pool.stats.misses++;
+	Mutex_Unlock(pool.mutex);
+
+	return entry;
+}
+
+static void ReleaseEntry(ComprEntry *entry, ComprType type) {
+	if(pool.mutex && (IsDeflate(type) || IsInflate(type))) {
+		int ret = IsDeflate(type) ? zlib.defreset(&entry->stream)
+		: zlib.infreset(&entry->stream);
+
+		if(ret == Z_OK) {
+			Mutex_Lock(pool.mutex);
+			if(pool.stats.idle < pool.stats.limit) {
+				entry->next = pool.head[type];
+				pool.head[type] = entry;
+				pool.stats.idle++;
+				entry = NULL;
+			}
+			Mutex_Unlock(pool.mutex);
+			if(!entry) return;
+		}
+	}
+
+	FreeEntry(entry, type);
+}
+
+// Уничтожает свободные архиваторы сверх указанного количества
+static void TrimPool(cs_uint32 keep) {
+	ComprEntry *trash[COMPR_TYPE_GZIP + 1] = {0};
+
+	Mutex_Lock(pool.mutex);
+	for(ComprType type = COMPR_TYPE_DEFLATE; type <= COMPR_TYPE_GZIP && pool.stats.idle > keep; type++) {
+		while(pool.head[type] && pool.stats.idle > keep) {
+			ComprEntry *entry = pool.head[type];
+			pool.head[type] = entry->next;
+			entry->next = trash[type];
+			trash[type] = entry;
+			pool.stats.idle--;
+		}
+	}
+	Mutex_Unlock(pool.mutex);
+
+	for(ComprType type = COMPR_TYPE_DEFLATE; type <= COMPR_TYPE_GZIP; type++) {
+		while(trash[type]) {
+			ComprEntry *next = trash[type]->next;
+			FreeEntry(trash[type], type);
+			trash[type] = next;
+		}
+	}
+}
+
+cs_bool ComprPool_Init(void) {
+	return (pool.mutex = Mutex_Create()) != NULL;
+}
+
+void ComprPool_SetLimit(cs_uint32 limit) {
+	if(!pool.mutex) return;
+	Mutex_Lock(pool.mutex);
+	pool.stats.limit = limit;
+	Mutex_Unlock(pool.mutex);
+	TrimPool(limit);
+}
+
+void ComprPool_GetStats(ComprPoolStats *stats) {
+	if(pool.mutex) Mutex_Lock(pool.mutex);
+	*stats = pool.stats;
+	if(pool.mutex) Mutex_Unlock(pool.mutex);
+}
+
 INL static cs_int32 getWndBits(ComprType type) {
 	switch(type) {
 		case COMPR_TYPE_DEFLATE:
@@ -90,27 +299,467 @@ INL static cs_int32 getWndBits(ComprType type) {
 	}
 }
 
+INL static cs_int32 ClampLevel(cs_int32 level) {
+	return min(max(level, COMPR_LEVEL_MIN), COMPR_LEVEL_MAX);
+}
+
 cs_bool Compr_Init(Compr *ctx, ComprType type) {
+	return Compr_InitLevel(ctx, type, COMPR_LEVEL_DEFAULT);
+}
+
+cs_bool Compr_InitLevel(Compr *ctx, ComprType type, cs_int32 level) {
 	if(!zlib.lib && !InitBackend()) return false;
+	if(!IsDeflate(type) && !IsInflate(type)) return false;
 
-	if(!ctx->stream) ctx->stream = Memory_Alloc(1, sizeof(z_stream));
+	if(ctx->stream) Compr_Reset(ctx);
 	ctx->state = COMPR_STATE_IDLE;
 	ctx->type = type;
+	level = ClampLevel(level);
+
+	ComprEntry *entry;
+	if((entry = TakeEntry(type)) != NULL) {
+		ctx->stream = entry;
+		ctx->ret = Z_OK;
+		// После deflateReset уровень сжатия остаётся прежним
+		if(IsDeflate(type) && entry->level != level) {
+			ctx->ret = zlib.defparams(&entry->stream, level, Z_DEFAULT_STRATEGY);
+			entry->level = level;
+		}
+		return ctx->ret == Z_OK;
+	}
+
+	if((entry = Memory_TryAlloc(1, sizeof(ComprEntry))) == NULL) {
+		ctx->ret = Z_MEM_ERROR;
+		ctx->type = COMPR_TYPE_NOTSET;
+		return false;
+	}
 
-	if(type == COMPR_TYPE_DEFLATE || type == COMPR_TYPE_GZIP)
+	ctx->stream = entry;
+	entry->level = level;
+	if(IsDeflate(type))
 		ctx->ret = zlib.definit(
-			ctx->stream, Z_DEFAULT_COMPRESSION,
+			ctx->stream, level,
 			Z_DEFLATED, getWndBits(type),
 			MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY,
 			ZLIB_VERSION, sizeof(z_stream)
 		);
-	else if(type == COMPR_TYPE_INFLATE || type == COMPR_TYPE_UNGZIP)
+	else
 		ctx->ret = zlib.infinit(
 			ctx->stream, getWndBits(type),
 			ZLIB_VERSION, sizeof(z_stream)
 		);
 
-	return ctx->ret == Z_OK;
+	if(ctx->ret != Z_OK) {
+		Memory_Free(ctx->stream);
+		ctx->stream = NULL;
+		ctx->type = COMPR_TYPE_NOTSET;
+		return false;
+	}
+
+	return true;
+}
+
+void Compr_SetLevel(ComprUse use, cs_int32 level) {
+	if(use < COMPR_USE_COUNT) levels[use] = ClampLevel(level);
+}
+
+cs_int32 Compr_GetLevel(ComprUse use) {
+	return use < COMPR_USE_COUNT ? levels[use] : COMPR_LEVEL_DEFAULT;
+}
+
+cs_bool Compr_HasFastPath(void) {
+	if(!pool.mutex) return false;
+
+	Mutex_Lock(pool.mutex);
+	if(!pool.fasttried) {
+		pool.fasttried = true;
+		DLib_LoadAll(libdeflatedll, ldsymlist, (void **)&libdeflate);
+	}
+	Mutex_Unlock(pool.mutex);
+
+	return libdeflate.lib != NULL;
+}
+
+cs_uint32 Compr_Bound(cs_uint32 insize) {
+	// С запасом покрывает и deflateBound, и оценку libdeflate
+	cs_uint64 bound = (cs_uint64)insize + (insize >> 9) + 64;
+	return bound > 0xFFFFFFFFu ? 0 : (cs_uint32)bound;
+}
+
+static cs_uint32 WholeFast(ComprType type, cs_int32 level, const void *in, cs_uint32 insize, void *out, cs_uint32 outsize) {
+	void *c;
+
+	Mutex_Lock(pool.mutex);
+	c = pool.compressors[level];
+	pool.compressors[level] = NULL;
+	Mutex_Unlock(pool.mutex);
+
+	if(!c && (c = libdeflate.alloc(level)) == NULL)
+		return 0;
+
+	cs_size written = type == COMPR_TYPE_GZIP
+	? libdeflate.gzip(c, in, insize, out, outsize)
+	: libdeflate.deflate(c, in, insize, out, outsize);
+
+	Mutex_Lock(pool.mutex);
+	if(!pool.compressors[level]) {
+		pool.compressors[level] = c;
+		c = NULL;
+	}
+	Mutex_Unlock(pool.mutex);
+	if(c) libdeflate.free(c);
+
+	return (cs_uint32)written;
+}
+
+static cs_uint32 WholeZlib(ComprType type, cs_int32 level, const void *in, cs_uint32 insize, void *out, cs_uint32 outsize) {
+	Compr ctx = {0};
+	cs_uint32 written = 0;
+
+	if(!Compr_InitLevel(&ctx, type, level)) return 0;
+	z_streamp stream = (z_streamp)ctx.stream;
+	stream->next_in = (Bytef *)in;
+	stream->avail_in = insize;
+	stream->next_out = out;
+	stream->avail_out = outsize;
+	if(zlib.deflate(stream, Z_FINISH) == Z_STREAM_END)
+		written = outsize - stream->avail_out;
+	Compr_Reset(&ctx);
+
+	return written;
+}
+
+cs_uint32 Compr_Whole(ComprType type, cs_int32 level, const void *in, cs_uint32 insize, void *out, cs_uint32 outsize) {
+	if(!IsDeflate(type)) return 0;
+	level = ClampLevel(level);
+
+	if(Compr_HasFastPath())
+		return WholeFast(type, level, in, insize, out, outsize);
+
+	return WholeZlib(type, level, in, insize, out, outsize);
+}
+
+typedef cs_bool(*ParallelFunc)(void *arg, cs_uint32 idx, cs_byte *tmp);
+
+typedef struct _ParallelRun {
+	Mutex *mutex;
+	cs_uint32 count, next; // Количество задач и следующая невыполненная задача
+	ParallelFunc func;
+	void *arg;
+	cs_uint32 tmpsize; // Размер временного буфера каждого потока
+	cs_bool failed;
+} ParallelRun;
+
+THREAD_FUNC(ParallelWorker) {
+	ParallelRun *run = (ParallelRun *)param;
+	cs_byte *tmp = NULL;
+
+	if(run->tmpsize > 0 && (tmp = Memory_TryAlloc(1, run->tmpsize)) == NULL) {
+		Mutex_Lock(run->mutex);
+		run->failed = true;
+		Mutex_Unlock(run->mutex);
+		return 0;
+	}
+
+	while(true) {
+		Mutex_Lock(run->mutex);
+		cs_uint32 idx = run->failed ? run->count : run->next++;
+		Mutex_Unlock(run->mutex);
+		if(idx >= run->count) break;
+
+		if(!run->func(run->arg, idx, tmp)) {
+			Mutex_Lock(run->mutex);
+			run->failed = true;
+			Mutex_Unlock(run->mutex);
+			break;
+		}
+	}
+
+	if(tmp) Memory_Free(tmp);
+	return 0;
+}
+
+INL static cs_uint32 ParallelThreads(cs_uint32 count) {
+	return min(min(Thread_GetCPUCount(), COMPR_PARALLEL_MAX), count);
+}
+
+// Раздаёт задачи с номерами [0, count) потокам и ждёт их выполнения
+static cs_bool RunParallel(cs_uint32 count, ParallelFunc func, void *arg, cs_uint32 tmpsize) {
+	ParallelRun run = {
+		.count = count, .func = func,
+		.arg = arg, .tmpsize = tmpsize
+	};
+	if((run.mutex = Mutex_Create()) == NULL)
+		return false;
+
+	Thread threads[COMPR_PARALLEL_MAX];
+	cs_uint32 nthreads = ParallelThreads(count);
+	for(cs_uint32 i = 1; i < nthreads; i++)
+		threads[i] = Thread_Create(ParallelWorker, &run, false);
+	// Вызывающий поток тоже выполняет свою долю задач
+	ParallelWorker(&run);
+	for(cs_uint32 i = 1; i < nthreads; i++)
+		Thread_Join(threads[i]);
+
+	Mutex_Free(run.mutex);
+	return !run.failed;
+}
+
+#define PARALLEL_DICT 32768
+
+typedef struct _ParallelJob {
+	cs_int32 level;
+	const cs_byte *in;
+	cs_uint32 insize;
+	cs_uint32 count; // Количество кусков
+	ComprTransform tf;
+	void *tfarg;
+	struct _ParallelBlock {
+		cs_byte *data; // Сжатый кусок
+		cs_uint32 size; // Размер сжатого куска
+		cs_ulong crc; // CRC32 несжатого куска
+	} *blocks;
+} ParallelJob;
+
+static cs_bool CompressBlock(void *arg, cs_uint32 idx, cs_byte *tmp) {
+	ParallelJob *job = (ParallelJob *)arg;
+	struct _ParallelBlock *blk = &job->blocks[idx];
+	cs_uint32 start = idx * COMPR_PARALLEL_BLOCK,
+	size = min(job->insize - start, COMPR_PARALLEL_BLOCK),
+	dict = min(start, PARALLEL_DICT),
+	// Z_SYNC_FLUSH дописывает пустой stored-блок
+	bound = Compr_Bound(size) + 16;
+	const cs_byte *src = job->in + start - dict;
+
+	if(job->tf) {
+		// Словарь должен совпадать с тем, что
+		// на самом деле сжал предыдущий кусок
+		job->tf(job->tfarg, start - dict, src, tmp, dict + size);
+		src = tmp;
+	}
+
+	if((blk->data = Memory_TryAlloc(1, bound)) == NULL)
+		return false;
+
+	Compr ctx = {0};
+	if(!Compr_InitLevel(&ctx, COMPR_TYPE_DEFLATE, job->level))
+		return false;
+
+	z_streamp stream = (z_streamp)ctx.stream;
+	cs_bool ok = dict == 0 || zlib.defdict(stream, src, dict) == Z_OK;
+	if(ok) {
+		cs_bool last = idx == job->count - 1;
+		stream->next_in = (Bytef *)src + dict;
+		stream->avail_in = size;
+		stream->next_out = blk->data;
+		stream->avail_out = bound;
+		// Все куски кроме последнего заканчиваются на границе
+		// байта без флага последнего блока, поэтому их можно
+		// просто склеить друг за другом
+		cs_int32 ret = zlib.deflate(stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+		ok = last ? ret == Z_STREAM_END : (ret == Z_OK && stream->avail_in == 0 && stream->avail_out > 0);
+		blk->size = bound - stream->avail_out;
+		blk->crc = zlib.crc32(0, src + dict, size);
+	}
+
+	Compr_Reset(&ctx);
+	return ok;
+}
+
+INL static void WriteLE32(cs_byte *ptr, cs_uint32 value) {
+	ptr[0] = (cs_byte)value;
+	ptr[1] = (cs_byte)(value >> 8);
+	ptr[2] = (cs_byte)(value >> 16);
+	ptr[3] = (cs_byte)(value >> 24);
+}
+
+static cs_uint32 StitchBlocks(ParallelJob *job, ComprType type, cs_byte *out, cs_uint32 outsize) {
+	cs_uint64 total = type == COMPR_TYPE_GZIP ? 18 : 0;
+	for(cs_uint32 i = 0; i < job->count; i++)
+		total += job->blocks[i].size;
+	if(total > outsize) return 0;
+
+	if(type == COMPR_TYPE_GZIP) {
+		static const cs_byte header[10] = {
+			0x1F, 0x8B, Z_DEFLATED, 0, 0, 0, 0, 0, 0, 0xFF
+		};
+		Memory_Copy(out, header, sizeof(header));
+		out += sizeof(header);
+	}
+
+	cs_ulong crc = 0;
+	for(cs_uint32 i = 0; i < job->count; i++) {
+		struct _ParallelBlock *blk = &job->blocks[i];
+		Memory_Copy(out, blk->data, blk->size);
+		out += blk->size;
+		cs_uint32 size = min(job->insize - i * COMPR_PARALLEL_BLOCK, COMPR_PARALLEL_BLOCK);
+		crc = i == 0 ? blk->crc : zlib.crc32comb(crc, blk->crc, (long)size);
+	}
+
+	if(type == COMPR_TYPE_GZIP) {
+		WriteLE32(out, (cs_uint32)crc);
+		WriteLE32(out + 4, job->insize);
+	}
+
+	return (cs_uint32)total;
+}
+
+cs_uint32 Compr_Parallel(ComprType type, cs_int32 level, const void *in, cs_uint32 insize,
+	void *out, cs_uint32 outsize, ComprTransform tf, void *tfarg) {
+	if(!IsDeflate(type) || insize == 0) return 0;
+	if(!zlib.lib && !InitBackend()) return 0;
+	level = ClampLevel(level);
+
+	ParallelJob job = {
+		.level = level, .in = in, .insize = insize,
+		.count = (insize + COMPR_PARALLEL_BLOCK - 1) / COMPR_PARALLEL_BLOCK,
+		.tf = tf, .tfarg = tfarg
+	};
+
+	// Один поток libdeflate обгоняет пару потоков zlib
+	if(!tf && ParallelThreads(job.count) < 3 && Compr_HasFastPath())
+		return Compr_Whole(type, level, in, insize, out, outsize);
+
+	if((job.blocks = Memory_TryAlloc(job.count, sizeof(struct _ParallelBlock))) == NULL)
+		return 0;
+
+	cs_uint32 total = 0;
+	if(RunParallel(job.count, CompressBlock, &job, tf ? COMPR_PARALLEL_BLOCK + PARALLEL_DICT : 0))
+		total = StitchBlocks(&job, type, out, outsize);
+
+	for(cs_uint32 i = 0; i < job.count; i++)
+		if(job.blocks[i].data) Memory_Free(job.blocks[i].data);
+	Memory_Free(job.blocks);
+	return total;
+}
+
+cs_bool Compr_HasCodec(ComprCodec codec) {
+	switch(codec) {
+		case COMPR_CODEC_GZIP:
+			return zlib.lib || InitBackend();
+		case COMPR_CODEC_ZSTD:
+		case COMPR_CODEC_LZ4:
+			if(!pool.mutex) return false;
+			Mutex_Lock(pool.mutex);
+			if(!pool.codectried[codec]) {
+				pool.codectried[codec] = true;
+				if(codec == COMPR_CODEC_ZSTD)
+					DLib_LoadAll(libzstddll, zstdsymlist, (void **)&libzstd);
+				else
+					DLib_LoadAll(liblz4dll, lz4symlist, (void **)&liblz4);
+			}
+			Mutex_Unlock(pool.mutex);
+			return codec == COMPR_CODEC_ZSTD ? libzstd.lib != NULL : liblz4.lib != NULL;
+		case COMPR_CODEC_COUNT:
+		default:
+			return false;
+	}
+}
+
+cs_uint32 Compr_FrameBound(ComprCodec codec, cs_uint32 framesize) {
+	if(!Compr_HasCodec(codec)) return 0;
+	cs_uint64 bound = 0;
+	if(codec == COMPR_CODEC_ZSTD)
+		bound = libzstd.bound(framesize);
+	else if(codec == COMPR_CODEC_LZ4 && framesize <= 0x7E000000)
+		bound = (cs_uint64)liblz4.bound((int)framesize);
+	return bound > 0xFFFFFFFFu ? 0 : (cs_uint32)bound;
+}
+
+typedef struct _FrameJob {
+	ComprCodec codec;
+	cs_int32 level;
+	const cs_byte *in;
+	cs_byte *out;
+	cs_uint32 insize, outsize;
+	cs_uint32 framesize, fbound;
+	cs_uint32 *sizes;
+	const cs_uint32 *csizes, *offsets;
+} FrameJob;
+
+static cs_bool CompressFrame(void *arg, cs_uint32 idx, cs_byte *tmp) {
+	(void)tmp;
+	FrameJob *job = (FrameJob *)arg;
+	cs_uint32 start = idx * job->framesize,
+	size = min(job->insize - start, job->framesize);
+	cs_byte *dst = job->out + (cs_size)idx * job->fbound;
+
+	if(job->codec == COMPR_CODEC_ZSTD) {
+		cs_size ret = libzstd.compress(dst, job->fbound, job->in + start, size, job->level);
+		if(libzstd.iserror(ret)) return false;
+		job->sizes[idx] = (cs_uint32)ret;
+	} else {
+		int ret = liblz4.compress((const char *)job->in + start, (char *)dst, (int)size, (int)job->fbound);
+		if(ret <= 0) return false;
+		job->sizes[idx] = (cs_uint32)ret;
+	}
+
+	return true;
+}
+
+static cs_bool DecompressFrame(void *arg, cs_uint32 idx, cs_byte *tmp) {
+	(void)tmp;
+	FrameJob *job = (FrameJob *)arg;
+	cs_uint32 start = idx * job->framesize,
+	size = min(job->outsize - start, job->framesize);
+	const cs_byte *src = job->in + job->offsets[idx];
+
+	if(job->codec == COMPR_CODEC_ZSTD) {
+		cs_size ret = libzstd.decompress(job->out + start, size, src, job->csizes[idx]);
+		return !libzstd.iserror(ret) && ret == size;
+	}
+
+	return liblz4.decompress((const char *)src, (char *)job->out + start,
+		(int)job->csizes[idx], (int)size) == (int)size;
+}
+
+INL static cs_bool IsFrameCodec(ComprCodec codec) {
+	return codec == COMPR_CODEC_ZSTD || codec == COMPR_CODEC_LZ4;
+}
+
+cs_bool Compr_CompressFrames(ComprCodec codec, cs_int32 level, const void *in, cs_uint32 insize,
+	cs_uint32 framesize, void *out, cs_uint32 *sizes) {
+	if(!IsFrameCodec(codec) || framesize == 0 || insize == 0) return false;
+
+	FrameJob job = {
+		.codec = codec, .level = ClampLevel(level),
+		.in = in, .out = out, .insize = insize,
+		.framesize = framesize, .fbound = Compr_FrameBound(codec, framesize),
+		.sizes = sizes
+	};
+	if(job.fbound == 0) return false;
+
+	return RunParallel((insize + framesize - 1) / framesize, CompressFrame, &job, 0);
+}
+
+cs_bool Compr_DecompressFrames(ComprCodec codec, const void *in, cs_uint32 insize,
+	const cs_uint32 *sizes, cs_uint32 framesize, void *out, cs_uint32 outsize) {
+	if(!IsFrameCodec(codec) || framesize == 0 || outsize == 0) return false;
+	if(!Compr_HasCodec(codec)) return false;
+
+	cs_uint32 count = (outsize + framesize - 1) / framesize;
+	cs_uint32 *offsets = Memory_TryAlloc(count, sizeof(cs_uint32));
+	if(!offsets) return false;
+
+	cs_uint64 offset = 0;
+	for(cs_uint32 i = 0; i < count; i++) {
+		offsets[i] = (cs_uint32)offset;
+		offset += sizes[i];
+	}
+
+	cs_bool ok = false;
+	if(offset <= insize) {
+		FrameJob job = {
+			.codec = codec, .in = in, .out = out,
+			.insize = insize, .outsize = outsize,
+			.framesize = framesize, .csizes = sizes,
+			.offsets = offsets
+		};
+		ok = RunParallel(count, DecompressFrame, &job, 0);
+	}
+
+	Memory_Free(offsets);
+	return ok;
 }
 
 cs_bool Compr_IsInState(Compr *ctx, ComprState state) {
@@ -118,7 +767,7 @@ cs_bool Compr_IsInState(Compr *ctx, ComprState state) {
 }
 
 cs_ulong Compr_CRC32(const cs_byte *data, cs_uint32 len) {
-	if(!zlib.crc32) return 0x00000000;
+	if(!zlib.lib && !InitBackend()) return 0x00000000;
 	return zlib.crc32(0, data, len);
 }
 
@@ -166,6 +815,9 @@ INL static cs_bool InflateStep(Compr *ctx) {
 		case Z_DATA_ERROR:
 		case Z_MEM_ERROR:
 			return false;
+		case Z_STREAM_END:
+			ctx->state = COMPR_STATE_DONE;
+			break;
 	}
 	ctx->written = avail - stream->avail_out;
 	ctx->queued = stream->avail_in;
@@ -178,9 +830,9 @@ cs_bool Compr_Update(Compr *ctx) {
 	else if(ctx->state == COMPR_STATE_DONE)
 		return true;
 
-	if(ctx->type == COMPR_TYPE_DEFLATE || ctx->type == COMPR_TYPE_GZIP)
+	if(IsDeflate(ctx->type))
 		return DeflateStep(ctx);
-	else if(ctx->type == COMPR_TYPE_INFLATE || ctx->type == COMPR_TYPE_UNGZIP)
+	else if(IsInflate(ctx->type))
 		return InflateStep(ctx);
 
 	return false;
@@ -205,11 +857,8 @@ cs_uint32 Compr_GetWrittenSize(Compr *ctx) {
 
 void Compr_Reset(Compr *ctx) {
 	if(ctx->stream) {
-		if(ctx->type == COMPR_TYPE_DEFLATE || ctx->type == COMPR_TYPE_GZIP)
-			zlib.defend(ctx->stream);
-		else if(ctx->type == COMPR_TYPE_INFLATE || ctx->type == COMPR_TYPE_UNGZIP)
-			zlib.infend(ctx->stream);
-		Memory_Zero(ctx->stream, sizeof(z_stream));
+		ReleaseEntry(ctx->stream, ctx->type);
+		ctx->stream = NULL;
 	}
 	ctx->type = COMPR_TYPE_NOTSET;
 	ctx->state = COMPR_STATE_IDLE;
@@ -217,12 +866,39 @@ void Compr_Reset(Compr *ctx) {
 
 void Compr_Cleanup(Compr *ctx) {
 	if(ctx->stream) {
-		Memory_Free(ctx->stream);
+		ReleaseEntry(ctx->stream, ctx->type);
 		ctx->stream = NULL;
 	}
 }
 
 void Compr_Uninit(void) {
+	if(pool.mutex) {
+		TrimPool(0);
+		Mutex_Free(pool.mutex);
+		pool.mutex = NULL;
+	}
+
+	if(libdeflate.lib) {
+		for(cs_int32 i = 0; i <= COMPR_LEVEL_MAX; i++) {
+			if(pool.compressors[i]) {
+				libdeflate.free(pool.compressors[i]);
+				pool.compressors[i] = NULL;
+			}
+		}
+		DLib_Unload(libdeflate.lib);
+		Memory_Zero(&libdeflate, sizeof(libdeflate));
+	}
+
+	if(libzstd.lib) {
+		DLib_Unload(libzstd.lib);
+		Memory_Zero(&libzstd, sizeof(libzstd));
+	}
+
+	if(liblz4.lib) {
+		DLib_Unload(liblz4.lib);
+		Memory_Zero(&liblz4, sizeof(liblz4));
+	}
+
 	if(!zlib.lib) return;
 	DLib_Unload(zlib.lib);
 	Memory_Zero(&zlib, sizeof(zlib));
@@ -12,6 +12,84 @@
  */
 API cs_bool Compr_Init(Compr *ctx, ComprType type);
 
+/**
+ * @brief Инициализирует архиватор с указанным уровнем сжатия.
+ * Для распаковщиков уровень игнорируется.
+ * 
+ * @param ctx указатель на контекст архиватора
+ * @param type тип архиватора
+ * @param level уровень сжатия (COMPR_LEVEL_MIN - COMPR_LEVEL_MAX)
+ * @return true - архиватор инициализорван, false - ошибка инициализации
+ */
+API cs_bool Compr_InitLevel(Compr *ctx, ComprType type, cs_int32 level);
+
+/**
+ * @brief Устанавливает уровень сжатия для указанного применения.
+ * 
+ * @param use применение архиватора
+ * @param level уровень сжатия (COMPR_LEVEL_MIN - COMPR_LEVEL_MAX)
+ */
+API void Compr_SetLevel(ComprUse use, cs_int32 level);
+
+/**
+ * @brief Возвращает уровень сжатия для указанного применения.
+ * 
+ * @param use применение архиватора
+ * @return уровень сжатия
+ */
+API cs_int32 Compr_GetLevel(ComprUse use);
+
+/**
+ * @brief Проверяет, доступна ли быстрая библиотека
+ * для сжатия целого буфера за один вызов (libdeflate).
+ * 
+ * @return true - доступна, false - Compr_Whole будет использовать zlib
+ */
+API cs_bool Compr_HasFastPath(void);
+
+/**
+ * @brief Возвращает размер выходного буфера, которого
+ * гарантированно хватит Compr_Whole для сжатия данных.
+ * 
+ * @param insize размер несжатых данных
+ * @return размер буфера, 0 - данные слишком велики
+ */
+API cs_uint32 Compr_Bound(cs_uint32 insize);
+
+/**
+ * @brief Сжимает находящиеся целиком в памяти данные за один вызов.
+ * Результат совместим с потоковым архиватором того же типа.
+ * 
+ * @param type тип архиватора (COMPR_TYPE_DEFLATE или COMPR_TYPE_GZIP)
+ * @param level уровень сжатия
+ * @param in указатель на несжатые данные
+ * @param insize размер несжатых данных
+ * @param out указатель на выходной буфер
+ * @param outsize размер выходного буфера
+ * @return размер сжатых данных, 0 - произошла ошибка
+ */
+API cs_uint32 Compr_Whole(ComprType type, cs_int32 level, const void *in, cs_uint32 insize, void *out, cs_uint32 outsize);
+
+/**
+ * @brief Сжимает находящиеся целиком в памяти данные в несколько потоков.
+ * Данные режутся на куски по COMPR_PARALLEL_BLOCK байт, каждый кусок
+ * сжимается отдельно с последними 32 КБ предыдущего в качестве словаря,
+ * после чего куски склеиваются в один deflate поток (или gzip, с общим
+ * CRC32). Функция возвращается только после завершения сжатия.
+ * 
+ * @param type тип архиватора (COMPR_TYPE_DEFLATE или COMPR_TYPE_GZIP)
+ * @param level уровень сжатия
+ * @param in указатель на несжатые данные
+ * @param insize размер несжатых данных
+ * @param out указатель на выходной буфер (не меньше Compr_Bound(insize))
+ * @param outsize размер выходного буфера
+ * @param tf функция преобразования данных перед сжатием, может быть NULL
+ * @param tfarg аргумент для функции преобразования
+ * @return размер сжатых данных, 0 - произошла ошибка
+ */
+API cs_uint32 Compr_Parallel(ComprType type, cs_int32 level, const void *in, cs_uint32 insize,
+	void *out, cs_uint32 outsize, ComprTransform tf, void *tfarg);
+
 /**
  * @brief Проверяет, находится ли архиватор в указанном состоянии.
  * 
@@ -95,6 +173,8 @@ API cs_uint32 Compr_GetWrittenSize(Compr *ctx);
 
 /**
  * @brief Возвращает архиватор в начальное состояние.
+ * Внутренний zlib контекст при этом уходит в пул
+ * и достанется следующему Compr_Init того же типа.
  * 
  * @param ctx указатель на контекст архиватора
  */
@@ -107,10 +187,85 @@ API void Compr_Reset(Compr *ctx);
  */
 API void Compr_Cleanup(Compr *ctx);
 
+/**
+ * @brief Возвращает статистику пула архиваторов.
+ * 
+ * @param stats указатель на структуру, куда будет записана статистика
+ */
+API void ComprPool_GetStats(ComprPoolStats *stats);
+
+/**
+ * @brief Проверяет, доступна ли библиотека для указанного кодека.
+ * Библиотеки zstd и LZ4 подгружаются при первой проверке.
+ * 
+ * @param codec кодек
+ * @return true - доступна, false - нет
+ */
+API cs_bool Compr_HasCodec(ComprCodec codec);
+
+/**
+ * @brief Возвращает размер буфера, которого гарантированно
+ * хватит под один сжатый кадр указанного размера.
+ * 
+ * @param codec кадровый кодек (COMPR_CODEC_ZSTD или COMPR_CODEC_LZ4)
+ * @param framesize размер несжатого кадра
+ * @return размер буфера, 0 - кодек недоступен
+ */
+API cs_uint32 Compr_FrameBound(ComprCodec codec, cs_uint32 framesize);
+
+/**
+ * @brief Режет данные на кадры по framesize байт и сжимает их
+ * независимо друг от друга в несколько потоков. Кадр с номером i
+ * записывается в out по смещению i * Compr_FrameBound(codec, framesize).
+ * 
+ * @param codec кадровый кодек
+ * @param level уровень сжатия
+ * @param in указатель на несжатые данные
+ * @param insize размер несжатых данных
+ * @param framesize размер несжатого кадра
+ * @param out выходной буфер на (количество кадров * Compr_FrameBound) байт
+ * @param sizes сюда будут записаны размеры сжатых кадров
+ * @return true - данные сжаты, false - произошла ошибка
+ */
+API cs_bool Compr_CompressFrames(ComprCodec codec, cs_int32 level, const void *in, cs_uint32 insize,
+	cs_uint32 framesize, void *out, cs_uint32 *sizes);
+
+/**
+ * @brief Распаковывает идущие подряд сжатые кадры в несколько потоков.
+ * 
+ * @param codec кадровый кодек
+ * @param in указатель на сжатые кадры
+ * @param insize размер сжатых данных
+ * @param sizes размеры сжатых кадров
+ * @param framesize размер несжатого кадра
+ * @param out выходной буфер
+ * @param outsize размер несжатых данных, определяет количество кадров
+ * @return true - данные распакованы, false - данные повреждены
+ */
+API cs_bool Compr_DecompressFrames(ComprCodec codec, const void *in, cs_uint32 insize,
+	const cs_uint32 *sizes, cs_uint32 framesize, void *out, cs_uint32 outsize);
+
 #ifndef CORE_BUILD_PLUGIN
+	/**
+	 * @brief Создаёт пул заранее инициализированных архиваторов.
+	 * 
+	 * @return true - пул создан, false - архиваторы будут создаваться заново каждый раз
+	 */
+	cs_bool ComprPool_Init(void);
+
+	/**
+	 * @brief Устанавливает максимальное количество
+	 * свободных архиваторов в пуле.
+	 * 
+	 * @param limit количество архиваторов, 0 - не хранить архиваторы вовсе
+	 */
+	void ComprPool_SetLimit(cs_uint32 limit);
+
 	/**
 	 * @brief Отключает библиотеку zlib.
 	 * (При следующем вызове Compr_Init произойдёт повторное подключение)
+	 * Свободные архиваторы пула при этом уничтожаются, а libdeflate,
+	 * zstd и LZ4 отключаются насовсем.
 	 * 
 	 */
 	void Compr_Uninit(void);
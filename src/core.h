@@ -36,6 +36,22 @@ defined(_MIPSEL) || defined(__MIPSEL) || defined(__MIPSEL__)
 #	error "Unknown CPU architecture"
 #endif
 
+// Наборы инструкций, под которые есть SIMD-ядра
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#	define CPU_USE_X86
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#	define CPU_USE_ARM64
+#endif
+
+// Функция собирается под указанные расширения x86, даже
+// если весь сервер собран без них. Вызывать её можно
+// только после проверки CPU_GetFeatures
+#if defined(CPU_USE_X86) && (defined(__GNUC__) || defined(__clang__))
+#	define CPU_TARGET(t) __attribute__((target(t)))
+#else
+#	define CPU_TARGET(t)
+#endif
+
 // Определяем, где мы компилимся
 #ifndef CORE_MANUAL_BACKENDS
 #	if defined(__MINGW32__)
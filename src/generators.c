@@ -55,7 +55,10 @@ cs_bool Generators_RemoveByFunc(GeneratorRoutine gr) {
 
 cs_bool Generators_Use(World *world, cs_str name, cs_int32 seed) {
 	GeneratorRoutine gr = Generators_Get(name);
-	return gr != NULL ? gr(world, seed) : false;
+	// Генераторы пишут прямо в плоский массив блоков
+	if(gr == NULL || !World_UnpackBlocks(world) || !gr(world, seed)) return false;
+	World_UpdateBlocks(world);
+	return true;
 }
 
 GeneratorRoutine Generators_Get(cs_str name) {
@@ -7,11 +7,18 @@
 #include "cserror.h"
 #include "hash.h"
 #include "compr.h"
+#include "netbuffer.h"
+#include "remap.h"
+#include "websock.h"
 #include "tests.h"
 
 INL static cs_bool Init(void) {
+	CPU_Init();
+	Remap_Bind(CPU_GetFeatures());
+	WebSock_Bind(CPU_GetFeatures());
 	return Memory_Init() && Log_Init()
-	&& Error_Init() && Socket_Init();
+	&& Error_Init() && Socket_Init()
+	&& NetPool_Init() && ComprPool_Init();
 }
 
 int main(int argc, char *argv[]) {
@@ -49,6 +56,7 @@ int main(int argc, char *argv[]) {
 			Server_StartLoop();
 
 		Server_Cleanup();
+		NetPool_Uninit();
 		Compr_Uninit();
 		Http_Uninit();
 		Hash_Uninit();
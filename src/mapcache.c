@@ -0,0 +1,333 @@
+#include "core.h"
+#include "platform.h"
+#include "world.h"
+#include "block.h"
+#include "compr.h"
+#include "mapcache.h"
+#include "remap.h"
+
+#define MAPCACHE_CHUNK 16384
+#define MAPCACHE_MINFREE 16384
+// Карты до этого размера сжимаются libdeflate за
+// один шаг, большие сжимаются в фоновом потоке,
+// чтобы не подвешивать сервер надолго
+#define MAPCACHE_WHOLE_MAX (1024 * 1024)
+
+// Снимок нужен, пока архиватор не прочитал карту целиком
+INL static void DropSnapshot(MapCache *cache) {
+	if(cache->snap) {
+		World_ReleaseSnapshot(cache->snap);
+		cache->snap = NULL;
+	}
+}
+
+static void DestroyCache(MapCache *cache) {
+	if(cache->bg.mutex) Mutex_Free(cache->bg.mutex);
+	Compr_Reset(&cache->compr);
+	Compr_Cleanup(&cache->compr);
+	if(cache->data) Memory_Free(cache->data);
+	Memory_Free(cache);
+}
+
+static void FreeCache(MapCache *cache) {
+	if(cache->bg.busy) {
+		// Ждать, пока поток дожмёт ненужную уже карту,
+		// значит подвесить сервер, поэтому кеш удалит сам поток
+		Thread thread = cache->bg.thread;
+		Mutex_Lock(cache->bg.mutex);
+		if(!cache->bg.finished) {
+			cache->bg.orphan = true;
+			Mutex_Unlock(cache->bg.mutex);
+			Thread_Detach(thread);
+			return;
+		}
+		Mutex_Unlock(cache->bg.mutex);
+		Thread_Join(thread);
+		cache->bg.busy = false;
+	}
+	DropSnapshot(cache);
+	DestroyCache(cache);
+}
+
+static void Detach(MapCache *cache) {
+	if(!cache->detached && cache->world) {
+		if(cache->world->mcache[cache->variant] == cache)
+			cache->world->mcache[cache->variant] = NULL;
+		cache->detached = true;
+	}
+
+	if(cache->refs == 0) FreeCache(cache);
+}
+
+MapCache *MapCache_Acquire(World *world, cs_bool fastmap, cs_bool fback) {
+	cs_byte variant = (fastmap ? MAPCACHE_FLAG_FASTMAP : 0) |
+	(fback ? MAPCACHE_FLAG_FALLBACK : 0);
+	const RemapTable *fallback = fback ? Block_GetFallbackTable(world) : NULL;
+
+	MapCache *cache = world->mcache[variant];
+	if(cache) {
+		if(!cache->failed && cache->version == world->wdata.version &&
+		(!fback || Memory_Compare(cache->fallback.lut, fallback->lut, sizeof(fallback->lut)))) {
+			cache->refs++;
+			return cache;
+		}
+
+		// Мир успел измениться, этот кеш дожмётся для тех,
+		// кто его уже получает, а новые клиенты получат новый
+		Detach(cache);
+	}
+
+	if((cache = Memory_TryAlloc(1, sizeof(MapCache))) == NULL)
+		return NULL;
+
+	cache->world = world;
+	cache->version = world->wdata.version;
+	cache->variant = variant;
+	cache->refs = 1;
+	if(fback) cache->fallback = *fallback;
+
+	// Карта сжимается из снимка, поэтому изменения мира
+	// во время сжатия не попадут в неё наполовину
+	if((cache->snap = World_TakeSnapshot(world)) == NULL ||
+	!Compr_InitLevel(&cache->compr, fastmap ? COMPR_TYPE_DEFLATE : COMPR_TYPE_GZIP,
+	Compr_GetLevel(COMPR_USE_NETWORK))) {
+		DropSnapshot(cache);
+		cache->failed = true;
+		cache->detached = true;
+		return cache;
+	}
+
+	// Перед блоками gzip-варианта идёт 4 байта размера карты
+	cache->insize = cache->snap->size + (fastmap ? 0 : 4);
+	world->mcache[variant] = cache;
+	return cache;
+}
+
+void MapCache_Release(MapCache *cache) {
+	if(--cache->refs > 0) return;
+	if(cache->detached || cache->failed)
+		Detach(cache);
+}
+
+cs_uint32 MapCache_Peek(MapCache *cache, cs_uint32 offset, const cs_byte **data) {
+	if(offset >= cache->size) return 0;
+	*data = cache->data + offset;
+	return cache->size - offset;
+}
+
+INL static cs_bool EnsureSpace(MapCache *cache) {
+	if(cache->cap - cache->size >= MAPCACHE_MINFREE)
+		return true;
+
+	cs_uint32 newcap = cache->cap ? cache->cap * 2 : MAPCACHE_MINFREE * 4;
+	cs_byte *newdata = cache->data ? Memory_TryRealloc(cache->data, newcap)
+	: Memory_TryAlloc(1, newcap);
+	if(!newdata) return false;
+
+	cache->data = newdata;
+	cache->cap = newcap;
+	return true;
+}
+
+INL static void Finish(MapCache *cache) {
+	// Архиватор больше не нужен, а буфер можно
+	// ужать до реального размера сжатой карты
+	cache->done = true;
+	DropSnapshot(cache);
+	Compr_Reset(&cache->compr);
+	Compr_Cleanup(&cache->compr);
+	cs_byte *newdata = Memory_TryRealloc(cache->data, cache->size);
+	if(newdata) {
+		cache->data = newdata;
+		cache->cap = cache->size;
+	}
+}
+
+// Читает несжатую карту: заголовок gzip-варианта и блоки из снимка
+static void ReadInput(MapCache *cache, cs_uint32 offset, cs_byte *dst, cs_uint32 size) {
+	cs_uint32 head = cache->insize - cache->snap->size, i = 0;
+	if(offset < head) {
+		cs_uint32 wsize = htonl(cache->snap->size);
+		for(; i < size && offset + i < head; i++)
+			dst[i] = ((cs_byte *)&wsize)[offset + i];
+	}
+	World_ReadSnapshot(cache->snap, offset + i - head, dst + i, size - i);
+	if(cache->variant & MAPCACHE_FLAG_FALLBACK)
+		Remap_Apply(&cache->fallback, dst + i, dst + i, size - i);
+}
+
+INL static ComprType GetType(MapCache *cache) {
+	return (cache->variant & MAPCACHE_FLAG_FASTMAP) ? COMPR_TYPE_DEFLATE : COMPR_TYPE_GZIP;
+}
+
+static cs_bool StepWhole(MapCache *cache) {
+	cs_uint32 bound = Compr_Bound(cache->insize);
+	cs_byte *input = NULL;
+	if(bound == 0 || (cache->data = Memory_TryAlloc(1, bound)) == NULL)
+		return false;
+
+	if((input = Memory_TryAlloc(1, cache->insize)) == NULL) {
+		Memory_Free(cache->data);
+		cache->data = NULL;
+		return false;
+	}
+
+	ReadInput(cache, 0, input, cache->insize);
+	cache->size = Compr_Whole(GetType(cache), Compr_GetLevel(COMPR_USE_NETWORK),
+		input, cache->insize, cache->data, bound
+	);
+	Memory_Free(input);
+
+	if(cache->size == 0) {
+		Memory_Free(cache->data);
+		cache->data = NULL;
+		return false;
+	}
+
+	cache->cap = bound;
+	cache->inpos = cache->insize;
+	Finish(cache);
+	return true;
+}
+
+/*
+ * Поток сжимает собственную копию блоков: мир могут
+ * менять, упаковывать и выгружать, пока карта сжимается.
+ * Задача мира держится только на время копирования
+ * снимка, после этого мир потоку больше не нужен.
+*/
+THREAD_FUNC(CompressThread) {
+	MapCache *cache = (MapCache *)param;
+	struct _MapCacheBg *bg = &cache->bg;
+	World *world = cache->world;
+
+	ReadInput(cache, 0, bg->input, cache->insize);
+	DropSnapshot(cache);
+	World_EndTask(world);
+
+	cs_uint32 size = Compr_Parallel(GetType(cache), Compr_GetLevel(COMPR_USE_NETWORK),
+		bg->input, cache->insize, cache->data, cache->cap, NULL, NULL
+	);
+	Memory_Free(bg->input);
+	bg->input = NULL;
+
+	Mutex_Lock(bg->mutex);
+	bg->size = size;
+	bg->finished = true;
+	cs_bool orphan = bg->orphan;
+	Mutex_Unlock(bg->mutex);
+	if(orphan) DestroyCache(cache);
+	return 0;
+}
+
+static cs_bool StartBackground(MapCache *cache) {
+	struct _MapCacheBg *bg = &cache->bg;
+	cs_uint32 bound = Compr_Bound(cache->insize);
+	if(bound == 0 || (cache->data = Memory_TryAlloc(1, bound)) == NULL)
+		return false;
+
+	if((bg->input = Memory_TryAlloc(1, cache->insize)) == NULL ||
+		(bg->mutex = Mutex_Create()) == NULL) {
+		if(bg->input) Memory_Free(bg->input);
+		Memory_Free(cache->data);
+		cache->data = NULL;
+		bg->input = NULL;
+		return false;
+	}
+
+	cache->cap = bound;
+	bg->busy = true;
+	World_StartTask(cache->world);
+	bg->thread = Thread_Create(CompressThread, cache, false);
+	return true;
+}
+
+INL static cs_bool PollBackground(MapCache *cache) {
+	Mutex_Lock(cache->bg.mutex);
+	cs_bool finished = cache->bg.finished;
+	Mutex_Unlock(cache->bg.mutex);
+	if(!finished) return true;
+
+	Thread_Join(cache->bg.thread);
+	cache->bg.busy = false;
+	if(cache->bg.size == 0) {
+		cache->failed = true;
+		return false;
+	}
+
+	cache->size = cache->bg.size;
+	cache->inpos = cache->insize;
+	Finish(cache);
+	return true;
+}
+
+cs_bool MapCache_Step(MapCache *cache) {
+	if(cache->failed) return false;
+	if(MapCache_IsDone(cache)) return true;
+	if(cache->bg.busy) return PollBackground(cache);
+
+	if(cache->inpos == 0) {
+		// Маленькие карты быстрее сжать сразу, большие
+		// сжимаются в фоне на всех ядрах, пока сервер
+		// занят своими делами
+		if(cache->insize <= MAPCACHE_WHOLE_MAX) {
+			if(Compr_HasFastPath() && StepWhole(cache))
+				return true;
+		} else if(StartBackground(cache))
+			return true;
+	}
+
+	cs_byte indata[MAPCACHE_CHUNK];
+	cs_uint32 avail = min(cache->insize - cache->inpos, MAPCACHE_CHUNK);
+	if(avail > 0) {
+		ReadInput(cache, cache->inpos, indata, avail);
+		Compr_SetInBuffer(&cache->compr, indata, avail);
+		cache->inpos += avail;
+	}
+
+	do {
+		if(!EnsureSpace(cache)) {
+			cache->failed = true;
+			return false;
+		}
+
+		Compr_SetOutBuffer(&cache->compr, cache->data + cache->size, cache->cap - cache->size);
+		if(!Compr_Update(&cache->compr)) {
+			cache->failed = true;
+			return false;
+		}
+		cache->size += cache->compr.written;
+	} while(cache->compr.written > 0);
+
+	if(Compr_IsInState(&cache->compr, COMPR_STATE_DONE))
+		Finish(cache);
+
+	return true;
+}
+
+cs_bool MapCache_IsBusy(MapCache *cache) {
+	return cache->bg.busy;
+}
+
+cs_bool MapCache_IsDone(MapCache *cache) {
+	return cache->done;
+}
+
+cs_byte MapCache_GetProgress(MapCache *cache, cs_uint32 offset) {
+	if(cache->size == 0 || cache->insize == 0) return 0;
+	return (cs_byte)(((cs_float)offset / cache->size) *
+	((cs_float)cache->inpos / cache->insize) * 100);
+}
+
+cs_str MapCache_GetError(MapCache *cache) {
+	return Compr_GetLastError(&cache->compr);
+}
+
+void MapCache_Invalidate(World *world) {
+	for(cs_int32 i = 0; i < MAPCACHE_VARIANTS; i++) {
+		MapCache *cache = world->mcache[i];
+		// Снимок переживёт массив блоков, так что начатые
+		// кеши дожмутся для тех, кто их уже получает
+		if(cache) Detach(cache);
+	}
+}
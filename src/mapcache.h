@@ -0,0 +1,92 @@
+#ifndef MAPCACHE_H
+#define MAPCACHE_H
+#include "core.h"
+#include "types/world.h"
+#include "types/mapcache.h"
+
+#ifndef CORE_BUILD_PLUGIN
+	/**
+	 * @brief Возвращает кеш сжатой карты мира для указанного
+	 * варианта протокола. Если актуального кеша нет, он будет
+	 * создан, при этом сжатие производится постепенно вызовами
+	 * MapCache_Step (большие карты сжимаются в фоновом потоке).
+	 * Карта сжимается из снимка блоков, снятого при создании
+	 * кеша, поэтому последующие изменения мира в неё не попадут.
+	 * Полученный кеш обязательно нужно вернуть через MapCache_Release.
+	 *
+	 * @param world мир, карту которого нужно отправить
+	 * @param fastmap клиент поддерживает FastMap (сырой deflate без заголовка)
+	 * @param fback клиенту нужна замена кастомных блоков
+	 * @return указатель на кеш, NULL - не хватило памяти
+	 */
+	MapCache *MapCache_Acquire(World *world, cs_bool fastmap, cs_bool fback);
+
+	/**
+	 * @brief Отпускает кеш, полученный через MapCache_Acquire.
+	 *
+	 * @param cache указатель на кеш
+	 */
+	void MapCache_Release(MapCache *cache);
+
+	/**
+	 * @brief Возвращает уже сжатые данные, начиная с указанного смещения.
+	 *
+	 * @param cache указатель на кеш
+	 * @param offset смещение в сжатом потоке
+	 * @param data сюда будет записан указатель на данные
+	 * @return количество доступных байт, 0 - данные ещё не сжаты
+	 */
+	cs_uint32 MapCache_Peek(MapCache *cache, cs_uint32 offset, const cs_byte **data);
+
+	/**
+	 * @brief Сжимает следующую порцию карты.
+	 *
+	 * @param cache указатель на кеш
+	 * @return true - порция сжата, false - произошла ошибка
+	 */
+	cs_bool MapCache_Step(MapCache *cache);
+
+	/**
+	 * @brief Проверяет, сжимается ли карта в фоновом потоке.
+	 * Пока это так, вызывать MapCache_Step чаще раза в тик незачем.
+	 *
+	 * @param cache указатель на кеш
+	 * @return true - сжимается, false - нет
+	 */
+	cs_bool MapCache_IsBusy(MapCache *cache);
+
+	/**
+	 * @brief Проверяет, сжата ли карта целиком.
+	 *
+	 * @param cache указатель на кеш
+	 * @return true - сжата, false - нет
+	 */
+	cs_bool MapCache_IsDone(MapCache *cache);
+
+	/**
+	 * @brief Возвращает процент загрузки карты для пакета 0x03.
+	 *
+	 * @param cache указатель на кеш
+	 * @param offset количество отправленных клиенту сжатых байт
+	 * @return процент загрузки
+	 */
+	cs_byte MapCache_GetProgress(MapCache *cache, cs_uint32 offset);
+
+	/**
+	 * @brief Возвращает текст последней ошибки архиватора кеша.
+	 *
+	 * @param cache указатель на кеш
+	 * @return строка с ошибкой
+	 */
+	cs_str MapCache_GetError(MapCache *cache);
+
+	/**
+	 * @brief Удаляет все кеши мира. Кеши, которые в данный момент
+	 * отправляются клиентам, будут удалены после их освобождения.
+	 *
+	 * @param world мир
+	 */
+	void MapCache_Invalidate(World *world);
+#endif
+
+#endif
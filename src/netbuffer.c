@@ -3,125 +3,267 @@
 #include "netbuffer.h"
 #include "websock.h"
 
-static cs_bool Ensure(GrowingBuffer *self, cs_uint32 size) {
-	cs_uint32 required = self->offset + size;
-	if(self->maxsize > 0 && self->maxsize < required)
-		return false;
+static struct _NetPool {
+	Mutex *mutex;
+	NetPage *head;
+	cs_uint32 count;
+} pool = {0};
 
-	if(self->size < required) {
-		if(self->maxsize)
-			required = min(required + GROWINGBUFFER_ADDITIONAL, self->maxsize);
-		else
-			required += GROWINGBUFFER_ADDITIONAL;
+static cs_uint32 defaultLimit = NETBUFFER_DEFAULT_LIMIT,
+defaultLowat = NETBUFFER_DEFAULT_LOWAT;
 
-		if(self->buffer)
-			self->buffer = Memory_Realloc(self->buffer, required);
-		else
-			self->buffer = Memory_Alloc(1, required);
+cs_bool NetPool_Init(void) {
+	return (pool.mutex = Mutex_Create()) != NULL;
+}
 
-		self->size = required;
+void NetPool_Uninit(void) {
+	while(pool.head) {
+		NetPage *next = pool.head->next;
+		Memory_Free(pool.head);
+		pool.head = next;
 	}
 
-	return true;
+	pool.count = 0;
+	if(pool.mutex) {
+		Mutex_Free(pool.mutex);
+		pool.mutex = NULL;
+	}
+}
+
+NetPage *NetPool_Alloc(cs_uint32 size) {
+	NetPage *page = NULL;
+
+	// Страницы стандартного размера переиспользуются,
+	// большие же выделяются под конкретную запись
+	if(size <= NETBUFFER_PAGE_SIZE) {
+		size = NETBUFFER_PAGE_SIZE;
+		Mutex_Lock(pool.mutex);
+		if((page = pool.head) != NULL) {
+			pool.head = page->next;
+			pool.count--;
+		}
+		Mutex_Unlock(pool.mutex);
+	}
+
+	if(!page) {
+		if((page = Memory_TryAlloc(1, sizeof(NetPage) + size)) == NULL)
+			return NULL;
+		page->data = (cs_char *)(page + 1);
+		page->size = size;
+	}
+
+	page->next = NULL;
+	page->refs = 1;
+	page->used = 0;
+	return page;
+}
+
+void NetPool_Grab(NetPage *page) {
+	Mutex_Lock(pool.mutex);
+	page->refs++;
+	Mutex_Unlock(pool.mutex);
 }
 
-static INL void Cleanup(GrowingBuffer *self) {
-	if(self->buffer) {
-		Memory_Free(self->buffer);
-		self->buffer = NULL;
-		self->offset = 0;
-		self->size = 0;
+void NetPool_Release(NetPage *page) {
+	Mutex_Lock(pool.mutex);
+	if(--page->refs > 0) {
+		Mutex_Unlock(pool.mutex);
+		return;
 	}
+
+	if(page->size == NETBUFFER_PAGE_SIZE && pool.count < NETBUFFER_POOL_MAX) {
+		page->next = pool.head;
+		pool.head = page;
+		pool.count++;
+		page = NULL;
+	}
+	Mutex_Unlock(pool.mutex);
+
+	if(page) Memory_Free(page);
+}
+
+void NetBuffer_SetDefaultLimits(cs_uint32 limit, cs_uint32 lowat) {
+	defaultLimit = limit;
+	defaultLowat = min(lowat, limit);
 }
 
 void NetBuffer_Init(NetBuffer *nb, Socket sock) {
-	Ensure(&nb->write, 1);
-	Ensure(&nb->read, 1);
+	nb->write.limit = defaultLimit;
+	nb->write.lowat = defaultLowat;
 	nb->fd = sock;
 }
 
-cs_bool NetBuffer_Process(NetBuffer *nb) {
-	cs_ulong avail = Socket_AvailData(nb->fd);
-	if(avail > 0) {
-		Ensure(&nb->read, avail);
-		cs_char *data = nb->read.buffer + nb->read.offset;
-		if(Socket_Receive(nb->fd, data, avail, 0) != -1)
-			nb->read.offset += avail;
-		else if(Socket_IsFatal()) {
-			nb->closed = true;
-			return false;
-		}
-	} else {
-		cs_char unused;
-		cs_int32 ret = Socket_Receive(nb->fd, &unused, 1, MSG_PEEK);
-		if(ret == 0 || (ret == -1 && Socket_IsFatal())) {
-			nb->closed = true;
-			return false;
-		}
+cs_bool NetBuffer_Register(NetBuffer *nb) {
+	if(nb->polled) return true;
+	// Ядро не будет копить у себя больше неотправленных данных,
+	// чем мы держим в очереди до досылки фоновых данных
+	(void)Socket_SetNotSentLowat(nb->fd, nb->write.lowat);
+	nb->polled = Poll_Add(nb->fd, POLL_EVENT_READ, nb);
+	return nb->polled;
+}
+
+static void WantWrite(NetBuffer *nb, cs_bool state) {
+	if(!nb->polled || nb->pollout == state) return;
+	cs_uint32 events = POLL_EVENT_READ | (state ? POLL_EVENT_WRITE : 0);
+	if(Poll_Modify(nb->fd, events, nb)) nb->pollout = state;
+}
+
+static void ReleaseRead(NetBuffer *nb) {
+	if(nb->read.page) {
+		NetPool_Release(nb->read.page);
+		nb->read.page = NULL;
+	}
+	nb->read.start = nb->read.end = 0;
+}
+
+static void PopSegment(NetBuffer *nb) {
+	NetSegment *seg = &nb->write.segs[nb->write.head];
+	nb->write.queued -= seg->end - seg->start;
+	NetPool_Release(seg->page);
+	seg->page = NULL;
+	nb->write.head = (nb->write.head + 1) % NETBUFFER_SEGMENTS;
+	nb->write.count--;
+}
+
+static cs_bool ProcessRead(NetBuffer *nb) {
+	struct _NetBufferRead *rd = &nb->read;
+	if(!rd->page && (rd->page = NetPool_Alloc(NETBUFFER_PAGE_SIZE)) == NULL) {
+		nb->closed = true;
+		return false;
+	}
+
+	if(rd->start == rd->end)
+		rd->start = rd->end = 0;
+	else if(rd->start > 0) {
+		// Сдвигаем недочитанный хвост в начало страницы
+		// кусками не длиннее смещения, чтобы источник и
+		// приёмник никогда не перекрывались
+		cs_uint32 tail = rd->end - rd->start;
+		for(cs_uint32 off = 0; off < tail; off += rd->start)
+			Memory_Copy(rd->page->data + off, rd->page->data + rd->start + off,
+				min(rd->start, tail - off)
+			);
+		rd->start = 0;
+		rd->end = tail;
+	}
+
+	// Буфер чтения фиксированного размера, если в нём нет
+	// места, то оставшиеся данные подождут в сокете
+	cs_uint32 space = rd->page->size - rd->end;
+	if(space == 0) return true;
+
+	cs_int32 ret = Socket_Receive(nb->fd, rd->page->data + rd->end, space, 0);
+	if(ret > 0)
+		rd->end += ret;
+	else if(ret == 0 || Socket_IsFatal()) {
+		nb->closed = true;
+		return false;
 	}
 
-	avail = NetBuffer_AvailWrite(nb);
-	if(avail > 0) {
+	return true;
+}
+
+static cs_bool ProcessWrite(NetBuffer *nb) {
+	struct _NetBufferWrite *wr = &nb->write;
+	if(wr->queued == 0) {
+		while(wr->count > 0) PopSegment(nb);
+		return true;
+	}
+
+	// Сокет уже сообщал о заполненном буфере отправки,
+	// нет смысла пытаться писать в него до POLL_EVENT_WRITE
+	if(nb->pollout && (nb->events & POLL_EVENT_WRITE) == 0)
+		return true;
+
+	while(wr->queued > 0) {
+		NetSegment *seg = &wr->segs[wr->head];
+		cs_uint32 avail = seg->end - seg->start;
+		if(avail == 0) {
+			PopSegment(nb);
+			continue;
+		}
+
 		if(nb->asframe) {
 			if(nb->framesize == 0) {
 				cs_int32 hdrlen = 0;
-				nb->framesize = min(avail, WEBSOCK_FRAME_MAXSIZE);
+				nb->framesize = min(wr->queued, WEBSOCK_FRAME_MAXSIZE);
 				if(WebSock_WriteHeader(nb->fd, 0x02, nb->framesize, &hdrlen) != hdrlen) {
+					nb->framesize = 0;
 					if(Socket_IsFatal()) {
 						nb->closed = true;
 						return false;
 					}
-
-					nb->framesize = 0;
-					return true;
+					break;
 				}
 			}
 
 			avail = min(nb->framesize, avail);
 		}
 
-		cs_char *data = nb->write.buffer + nb->cwrite;
-		cs_int32 sent = Socket_Send(nb->fd, data, avail);
+		cs_int32 sent = Socket_Send(nb->fd, seg->page->data + seg->start, avail);
 		if(sent > 0) {
-			nb->cwrite += sent;
+			seg->start += sent;
+			wr->queued -= sent;
 			if(nb->asframe) nb->framesize -= sent;
-			if(NetBuffer_AvailWrite(nb) == 0) {
-				if(nb->shutdown) Socket_Shutdown(nb->fd, SD_SEND);
-				if(nb->wsupgrade) nb->asframe = true;
-				nb->write.offset = 0;
-				nb->cwrite = 0;
-			}
+			if((cs_uint32)sent < avail) break;
 		} else if(Socket_IsFatal()) {
 			nb->closed = true;
 			return false;
-		}
+		} else break;
+	}
+
+	if(wr->queued == 0) {
+		while(wr->count > 0) PopSegment(nb);
+		if(nb->shutdown) Socket_Shutdown(nb->fd, SD_SEND);
+		if(nb->wsupgrade) nb->asframe = true;
+	} else {
+		while(wr->count > 0 && wr->segs[wr->head].start == wr->segs[wr->head].end)
+			PopSegment(nb);
 	}
 
+	WantWrite(nb, wr->queued > 0);
 	return true;
 }
 
+cs_bool NetBuffer_Process(NetBuffer *nb) {
+	// Сокеты, не добавленные в поллер, читаются
+	// на каждом вызове, как и раньше
+	if(!nb->polled || (nb->events & POLL_EVENT_READ)) {
+		if(!ProcessRead(nb)) return false;
+	} else if(nb->read.start == nb->read.end)
+		ReleaseRead(nb);
+
+	cs_bool ret = ProcessWrite(nb);
+	nb->events = 0;
+	return ret;
+}
+
+cs_bool NetBuffer_Flush(NetBuffer *nb) {
+	if(nb->closed) return false;
+	return ProcessWrite(nb);
+}
+
+cs_bool NetBuffer_IsWriteLow(NetBuffer *nb) {
+	return nb->write.queued < nb->write.lowat;
+}
+
 cs_char *NetBuffer_PeekRead(NetBuffer *nb, cs_uint32 point) {
-	if(nb->cread + point > nb->read.offset) return NULL;
-	return nb->read.buffer + nb->cread;
+	if(nb->read.start + point > nb->read.end) return NULL;
+	return nb->read.page->data + nb->read.start;
 }
 
 // TODO: Почистить эту функцию от непотребностей
 cs_int32 NetBuffer_ReadLine(NetBuffer *nb, cs_char *buffer, cs_uint32 buflen) {
-	cs_char *data = nb->read.buffer + nb->cread;
-	if(!data) {
-		nb->read.offset = 0;
-		return -2;
-	}
-
-	cs_uint32 avail = nb->read.offset - nb->cread;
+	cs_uint32 avail = NetBuffer_AvailRead(nb);
 	if(avail == 0) return -2;
 
+	cs_char *data = nb->read.page->data + nb->read.start;
 	cs_uint32 bufpos = 0;
 	for(cs_uint32 i = 0; i < buflen; i++) {
-		if(i > avail) return -2;
+		if(i >= avail) return -2;
 
 		if(data[i] == '\n') {
-			nb->cread += (i + 1);
+			nb->read.start += (i + 1);
 			buffer[bufpos] = '\0';
 			return (cs_int32)bufpos;
 		} else if(data[i] != '\r')
@@ -132,33 +274,79 @@ cs_int32 NetBuffer_ReadLine(NetBuffer *nb, cs_char *buffer, cs_uint32 buflen) {
 }
 
 cs_char *NetBuffer_Read(NetBuffer *nb, cs_uint32 len) {
-	cs_char *ptr = nb->read.buffer + nb->cread;
-	if(!ptr) {
-		nb->read.offset = 0;
-		return false;
-	}
-	nb->cread += len;
+	if(!nb->read.page) return NULL;
+	cs_char *ptr = nb->read.page->data + nb->read.start;
+	nb->read.start += len;
 	return ptr;
 }
 
 cs_char *NetBuffer_StartWrite(NetBuffer *nb, cs_uint32 dlen) {
-	if(!Ensure(&nb->write, dlen)) return false;
-	return nb->write.buffer + nb->write.offset;
+	struct _NetBufferWrite *wr = &nb->write;
+	if(wr->queued + dlen > wr->limit) return NULL;
+
+	// Дописываем в последнюю страницу очереди, если
+	// она принадлежит только этому буферу
+	if(wr->count > 0) {
+		NetSegment *seg = &wr->segs[(wr->head + wr->count - 1) % NETBUFFER_SEGMENTS];
+		NetPage *page = seg->page;
+		if(page->refs == 1 && seg->end == page->used && page->size - page->used >= dlen)
+			return page->data + page->used;
+	}
+
+	if(wr->count == NETBUFFER_SEGMENTS) return NULL;
+	NetPage *page = NetPool_Alloc(dlen);
+	if(!page) return NULL;
+
+	NetSegment *seg = &wr->segs[(wr->head + wr->count++) % NETBUFFER_SEGMENTS];
+	seg->page = page;
+	seg->start = seg->end = 0;
+	return page->data;
 }
 
 cs_bool NetBuffer_EndWrite(NetBuffer *nb, cs_uint32 size) {
-	cs_uint32 newsize = nb->write.offset + size;
-	if(newsize > nb->write.size) return false;
-	nb->write.offset = newsize;
+	struct _NetBufferWrite *wr = &nb->write;
+	if(wr->count == 0) return false;
+
+	NetSegment *seg = &wr->segs[(wr->head + wr->count - 1) % NETBUFFER_SEGMENTS];
+	NetPage *page = seg->page;
+	if(seg->end != page->used || page->size - page->used < size)
+		return false;
+
+	page->used += size;
+	seg->end = page->used;
+	wr->queued += size;
+	return true;
+}
+
+cs_bool NetBuffer_AppendShared(NetBuffer *nb, NetPage *page, cs_uint32 offset, cs_uint32 size) {
+	struct _NetBufferWrite *wr = &nb->write;
+	if(size == 0) return true;
+	if(wr->queued + size > wr->limit) return false;
+
+	// Мелкие пакеты дешевле скопировать в хвост очереди,
+	// чем тратить на каждый отдельный сегмент кольца
+	if(size < NETBUFFER_SHARE_MIN || wr->count == NETBUFFER_SEGMENTS) {
+		cs_char *data = NetBuffer_StartWrite(nb, size);
+		if(!data) return false;
+		Memory_Copy(data, page->data + offset, size);
+		return NetBuffer_EndWrite(nb, size);
+	}
+
+	NetPool_Grab(page);
+	NetSegment *seg = &wr->segs[(wr->head + wr->count++) % NETBUFFER_SEGMENTS];
+	seg->page = page;
+	seg->start = offset;
+	seg->end = offset + size;
+	wr->queued += size;
 	return true;
 }
 
 cs_uint32 NetBuffer_AvailRead(NetBuffer *nb) {
-	return nb->read.offset - nb->cread;
+	return nb->read.end - nb->read.start;
 }
 
 cs_uint32 NetBuffer_AvailWrite(NetBuffer *nb) {
-	return nb->write.offset - nb->cwrite;
+	return nb->write.queued;
 }
 
 cs_bool NetBuffer_Shutdown(NetBuffer *nb) {
@@ -176,8 +364,16 @@ cs_bool NetBuffer_IsAlive(NetBuffer *nb) {
 }
 
 void NetBuffer_ForceClose(NetBuffer *nb) {
-	if(nb->fd != INVALID_SOCKET) Socket_Close(nb->fd);
-	Cleanup(&nb->write);
-	Cleanup(&nb->read);
+	if(nb->polled) {
+		Poll_Remove(nb->fd);
+		nb->polled = false;
+	}
+	if(nb->fd != INVALID_SOCKET && !nb->released) {
+		Socket_Close(nb->fd);
+		nb->released = true;
+	}
+	while(nb->write.count > 0)
+		PopSegment(nb);
+	ReleaseRead(nb);
 	nb->closed = true;
 }
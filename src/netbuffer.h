@@ -3,8 +3,22 @@
 #include "core.h"
 #include "types/netbuffer.h"
 
+#ifndef CORE_BUILD_PLUGIN
+	cs_bool NetPool_Init(void);
+	void NetPool_Uninit(void);
+	NetPage *NetPool_Alloc(cs_uint32 size);
+	void NetPool_Grab(NetPage *page);
+	void NetPool_Release(NetPage *page);
+
+	void NetBuffer_SetDefaultLimits(cs_uint32 limit, cs_uint32 lowat);
+	cs_bool NetBuffer_AppendShared(NetBuffer *nb, NetPage *page, cs_uint32 offset, cs_uint32 size);
+	cs_bool NetBuffer_Register(NetBuffer *nb);
+#endif
+
 API void NetBuffer_Init(NetBuffer *nb, Socket sock);
 API cs_bool NetBuffer_Process(NetBuffer *nb);
+API cs_bool NetBuffer_Flush(NetBuffer *nb);
+API cs_bool NetBuffer_IsWriteLow(NetBuffer *nb);
 API cs_char *NetBuffer_PeekRead(NetBuffer *nb, cs_uint32 point);
 API cs_int32 NetBuffer_ReadLine(NetBuffer *nb, cs_char *buffer, cs_uint32 buflen);
 API cs_char *NetBuffer_Read(NetBuffer *nb, cs_uint32 len);
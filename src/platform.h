@@ -12,8 +12,68 @@
 	void Memory_Uninit(void);
 
 	cs_bool Console_BindSignalHandler(TSHND handler);
+
+	/**
+	 * @brief Определяет расширения процессора, которые
+	 * поддерживают и сам процессор, и операционная система.
+	 * Вызывается один раз при запуске, до привязки ядер.
+	 */
+	void CPU_Init(void);
+
+	/**
+	 * @brief Создаёт безымянный объект разделяемой памяти.
+	 * Его отображения с copy-on-write делят страницы между
+	 * собой, пока какая-нибудь из них не будет изменена.
+	 *
+	 * @param size размер объекта
+	 * @return объект памяти, MEMORY_IMAGE_INVALID - ошибка
+	 */
+	MemoryImage Memory_CreateImage(cs_size size);
+
+	/**
+	 * @brief Создаёт объект памяти поверх временного файла.
+	 * Ядро само вытесняет давно не нужные страницы такого
+	 * объекта в файл, а файл удаляется вместе с последним
+	 * отображением.
+	 *
+	 * @param path путь до файла
+	 * @param size размер объекта
+	 * @return объект памяти, MEMORY_IMAGE_INVALID - ошибка
+	 */
+	MemoryImage Memory_CreateFileImage(cs_str path, cs_size size);
+
+	/**
+	 * @brief Выделяет обнулённые страницы памяти в обход кучи.
+	 * Освобождаются они через Memory_UnmapImage.
+	 *
+	 * @param size размер памяти
+	 * @param huge true - попросить у системы большие страницы
+	 * @return указатель на память, NULL - ошибка
+	 */
+	void *Memory_MapPages(cs_size size, cs_bool huge);
+
+	/**
+	 * @brief Отображает объект разделяемой памяти в адресное
+	 * пространство процесса. Отображение остаётся рабочим
+	 * и после закрытия самого объекта.
+	 *
+	 * @param img объект памяти
+	 * @param size размер отображения
+	 * @param cow true - изменения видны только этому отображению
+	 * @return указатель на память, NULL - ошибка
+	 */
+	void *Memory_MapImage(MemoryImage img, cs_size size, cs_bool cow);
+	void Memory_UnmapImage(void *ptr, cs_size size);
+	void Memory_CloseImage(MemoryImage img);
 #endif
 
+/**
+ * @brief Возвращает расширения процессора, доступные серверу.
+ * 
+ * @return комбинация флагов CPU_FEATURE_*
+ */
+API cs_uint32 CPU_GetFeatures(void);
+
 API void *Memory_TryAlloc(cs_size num, cs_size size);
 API void *Memory_TryRealloc(void *oldptr, cs_size new);
 API cs_size Memory_GetSize(void *ptr);
@@ -64,6 +124,7 @@ API cs_bool Socket_IsLocal(cs_ulong addr);
 API cs_error Socket_GetError(void);
 API cs_ulong Socket_AvailData(Socket n);
 API cs_bool Socket_SetNonBlocking(Socket n, cs_bool state);
+API cs_bool Socket_SetNotSentLowat(Socket n, cs_uint32 bytes);
 API cs_int32 Socket_SetAddr(struct sockaddr_in *ssa, cs_str ip, cs_uint16 port);
 API cs_bool Socket_SetAddrGuess(struct sockaddr_in *ssa, cs_str host, cs_uint16 port);
 API cs_bool Socket_Bind(Socket sock, struct sockaddr_in *ssa);
@@ -74,12 +135,20 @@ API cs_int32 Socket_Send(Socket sock, const cs_char *buf, cs_int32 len);
 API cs_bool Socket_Shutdown(Socket sock, cs_int32 how);
 API void Socket_Close(Socket sock);
 
+cs_bool Poll_Init(void);
+void Poll_Uninit(void);
+cs_bool Poll_Add(Socket sock, cs_uint32 events, void *ud);
+cs_bool Poll_Modify(Socket sock, cs_uint32 events, void *ud);
+cs_bool Poll_Remove(Socket sock);
+cs_int32 Poll_Wait(PollEvent *events, cs_int32 max, cs_int32 timeout);
+
 API Thread Thread_Create(TFUNC func, const TARG param, cs_bool detach);
 API cs_bool Thread_IsValid(Thread th);
 API cs_bool Thread_Signal(Thread th, cs_int32 sig);
 API void Thread_Detach(Thread th);
 API void Thread_Join(Thread th);
 API void Thread_Sleep(cs_uint32 ms);
+API cs_uint32 Thread_GetCPUCount(void);
 API cs_error Thread_GetError(void);
 
 API Mutex *Mutex_Create(void);
@@ -35,6 +35,64 @@ cs_bool Memory_Compare(const cs_byte *src1, const cs_byte *src2, cs_size len) {
 	return true;
 }
 
+static cs_uint32 CPUFeatures = 0;
+
+#if defined(CPU_USE_X86)
+#	if defined(_MSC_VER)
+#		include <intrin.h>
+
+INL static void CPUID(cs_uint32 leaf, cs_uint32 *regs) {
+	__cpuidex((int *)regs, (int)leaf, 0);
+}
+
+INL static cs_uint64 XGetBV(void) {
+	return _xgetbv(0);
+}
+#	else
+#		include <cpuid.h>
+
+INL static void CPUID(cs_uint32 leaf, cs_uint32 *regs) {
+	__cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+}
+
+INL static cs_uint64 XGetBV(void) {
+	cs_uint32 lo, hi;
+	__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((cs_uint64)hi << 32) | lo;
+}
+#	endif
+#endif
+
+void CPU_Init(void) {
+	CPUFeatures = 0;
+#if defined(CPU_USE_X86)
+	cs_uint32 regs[4], maxleaf;
+	CPUID(0, regs);
+	if((maxleaf = regs[0]) < 1) return;
+
+	CPUID(1, regs);
+	if(regs[2] & BIT(9)) CPUFeatures |= CPU_FEATURE_SSSE3;
+	if(regs[2] & BIT(20)) CPUFeatures |= CPU_FEATURE_SSE42;
+	// AVX-регистры должна сохранять при переключении
+	// потоков ещё и ОС, иначе они испортятся
+	if((regs[2] & BIT(27)) && (regs[2] & BIT(28)) && maxleaf >= 7) {
+		cs_uint64 xcr0 = XGetBV();
+		CPUID(7, regs);
+		if((xcr0 & 0x06) == 0x06 && (regs[1] & BIT(5)))
+			CPUFeatures |= CPU_FEATURE_AVX2;
+		if((xcr0 & 0xE6) == 0xE6 && (regs[1] & BIT(16)) && (regs[1] & BIT(30)))
+			CPUFeatures |= CPU_FEATURE_AVX512;
+	}
+#elif defined(CPU_USE_ARM64)
+	// В AArch64 NEON есть всегда
+	CPUFeatures |= CPU_FEATURE_NEON;
+#endif
+}
+
+cs_uint32 CPU_GetFeatures(void) {
+	return CPUFeatures;
+}
+
 cs_file File_Open(cs_str path, cs_str mode) {
 	return fopen(path, mode);
 }
@@ -183,6 +241,130 @@ cs_bool Socket_Shutdown(Socket sock, cs_int32 how) {
 	return shutdown(sock, how) == 0;
 }
 
+#ifndef CORE_USE_LINUX
+#if defined(CORE_USE_WINDOWS)
+#	define PollFd WSAPOLLFD
+#	define PollCall WSAPoll
+#else
+#	include <poll.h>
+#	define PollFd struct pollfd
+#	define PollCall poll
+#endif
+
+// Запасной вариант для систем без epoll: дескрипторы
+// хранятся в плотном массиве, при удалении на место
+// удаляемого элемента переносится последний.
+static struct _PollSet {
+	PollFd *fds;
+	void **uds;
+	cs_uint32 count, size, start;
+} pollSet = {0};
+
+cs_bool Poll_Init(void) {
+	return true;
+}
+
+void Poll_Uninit(void) {
+	if(pollSet.fds) {
+		Memory_Free(pollSet.fds);
+		Memory_Free(pollSet.uds);
+	}
+	pollSet = (struct _PollSet){0};
+}
+
+static cs_int32 PollFind(Socket sock) {
+	for(cs_uint32 i = 0; i < pollSet.count; i++)
+		if(pollSet.fds[i].fd == sock) return (cs_int32)i;
+
+	return -1;
+}
+
+static cs_int16 PollMask(cs_uint32 events) {
+	cs_int16 mask = 0;
+	if(events & POLL_EVENT_READ) mask |= POLLIN;
+	if(events & POLL_EVENT_WRITE) mask |= POLLOUT;
+	return mask;
+}
+
+cs_bool Poll_Add(Socket sock, cs_uint32 events, void *ud) {
+	if(PollFind(sock) != -1) return false;
+
+	if(pollSet.count == pollSet.size) {
+		cs_uint32 newsize = pollSet.size + 32;
+		void *fds = Memory_TryAlloc(newsize, sizeof(PollFd)),
+		*uds = Memory_TryAlloc(newsize, sizeof(void *));
+		if(!fds || !uds) {
+			if(fds) Memory_Free(fds);
+			if(uds) Memory_Free(uds);
+			return false;
+		}
+
+		if(pollSet.fds) {
+			Memory_Copy(fds, pollSet.fds, pollSet.count * sizeof(PollFd));
+			Memory_Copy(uds, pollSet.uds, pollSet.count * sizeof(void *));
+			Memory_Free(pollSet.fds);
+			Memory_Free(pollSet.uds);
+		}
+
+		pollSet.fds = fds;
+		pollSet.uds = uds;
+		pollSet.size = newsize;
+	}
+
+	pollSet.fds[pollSet.count].fd = sock;
+	pollSet.fds[pollSet.count].events = PollMask(events);
+	pollSet.fds[pollSet.count].revents = 0;
+	pollSet.uds[pollSet.count++] = ud;
+	return true;
+}
+
+cs_bool Poll_Modify(Socket sock, cs_uint32 events, void *ud) {
+	cs_int32 idx = PollFind(sock);
+	if(idx == -1) return false;
+	pollSet.fds[idx].events = PollMask(events);
+	pollSet.uds[idx] = ud;
+	return true;
+}
+
+cs_bool Poll_Remove(Socket sock) {
+	cs_int32 idx = PollFind(sock);
+	if(idx == -1) return false;
+	pollSet.fds[idx] = pollSet.fds[--pollSet.count];
+	pollSet.uds[idx] = pollSet.uds[pollSet.count];
+	return true;
+}
+
+cs_int32 Poll_Wait(PollEvent *events, cs_int32 max, cs_int32 timeout) {
+	if(pollSet.count == 0) {
+		Thread_Sleep(timeout < 0 ? 1000 : (cs_uint32)timeout);
+		return 0;
+	}
+
+	cs_int32 ret = PollCall(pollSet.fds, pollSet.count, timeout);
+	if(ret <= 0) return ret;
+
+	// Начинаем обход каждый раз с нового места, чтобы
+	// сокеты в конце массива не ждали своей очереди
+	cs_int32 count = 0;
+	for(cs_uint32 i = 0; i < pollSet.count && count < max; i++) {
+		cs_uint32 idx = (pollSet.start + i) % pollSet.count;
+		cs_int16 rev = pollSet.fds[idx].revents;
+		if(rev == 0) continue;
+
+		events[count].ud = pollSet.uds[idx];
+		events[count].events = 0;
+		if(rev & POLLIN) events[count].events |= POLL_EVENT_READ;
+		if(rev & POLLOUT) events[count].events |= POLL_EVENT_WRITE;
+		if(rev & (POLLERR | POLLHUP | POLLNVAL))
+			events[count].events |= POLL_EVENT_READ | POLL_EVENT_CLOSE;
+		count++;
+	}
+	pollSet.start++;
+
+	return count;
+}
+#endif
+
 cs_bool Directory_Ensure(cs_str path) {
 	return Directory_Exists(path) || Directory_Create(path);
 }
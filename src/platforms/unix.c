@@ -4,6 +4,7 @@
 #include <dlfcn.h>
 #include <poll.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include "core.h"
 #include "platform.h"
 #include "cserror.h"
@@ -43,6 +44,67 @@ void Memory_Free(void *ptr) {
 	free(ptr);
 }
 
+MemoryImage Memory_CreateImage(cs_size size) {
+	static cs_uint32 counter = 0;
+	cs_char name[64];
+	MemoryImage img;
+
+	// Имя нужно только на время создания объекта
+	do {
+		String_FormatBuf(name, 64, "/cserver-%d-%u", (cs_int32)getpid(), counter++);
+		img = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	} while(img < 0 && errno == EEXIST);
+	if(img < 0) return MEMORY_IMAGE_INVALID;
+	shm_unlink(name);
+
+	if(ftruncate(img, (off_t)size) < 0) {
+		close(img);
+		return MEMORY_IMAGE_INVALID;
+	}
+
+	return img;
+}
+
+MemoryImage Memory_CreateFileImage(cs_str path, cs_size size) {
+	MemoryImage img = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if(img < 0) return MEMORY_IMAGE_INVALID;
+	// Открытые отображения держат файл и без имени
+	unlink(path);
+
+	if(ftruncate(img, (off_t)size) < 0) {
+		close(img);
+		return MEMORY_IMAGE_INVALID;
+	}
+
+	return img;
+}
+
+void *Memory_MapPages(cs_size size, cs_bool huge) {
+	void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(ptr == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+	if(huge) (void)madvise(ptr, size, MADV_HUGEPAGE);
+#else
+	(void)huge;
+#endif
+	return ptr;
+}
+
+void *Memory_MapImage(MemoryImage img, cs_size size, cs_bool cow) {
+	void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		cow ? MAP_PRIVATE : MAP_SHARED, img, 0);
+	return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+void Memory_UnmapImage(void *ptr, cs_size size) {
+	munmap(ptr, size);
+}
+
+void Memory_CloseImage(MemoryImage img) {
+	close(img);
+}
+
 cs_error File_Access(cs_str path, cs_int32 mode) {
 	if(access(path, mode) < 0)
 		return Thread_GetError();
@@ -110,12 +172,81 @@ cs_bool Socket_SetNonBlocking(Socket n, cs_bool state) {
 	return fcntl(n, F_SETFL, flags) == 0;
 }
 
+cs_bool Socket_SetNotSentLowat(Socket n, cs_uint32 bytes) {
+#ifdef TCP_NOTSENT_LOWAT
+	return setsockopt(n, IPPROTO_TCP, TCP_NOTSENT_LOWAT, (void *)&bytes, sizeof(bytes)) == 0;
+#else
+	(void)n; (void)bytes;
+	return false;
+#endif
+}
+
 void Socket_Close(Socket n) {
 	close(n);
 }
 
 void Socket_Uninit(void) {}
 
+#ifdef CORE_USE_LINUX
+#include <sys/epoll.h>
+
+#define POLL_MAX_EVENTS 64
+
+static cs_int32 pollFd = -1;
+
+cs_bool Poll_Init(void) {
+	if(pollFd != -1) return true;
+	return (pollFd = epoll_create1(EPOLL_CLOEXEC)) != -1;
+}
+
+void Poll_Uninit(void) {
+	if(pollFd != -1) {
+		close(pollFd);
+		pollFd = -1;
+	}
+}
+
+static cs_bool PollControl(cs_int32 op, Socket sock, cs_uint32 events, void *ud) {
+	struct epoll_event ev = {
+		.events = 0,
+		.data.ptr = ud
+	};
+
+	if(events & POLL_EVENT_READ) ev.events |= EPOLLIN | EPOLLRDHUP;
+	if(events & POLL_EVENT_WRITE) ev.events |= EPOLLOUT;
+	return epoll_ctl(pollFd, op, sock, &ev) == 0;
+}
+
+cs_bool Poll_Add(Socket sock, cs_uint32 events, void *ud) {
+	return PollControl(EPOLL_CTL_ADD, sock, events, ud);
+}
+
+cs_bool Poll_Modify(Socket sock, cs_uint32 events, void *ud) {
+	return PollControl(EPOLL_CTL_MOD, sock, events, ud);
+}
+
+cs_bool Poll_Remove(Socket sock) {
+	return PollControl(EPOLL_CTL_DEL, sock, 0, NULL);
+}
+
+cs_int32 Poll_Wait(PollEvent *events, cs_int32 max, cs_int32 timeout) {
+	struct epoll_event evs[POLL_MAX_EVENTS];
+	cs_int32 count = epoll_wait(pollFd, evs, min(max, POLL_MAX_EVENTS), timeout);
+	if(count < 0) return errno == EINTR ? 0 : -1;
+
+	for(cs_int32 i = 0; i < count; i++) {
+		cs_uint32 ev = evs[i].events;
+		events[i].ud = evs[i].data.ptr;
+		events[i].events = 0;
+		if(ev & (EPOLLIN | EPOLLRDHUP)) events[i].events |= POLL_EVENT_READ;
+		if(ev & EPOLLOUT) events[i].events |= POLL_EVENT_WRITE;
+		if(ev & (EPOLLERR | EPOLLHUP)) events[i].events |= POLL_EVENT_READ | POLL_EVENT_CLOSE;
+	}
+
+	return count;
+}
+#endif
+
 static cs_bool checkExtension(cs_str filename, cs_str ext) {
 	cs_str _ext = String_LastChar(filename, '.');
 	if(!_ext && !ext) return true;
@@ -225,6 +356,11 @@ void Thread_Sleep(cs_uint32 ms) {
 	usleep(ms * 1000);
 }
 
+cs_uint32 Thread_GetCPUCount(void) {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (cs_uint32)count : 1;
+}
+
 Mutex *Mutex_Create(void) {
 	Mutex *ptr = Memory_Alloc(1, sizeof(Mutex));
 	cs_int32 ret;
@@ -313,7 +449,18 @@ cs_bool Waitable_TryWait(Waitable *wte, cs_ulong timeout) {
 	ts.tv_sec += (add + secs);
 	ts.tv_nsec = timeout % (1000 * 1000 * 1000);
 
-	return pthread_cond_timedwait(&wte->cond, &wte->mutex->handle, &ts) == 0;
+	// Как и в Waitable_Wait, уже выставленный сигнал
+	// не ждём, а ложные пробуждения не считаем сигналом
+	Mutex_Lock(wte->mutex);
+	cs_bool signalled;
+	while(!(signalled = wte->signalled)) {
+		if(pthread_cond_timedwait(&wte->cond, &wte->mutex->handle, &ts) == ETIMEDOUT) {
+			signalled = wte->signalled;
+			break;
+		}
+	}
+	Mutex_Unlock(wte->mutex);
+	return signalled;
 }
 
 cs_int32 Time_Format(cs_char *buf, cs_size buflen) {
@@ -31,6 +31,47 @@ void Memory_Free(void *ptr) {
 	HeapFree(hHeap, 0, ptr);
 }
 
+MemoryImage Memory_CreateImage(cs_size size) {
+	return CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		(DWORD)((cs_uint64)size >> 32), (DWORD)size, NULL);
+}
+
+MemoryImage Memory_CreateFileImage(cs_str path, cs_size size) {
+	HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE,
+		FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+	if(file == INVALID_HANDLE_VALUE) return MEMORY_IMAGE_INVALID;
+	// Объект отображения сам держит файл открытым
+	HANDLE img = CreateFileMappingA(file, NULL, PAGE_READWRITE,
+		(DWORD)((cs_uint64)size >> 32), (DWORD)size, NULL);
+	CloseHandle(file);
+	return img;
+}
+
+// Большие страницы Windows выдаёт только с привилегией
+// SeLockMemoryPrivilege, поэтому huge здесь не учитывается
+void *Memory_MapPages(cs_size size, cs_bool huge) {
+	(void)huge;
+	MemoryImage img = Memory_CreateImage(size);
+	if(img == MEMORY_IMAGE_INVALID) return NULL;
+	void *ptr = Memory_MapImage(img, size, false);
+	Memory_CloseImage(img);
+	return ptr;
+}
+
+void *Memory_MapImage(MemoryImage img, cs_size size, cs_bool cow) {
+	return MapViewOfFile(img, cow ? FILE_MAP_COPY : FILE_MAP_WRITE, 0, 0, size);
+}
+
+void Memory_UnmapImage(void *ptr, cs_size size) {
+	(void)size;
+	UnmapViewOfFile(ptr);
+}
+
+void Memory_CloseImage(MemoryImage img) {
+	CloseHandle(img);
+}
+
 cs_error File_Access(cs_str path, cs_int32 mode) {
 	return _access_s(path, mode);
 }
@@ -96,6 +137,11 @@ cs_bool Socket_SetNonBlocking(Socket n, cs_bool state) {
 	return ioctlsocket(n, FIONBIO, &(cs_ulong){state}) == 0;
 }
 
+cs_bool Socket_SetNotSentLowat(Socket n, cs_uint32 bytes) {
+	(void)n; (void)bytes;
+	return false;
+}
+
 void Socket_Close(Socket n) {
 	if(closesocket(n) == SOCKET_ERROR)
 		Error_PrintSys(false);
@@ -212,6 +258,12 @@ void Thread_Sleep(cs_uint32 ms) {
 	Sleep(ms);
 }
 
+cs_uint32 Thread_GetCPUCount(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (cs_uint32)info.dwNumberOfProcessors : 1;
+}
+
 Mutex *Mutex_Create(void) {
 	Mutex *ptr = Memory_Alloc(1, sizeof(Mutex));
 	InitializeCriticalSection(ptr);
@@ -38,8 +38,9 @@ if(data == NULL) { \
 NetBuffer_EndWrite(&cl->netbuf, (cs_uint32)(data - start)); \
 Mutex_Unlock(cl->mutex);
 
-static cs_uint16 extensionsCount = 0;
+static cs_uint16 extensionsCount = 0, extensionsIndexed = 0;
 static CPESvExt *headExtension = NULL;
+static CPESvExt *extensionsTable[CPE_EXTTABLE_SIZE] = {0};
 
 void Proto_WriteString(cs_char **dataptr, cs_str string) {
 	cs_size size = 0;
@@ -327,6 +328,239 @@ void Vanilla_WriteUserType(Client *client, cs_byte type) {
 	PacketWriter_End(client);
 }
 
+cs_char *Proto_SharedWrite(SharedPacket *sp, cs_byte var, cs_uint32 msz) {
+	if(var >= PROTO_SHARED_VARIANTS) return NULL;
+	if(!sp->page && (sp->page = NetPool_Alloc(NETBUFFER_PAGE_SIZE)) == NULL)
+		return NULL;
+
+	NetPage *page = sp->page;
+	if(sp->ready & BIT(var)) {
+		// Дописывать можно только последний вариант,
+		// иначе он перестанет быть непрерывным
+		if(sp->last != var) return NULL;
+	} else {
+		sp->ready |= BIT(var);
+		sp->offset[var] = page->used;
+		sp->size[var] = 0;
+		sp->last = var;
+	}
+
+	if(page->size - page->used < msz) {
+		// Не влезший вариант выбрасывается целиком
+		page->used = sp->offset[var];
+		sp->ready &= ~BIT(var);
+		return NULL;
+	}
+
+	return page->data + page->used;
+}
+
+void Proto_SharedCommit(SharedPacket *sp, cs_uint32 size) {
+	sp->page->used += size;
+	sp->size[sp->last] += size;
+}
+
+cs_bool Proto_SharedIsReady(SharedPacket *sp, cs_byte var) {
+	return var < PROTO_SHARED_VARIANTS && (sp->ready & BIT(var)) != 0;
+}
+
+void Proto_SharedSend(SharedPacket *sp, cs_byte var, Client *client) {
+	if(!Proto_SharedIsReady(sp, var)) return;
+	if(!NetBuffer_IsAlive(&client->netbuf) || Client_IsBot(client)) return;
+	Mutex_Lock(client->mutex);
+	if(!NetBuffer_AppendShared(&client->netbuf, sp->page, sp->offset[var], sp->size[var]))
+		NetBuffer_ForceClose(&client->netbuf);
+	Mutex_Unlock(client->mutex);
+}
+
+void Proto_SharedFree(SharedPacket *sp) {
+	if(sp->page) {
+		NetPool_Release(sp->page);
+		sp->page = NULL;
+	}
+	sp->ready = 0;
+}
+
+cs_bool Vanilla_SharedChat(SharedPacket *sp, cs_byte var, EMesgType type, cs_str mesg) {
+	cs_char *data = Proto_SharedWrite(sp, var, 66), *start = data;
+	if(!data) return false;
+
+	*data++ = PACKET_SENDMESSAGE;
+	*data++ = (cs_byte)type;
+	Proto_WriteString(&data, mesg);
+
+	Proto_SharedCommit(sp, (cs_uint32)(data - start));
+	return true;
+}
+
+INL static void OffsetToSVec(World *world, cs_uint32 offset, SVec *pos) {
+	cs_uint32 dx = (cs_uint32)world->info.dimensions.x,
+	dz = (cs_uint32)world->info.dimensions.z;
+	pos->x = (cs_int16)(offset % dx);
+	pos->y = (cs_int16)((offset / dx) / dz);
+	pos->z = (cs_int16)((offset / dx) % dz);
+}
+
+// Нулевой бит варианта - замена блоков на запасные,
+// первый - поддержка клиентом BulkBlockUpdate
+#define BLOCKS_VAR_FALLBACK BIT(0)
+#define BLOCKS_VAR_BULK BIT(1)
+
+static cs_bool WriteBlockUpdates(SharedPacket *sp, cs_byte var, World *world, cs_uint32 *offsets, cs_uint32 count) {
+	const BlockID *fback = (var & BLOCKS_VAR_FALLBACK) ? Block_GetFallbackTable(world)->lut : NULL;
+	cs_char *data, *start;
+
+	if(var & BLOCKS_VAR_BULK) {
+		if((data = start = Proto_SharedWrite(sp, var, 1282)) == NULL) return false;
+		*data++ = PACKET_BULKBLOCKUPDATE;
+		// Клиенту нужно количество блоков, не индекс последнего
+		*data++ = (cs_byte)(count - 1);
+		Memory_Zero(data, 1280);
+		cs_uint32 *boffsets = (cs_uint32 *)data;
+		BlockID *bids = (BlockID *)(data + 1024);
+		for(cs_uint32 i = 0; i < count; i++) {
+			BlockID id = World_GetBlockO(world, offsets[i]);
+			boffsets[i] = htonl(offsets[i]);
+			bids[i] = fback ? fback[id] : id;
+		}
+		data += 1280;
+	} else {
+		if((data = start = Proto_SharedWrite(sp, var, count * 8)) == NULL) return false;
+		for(cs_uint32 i = 0; i < count; i++) {
+			SVec pos;
+			BlockID id = World_GetBlockO(world, offsets[i]);
+			OffsetToSVec(world, offsets[i], &pos);
+			*data++ = PACKET_SETBLOCK_SERVER;
+			Proto_WriteSVec(&data, &pos);
+			*data++ = fback ? fback[id] : id;
+		}
+	}
+
+	Proto_SharedCommit(sp, (cs_uint32)(data - start));
+	return true;
+}
+
+void Vanilla_BroadcastBlockUpdates(World *world, cs_uint32 *offsets, cs_uint32 count) {
+	if(count == 0 || count > WORLD_BATCH_MAX) return;
+	SharedPacket sp = {0};
+
+	for(cs_uint16 i = 0; i < world->clients.count; i++) {
+		Client *client = world->clients.list[i];
+		cs_byte var = Client_IsFallbackNeeded(client) ? BLOCKS_VAR_FALLBACK : 0;
+		if(Client_GetExtVer(client, EXT_BULKUPDATE)) var |= BLOCKS_VAR_BULK;
+
+		if(!Proto_SharedIsReady(&sp, var) && !WriteBlockUpdates(&sp, var, world, offsets, count)) {
+			for(cs_uint32 j = 0; j < count; j++) {
+				SVec pos;
+				OffsetToSVec(world, offsets[j], &pos);
+				Client_SetBlock(client, &pos, World_GetBlockO(world, offsets[j]));
+			}
+			continue;
+		}
+
+		Proto_SharedSend(&sp, var, client);
+	}
+
+	Proto_SharedFree(&sp);
+}
+
+void Vanilla_BroadcastMovement(Client *client) {
+	PlayerData *pd = &client->playerData;
+	cs_int32 pos[3] = {
+		(cs_int32)(pd->position.x * 32),
+		(cs_int32)(pd->position.y * 32),
+		(cs_int32)(pd->position.z * 32)
+	}, delta[3];
+	cs_byte ang[2] = {
+		(cs_byte)(pd->angle.yaw * 256.0f / 360.0f),
+		(cs_byte)(pd->angle.pitch * 256.0f / 360.0f)
+	};
+	cs_bool moved = false, rotated, relative = !pd->absolute;
+
+	for(cs_int32 i = 0; i < 3; i++) {
+		delta[i] = pos[i] - pd->sentPos[i];
+		if(delta[i] != 0) moved = true;
+		if(delta[i] < -128 || delta[i] > 127) relative = false;
+	}
+	rotated = ang[0] != pd->sentAng[0] || ang[1] != pd->sentAng[1];
+	if(!moved && !rotated && relative) return;
+
+	World *world = pd->world;
+	if(!world) return;
+
+	SharedPacket sp = {0};
+	for(cs_uint16 i = 0; i < world->clients.count; i++) {
+		Client *other = world->clients.list[i];
+		if(client == other || !Client_CheckState(other, CLIENT_STATE_INGAME) ||
+		!Client_CanSee(other, client)) continue;
+
+		// Относительные пакеты одинаковы для всех клиентов,
+		// абсолютные же зависят от поддержки ExtEntityPositions
+		cs_byte var = relative ? 0 : 1 + (Client_GetExtVer(other, EXT_ENTPOS) > 0);
+		if(!Proto_SharedIsReady(&sp, var)) {
+			cs_char *data = Proto_SharedWrite(&sp, var, 18), *start = data;
+			if(!data) {
+				Vanilla_WritePosAndOrient(other, client);
+				continue;
+			}
+
+			if(!relative) {
+				*data++ = PACKET_ENTITYTELEPORT;
+				*data++ = client->id;
+				WriteExtEntityPos(&data, &pd->position, &pd->angle, var == 2, false);
+			} else {
+				*data++ = moved ? (rotated ? PACKET_ENTITYUPDATEFULL : PACKET_ENTITYUPDATEPOS)
+				: PACKET_ENTITYUPDATEORIENT;
+				*data++ = client->id;
+				if(moved) {
+					*data++ = (cs_int8)delta[0];
+					*data++ = (cs_int8)delta[1];
+					*data++ = (cs_int8)delta[2];
+				}
+				if(rotated) {
+					*data++ = ang[0];
+					*data++ = ang[1];
+				}
+			}
+
+			Proto_SharedCommit(&sp, (cs_uint32)(data - start));
+		}
+
+		Proto_SharedSend(&sp, var, other);
+	}
+	Proto_SharedFree(&sp);
+
+	Memory_Copy(pd->sentPos, pos, sizeof(pos));
+	Memory_Copy(pd->sentAng, ang, sizeof(ang));
+	pd->absolute = false;
+}
+
+void Vanilla_BroadcastDespawn(Client *client) {
+	SharedPacket sp = {0};
+
+	for(ClientID i = 0; i < MAX_CLIENTS; i++) {
+		Client *other = Clients_List[i];
+		if(!other || !Client_CanSee(other, client)) continue;
+
+		cs_byte var = client == other;
+		if(!Proto_SharedIsReady(&sp, var)) {
+			cs_char *data = Proto_SharedWrite(&sp, var, 2), *start = data;
+			if(!data) {
+				Vanilla_WriteDespawn(other, client);
+				continue;
+			}
+
+			*data++ = PACKET_ENTITYDESPAWN;
+			*data++ = var ? CLIENT_SELF : client->id;
+			Proto_SharedCommit(&sp, (cs_uint32)(data - start));
+		}
+
+		Proto_SharedSend(&sp, var, other);
+	}
+
+	Proto_SharedFree(&sp);
+}
+
 static cs_bool FinishHandshake(Client *client) {
 	cs_int32 extVer = Client_GetExtVer(client, EXT_CUSTOMMODELS);
 	cs_bool hasParts = Client_GetExtVer(client, EXT_CUSTOMPARTS) > 0;
@@ -404,14 +638,6 @@ cs_bool Handler_Handshake(Client *client, cs_char *data) {
 	return true;
 }
 
-INL static void UpdateBlock(World *world, SVec *pos, BlockID block) {
-	for(ClientID i = 0; i < MAX_CLIENTS; i++) {
-		Client *client = Clients_List[i];
-		if(client && Client_IsInWorld(client, world))
-			Client_SetBlock(client, pos, block);
-	}
-}
-
 cs_bool Handler_SetBlock(Client *client, cs_char *data) {
 	ValidateClientState(client, CLIENT_STATE_INGAME, true);
 
@@ -431,13 +657,13 @@ cs_bool Handler_SetBlock(Client *client, cs_char *data) {
 				return false;
 			}
 			if(Event_Call(EVT_ONBLOCKPLACE, &params) && World_SetBlock(world, &params.pos, params.id))
-				UpdateBlock(world, &params.pos, params.id);
+				World_QueueBlockUpdate(world, World_GetOffset(world, &params.pos));
 			else
 				Vanilla_WriteSetBlock(client, &params.pos, World_GetBlock(world, &params.pos));
 			break;
 		case SETBLOCK_MODE_DESTROY:
 			if(Event_Call(EVT_ONBLOCKPLACE, &params) && World_SetBlock(world, &params.pos, BLOCK_AIR))
-				UpdateBlock(world, &params.pos, BLOCK_AIR);
+				World_QueueBlockUpdate(world, World_GetOffset(world, &params.pos));
 			else
 				Vanilla_WriteSetBlock(client, &params.pos, World_GetBlock(world, &params.pos));
 			break;
@@ -492,13 +718,8 @@ cs_bool Handler_PosAndOrient(Client *client, cs_char *data) {
 		}
 	}
 
-	if(ReadClientPos(client, data)) {
-		for(ClientID i = 0; i < MAX_CLIENTS; i++) {
-			Client *other = Clients_List[i];
-			if(other && client != other && Client_CheckState(other, CLIENT_STATE_INGAME) && Client_IsInSameWorld(client, other))
-				Vanilla_WritePosAndOrient(other, client);
-		}
-	}
+	if(ReadClientPos(client, data))
+		client->playerData.moved = true;
 	return true;
 }
 
@@ -1087,6 +1308,8 @@ cs_bool CPEHandler_ExtEntry(Client *client, cs_char *data) {
 	ext->version = ntohl(*(cs_int32 *)data);
 	if(ext->version < 1) return false;
 	ext->hash = Compr_CRC32((cs_byte*)tempname, (cs_uint32)String_Length(tempname));
+	cs_int16 idx = CPE_GetExtIndex(ext->hash);
+	if(idx >= 0) exts->versions[idx] = ext->version;
 
 	if(exts->current == exts->count) {
 		if(Client_GetExtVer(client, EXT_CUSTOMBLOCKS)) {
@@ -1201,13 +1424,38 @@ cs_bool Packet_SetCPEHandler(EPacketID id, cs_uint32 hash, cs_int32 ver, cs_uint
 	return true;
 }
 
+cs_int16 CPE_GetExtIndex(cs_ulong hash) {
+	for(cs_uint32 i = 0; i < CPE_EXTTABLE_SIZE; i++) {
+		CPESvExt *ext = extensionsTable[(hash + i) % CPE_EXTTABLE_SIZE];
+		if(!ext) break;
+		if(ext->hash == hash) return ext->index;
+	}
+
+	return -1;
+}
+
 void CPE_RegisterServerExtension(cs_str name, cs_int32 version) {
 	CPESvExt *tmp = Memory_Alloc(1, sizeof(struct _CPESvExt));
 	tmp->name = name;
 	tmp->version = version;
+	tmp->hash = Compr_CRC32((const cs_byte *)name, (cs_uint32)String_Length(name));
+	tmp->index = CPE_GetExtIndex(tmp->hash);
 	tmp->next = headExtension;
 	headExtension = tmp;
 	++extensionsCount;
+
+	// Каждое новое дополнение получает свой индекс в таблице
+	// версий клиента, так что его проверка - одно чтение массива
+	if(tmp->index == -1 && extensionsIndexed < CPE_MAX_EXTENSIONS) {
+		tmp->index = (cs_int16)extensionsIndexed++;
+		for(cs_uint32 i = 0; i < CPE_EXTTABLE_SIZE; i++) {
+			CPESvExt **slot = &extensionsTable[(tmp->hash + i) % CPE_EXTTABLE_SIZE];
+			if(!*slot) {
+				*slot = tmp;
+				break;
+			}
+		}
+	}
 }
 
 static const struct extReg {
@@ -1287,6 +1535,8 @@ void Packet_UnregisterAll(void) {
 		headExtension = headExtension->next;
 		Memory_Free(tmp);
 	}
+	Memory_Fill(extensionsTable, sizeof(extensionsTable), 0);
+	extensionsCount = extensionsIndexed = 0;
 
 	for(cs_int32 i = 0; i < 255; i++) {
 		Packet *packet = packetsList[i];
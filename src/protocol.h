@@ -31,12 +31,32 @@ typedef cs_bool(*packetHandler)(Client *, cs_char *);
 	NOINL void Vanilla_WriteKick(Client *client, cs_str reason);
 	NOINL void Vanilla_WriteUserType(Client *client, cs_byte type);
 
+	/*
+	* Пакеты, рассылаемые сразу нескольким
+	* клиентам, кодируются один раз на каждый
+	* вариант протокола и потом только копируются
+	* (или прикрепляются) в очереди отправки
+	*/
+
+	cs_char *Proto_SharedWrite(SharedPacket *sp, cs_byte var, cs_uint32 msz);
+	void Proto_SharedCommit(SharedPacket *sp, cs_uint32 size);
+	cs_bool Proto_SharedIsReady(SharedPacket *sp, cs_byte var);
+	void Proto_SharedSend(SharedPacket *sp, cs_byte var, Client *client);
+	void Proto_SharedFree(SharedPacket *sp);
+
+	cs_bool Vanilla_SharedChat(SharedPacket *sp, cs_byte var, EMesgType type, cs_str mesg);
+	void Vanilla_BroadcastBlockUpdates(World *world, cs_uint32 *offsets, cs_uint32 count);
+	void Vanilla_BroadcastMovement(Client *client);
+	void Vanilla_BroadcastDespawn(Client *client);
+
 	/*
 	* Врайтеры и хендлеры
 	* CPE протокола и прочие,
 	* связанные с CPE вещи
 	*/
 
+	cs_int16 CPE_GetExtIndex(cs_ulong hash);
+
 	NOINL void CPE_WriteInfo(Client *client);
 	NOINL void CPE_WriteExtEntry(Client *client, CPESvExt *ext);
 	NOINL void CPE_WriteClickDistance(Client *client, cs_uint16 dist);
@@ -0,0 +1,149 @@
+#include "core.h"
+#include "platform.h"
+#include "remap.h"
+
+#if defined(CPU_USE_X86)
+#	include <immintrin.h>
+// Дальше этого числа строк побайтовая замена быстрее
+#	define REMAP_SSSE3_ROWS 4
+#	define REMAP_AVX2_ROWS 6
+#elif defined(CPU_USE_ARM64)
+#	include <arm_neon.h>
+#endif
+
+// Ядро заменяет блоки целыми векторами и возвращает,
+// сколько блоков обработало, остаток доделывает цикл
+typedef cs_uint32(*RemapKernel)(const RemapTable *rt, const BlockID *src, BlockID *dst, cs_uint32 size);
+static RemapKernel Kernel = NULL;
+
+void Remap_Update(RemapTable *rt) {
+	rt->rows = 0;
+	for(cs_uint16 id = 0; id < 256; id++)
+		if(rt->lut[id] != id) rt->rows |= (cs_uint16)BIT((id >> 4));
+}
+
+static void RemapScalar(const RemapTable *rt, const BlockID *src, BlockID *dst, cs_uint32 size) {
+	for(cs_uint32 i = 0; i < size; i++)
+		dst[i] = rt->lut[src[i]];
+}
+
+#if defined(CPU_USE_X86)
+/*
+ * pshufb выбирает байт по младшему полубайту индекса,
+ * поэтому таблица делится на 16 строк по старшему.
+ * Строки, где блоки заменяются сами на себя, можно не
+ * трогать, а кроме них обычно меняются одна-две строки
+ * с блоками CPE и кастомными блоками.
+*/
+CPU_TARGET("ssse3")
+static cs_uint32 RemapSSSE3(const RemapTable *rt, const BlockID *src, BlockID *dst, cs_uint32 size) {
+	__m128i rows[16], hisel[16], lomask = _mm_set1_epi8(0x0F);
+	cs_uint32 count = 0, i = 0;
+
+	for(cs_byte r = 0; r < 16; r++) {
+		if(rt->rows & BIT(r)) {
+			rows[count] = _mm_loadu_si128((const __m128i *)(rt->lut + r * 16));
+			hisel[count++] = _mm_set1_epi8((cs_char)r);
+		}
+	}
+	if(count > REMAP_SSSE3_ROWS) return 0;
+
+	for(; i + 16 <= size; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i)),
+		hi = _mm_and_si128(_mm_srli_epi16(v, 4), lomask),
+		lo = _mm_and_si128(v, lomask);
+		for(cs_uint32 r = 0; r < count; r++) {
+			__m128i m = _mm_cmpeq_epi8(hi, hisel[r]);
+			v = _mm_or_si128(_mm_andnot_si128(m, v),
+				_mm_and_si128(m, _mm_shuffle_epi8(rows[r], lo)));
+		}
+		_mm_storeu_si128((__m128i *)(dst + i), v);
+	}
+
+	return i;
+}
+
+// vpshufb ищет только внутри своей 128-битной половины,
+// так что строка таблицы копируется в обе половины
+CPU_TARGET("avx2")
+static cs_uint32 RemapAVX2(const RemapTable *rt, const BlockID *src, BlockID *dst, cs_uint32 size) {
+	__m256i rows[16], hisel[16], lomask = _mm256_set1_epi8(0x0F);
+	cs_uint32 count = 0, i = 0;
+
+	for(cs_byte r = 0; r < 16; r++) {
+		if(rt->rows & BIT(r)) {
+			rows[count] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(rt->lut + r * 16)));
+			hisel[count++] = _mm256_set1_epi8((cs_char)r);
+		}
+	}
+	if(count > REMAP_AVX2_ROWS) return 0;
+
+	for(; i + 32 <= size; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(src + i)),
+		hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), lomask),
+		lo = _mm256_and_si256(v, lomask);
+		for(cs_uint32 r = 0; r < count; r++)
+			v = _mm256_blendv_epi8(v, _mm256_shuffle_epi8(rows[r], lo),
+				_mm256_cmpeq_epi8(hi, hisel[r]));
+		_mm256_storeu_si256((__m256i *)(dst + i), v);
+	}
+
+	return i;
+}
+#elif defined(CPU_USE_ARM64)
+INL static uint8x16x4_t LoadQuarter(const BlockID *lut) {
+	uint8x16x4_t t;
+	t.val[0] = vld1q_u8(lut);
+	t.val[1] = vld1q_u8(lut + 16);
+	t.val[2] = vld1q_u8(lut + 32);
+	t.val[3] = vld1q_u8(lut + 48);
+	return t;
+}
+
+// tbl ищет сразу в 64 байтах таблицы, а за их
+// пределами возвращает ноль, так что четыре
+// поиска со сдвигом индекса покрывают все 256
+static cs_uint32 RemapNEON(const RemapTable *rt, const BlockID *src, BlockID *dst, cs_uint32 size) {
+	uint8x16x4_t t0 = LoadQuarter(rt->lut), t1 = LoadQuarter(rt->lut + 64),
+	t2 = LoadQuarter(rt->lut + 128), t3 = LoadQuarter(rt->lut + 192);
+	uint8x16_t step = vdupq_n_u8(64);
+	cs_uint32 i = 0;
+
+	for(; i + 16 <= size; i += 16) {
+		uint8x16_t v = vld1q_u8(src + i), out = vqtbl4q_u8(t0, v);
+		v = vsubq_u8(v, step); out = vorrq_u8(out, vqtbl4q_u8(t1, v));
+		v = vsubq_u8(v, step); out = vorrq_u8(out, vqtbl4q_u8(t2, v));
+		v = vsubq_u8(v, step); out = vorrq_u8(out, vqtbl4q_u8(t3, v));
+		vst1q_u8(dst + i, out);
+	}
+
+	return i;
+}
+#endif
+
+void Remap_Bind(cs_uint32 features) {
+	Kernel = NULL;
+#if defined(CPU_USE_X86)
+	if(features & CPU_FEATURE_AVX2)
+		Kernel = RemapAVX2;
+	else if(features & CPU_FEATURE_SSSE3)
+		Kernel = RemapSSSE3;
+#elif defined(CPU_USE_ARM64)
+	if(features & CPU_FEATURE_NEON)
+		Kernel = RemapNEON;
+#else
+	(void)features;
+#endif
+}
+
+void Remap_Apply(const RemapTable *rt, const BlockID *src, BlockID *dst, cs_uint32 size) {
+	cs_uint32 done = 0;
+
+	if(rt->rows == 0) {
+		if(src != dst) Memory_Copy(dst, src, size);
+		return;
+	}
+
+	if(Kernel) done = Kernel(rt, src, dst, size);
+	RemapScalar(rt, src + done, dst + done, size - done);
+}
@@ -0,0 +1,37 @@
+#ifndef REMAP_H
+#define REMAP_H
+#include "core.h"
+#include "types/remap.h"
+
+#ifndef CORE_BUILD_PLUGIN
+	/**
+	 * @brief Пересчитывает строки таблицы после изменения lut.
+	 * Без этого Remap_Apply не заметит новых замен.
+	 *
+	 * @param rt указатель на таблицу замены
+	 */
+	void Remap_Update(RemapTable *rt);
+
+	/**
+	 * @brief Выбирает самое быстрое ядро замены из тех,
+	 * что поддерживает процессор. Без вызова этой функции
+	 * блоки заменяются обычным циклом.
+	 *
+	 * @param features комбинация флагов CPU_FEATURE_*
+	 */
+	void Remap_Bind(cs_uint32 features);
+
+	/**
+	 * @brief Заменяет каждый блок массива по таблице.
+	 * Массивы могут совпадать, но не должны частично
+	 * перекрываться.
+	 *
+	 * @param rt указатель на таблицу замены
+	 * @param src исходные блоки
+	 * @param dst массив для заменённых блоков
+	 * @param size количество блоков
+	 */
+	void Remap_Apply(const RemapTable *rt, const BlockID *src, BlockID *dst, cs_uint32 size);
+#endif
+
+#endif
@@ -4,6 +4,8 @@
 #include "cserror.h"
 #include "server.h"
 #include "netbuffer.h"
+#include "aoi.h"
+#include "compr.h"
 #include "client.h"
 #include "protocol.h"
 #include "config.h"
@@ -25,6 +27,9 @@ cs_bool Server_Active = false, Server_Ready = false;
 cs_uint64 Server_StartTime = 0;
 Socket Server_Socket = 0;
 
+#define SERVER_POLL_EVENTS 64
+#define SERVER_IDLE_WAIT 500
+
 INL static ClientID TryToGetIDFor(Client *client) {
 	cs_int16 maxPlayers = (cs_byte)Config_GetIntByKey(Server_Config, CFG_MAXPLAYERS_KEY);
 	cs_int8 maxConnPerIP = (cs_int8)Config_GetIntByKey(Server_Config, CFG_CONN_KEY),
@@ -71,7 +76,9 @@ INL static cs_bool ProcessClient(Client *client) {
 	}
 
 	if(Client_IsBot(client)) return true;
+	Mutex_Lock(client->mutex);
 	NetBuffer_Process(&client->netbuf);
+	Mutex_Unlock(client->mutex);
 
 	switch(client->state) {
 		case CLIENT_STATE_INITIAL:
@@ -84,7 +91,8 @@ INL static cs_bool ProcessClient(Client *client) {
 						return true;
 					}
 					client->websock->proto = "ClassiCube";
-					client->websock->maxpaylen = 32 * 1024;
+					// Кадр должен целиком помещаться в буфер чтения
+					client->websock->maxpaylen = NETBUFFER_PAGE_SIZE - 14;
 				}
 			}
 			break;
@@ -134,10 +142,27 @@ static cs_bool ProcessClients(void) {
 	return canFinish;
 }
 
-static void DoNetTick(void) {
+static cs_bool AcceptPending = false;
+
+static void WaitEvents(cs_int32 timeout) {
+	PollEvent events[SERVER_POLL_EVENTS];
+	cs_int32 count = Poll_Wait(events, SERVER_POLL_EVENTS, timeout);
+
+	for(cs_int32 i = 0; i < count; i++) {
+		NetBuffer *nb = (NetBuffer *)events[i].ud;
+		if(nb) nb->events |= events[i].events;
+		else AcceptPending = true;
+	}
+}
+
+static void AcceptClients(void) {
+	if(!AcceptPending) return;
+	AcceptPending = false;
+
 	struct sockaddr_in caddr;
-	Socket fd = Socket_Accept(Server_Socket, &caddr);
-	if(fd != INVALID_SOCKET) {
+	Socket fd;
+
+	while((fd = Socket_Accept(Server_Socket, &caddr)) != INVALID_SOCKET) {
 		if(!Server_Active) {
 			Socket_Close(fd);
 			return;
@@ -152,7 +177,11 @@ static void DoNetTick(void) {
 				tmp->lastmsg = Time_GetMSec();
 				if(Event_Call(EVT_ONCONNECT, tmp)) {
 					Clients_List[tmp->id] = tmp;
-					return;
+					// Без поллера клиент никогда не получит данных,
+					// ProcessClient сам доведёт отключение до конца
+					if(!NetBuffer_Register(&tmp->netbuf))
+						NetBuffer_ForceClose(&tmp->netbuf);
+					continue;
 				} else
 					Client_Kick(tmp, Sstor_Get("KICK_REJ"));
 			} else
@@ -166,12 +195,16 @@ static void DoNetTick(void) {
 			 */
 			while(NetBuffer_Process(&tmp->netbuf));
 			Client_Free(tmp);
+			continue;
 		}
 
 		Socket_Close(fd);
 	}
+}
 
-	ProcessClients();
+static cs_bool DoNetTick(void) {
+	AcceptClients();
+	return ProcessClients();
 }
 
 INL static cs_bool Bind(cs_str ip, cs_uint16 port) {
@@ -180,7 +213,8 @@ INL static cs_bool Bind(cs_str ip, cs_uint16 port) {
 	struct sockaddr_in ssa;
 	return Socket_SetAddr(&ssa, ip, port) > 0 &&
 	Socket_SetNonBlocking(Server_Socket, true) &&
-	Socket_Bind(Server_Socket, &ssa);
+	Socket_Bind(Server_Socket, &ssa) && Poll_Init() &&
+	Poll_Add(Server_Socket, POLL_EVENT_READ, NULL);
 }
 
 cs_bool Server_Init(void) {
@@ -239,8 +273,56 @@ cs_bool Server_Init(void) {
 	Config_SetLimit(ent, 1, 5);
 	Config_SetDefaultInt(ent, 5);
 
+	ent = Config_NewEntry(cfg, CFG_SENDLIMIT_KEY, CONFIG_TYPE_INT);
+	Config_SetComment(ent, "Max size of unsent data per client in kilobytes, client will be disconnected if exceeded [64-4096]");
+	Config_SetLimit(ent, 64, NETBUFFER_DEFAULT_LIMIT / 1024);
+	Config_SetDefaultInt(ent, NETBUFFER_DEFAULT_LIMIT / 1024);
+
+	ent = Config_NewEntry(cfg, CFG_SENDLOWAT_KEY, CONFIG_TYPE_INT);
+	Config_SetComment(ent, "Map data is sent to the client only when its unsent data is below this size in kilobytes [4-1024]");
+	Config_SetLimit(ent, 4, 1024);
+	Config_SetDefaultInt(ent, NETBUFFER_DEFAULT_LOWAT / 1024);
+
+	ent = Config_NewEntry(cfg, CFG_VIEWDIST_KEY, CONFIG_TYPE_INT);
+	Config_SetComment(ent, "Players and bots farther than this many blocks are not spawned for the client, 0 means no limit [0-1024]");
+	Config_SetLimit(ent, 0, 1024);
+	Config_SetDefaultInt(ent, 0);
+
+	ent = Config_NewEntry(cfg, CFG_COMPRPOOL_KEY, CONFIG_TYPE_INT);
+	Config_SetComment(ent, "How many idle zlib contexts are kept for reuse by map sends and world saves, 0 disables reuse [0-256]");
+	Config_SetLimit(ent, 0, 256);
+	Config_SetDefaultInt(ent, COMPR_POOL_DEFAULT);
+
+	ent = Config_NewEntry(cfg, CFG_SAVELEVEL_KEY, CONFIG_TYPE_INT);
+	Config_SetComment(ent, "Compression level used for saving worlds to disk [1-9]");
+	Config_SetLimit(ent, COMPR_LEVEL_MIN, COMPR_LEVEL_MAX);
+	Config_SetDefaultInt(ent, COMPR_LEVEL_DEFAULT);
+
+	ent = Config_NewEntry(cfg, CFG_NETLEVEL_KEY, CONFIG_TYPE_INT);
+	Config_SetComment(ent, "Compression level used for maps sent to clients [1-9]");
+	Config_SetLimit(ent, COMPR_LEVEL_MIN, COMPR_LEVEL_MAX);
+	Config_SetDefaultInt(ent, COMPR_LEVEL_DEFAULT);
+
+	ent = Config_NewEntry(cfg, CFG_WORLDFMT_KEY, CONFIG_TYPE_STR);
+	Config_SetComment(ent, "Format used for saving worlds: \"gzip\" - old format, \"zstd\" or \"lz4\" - faster format with parallel loading, falls back to gzip if the library is missing");
+	Config_SetDefaultStr(ent, "zstd");
+
+	ent = Config_NewEntry(cfg, CFG_JOURNAL_KEY, CONFIG_TYPE_BOOL);
+	Config_SetComment(ent, "Log every block change next to the world file, so changes made after the last save survive a server crash");
+	Config_SetDefaultBool(ent, true);
+
+	ent = Config_NewEntry(cfg, CFG_MEMBUDGET_KEY, CONFIG_TYPE_INT);
+	Config_SetComment(ent, "How many megabytes the blocks of all worlds may take, idle worlds are saved and unloaded above it. With \"*\" in worlds-list, blocks are also loaded only when a player joins the world. 0 means no limit [0-1048576]");
+	Config_SetLimit(ent, 0, 1048576);
+	Config_SetDefaultInt(ent, 0);
+
+	ent = Config_NewEntry(cfg, CFG_COLDAFTER_KEY, CONFIG_TYPE_INT);
+	Config_SetComment(ent, "Blocks of a world without players are compressed in memory after this many minutes and expanded again when someone joins it, 0 disables it [0-10080]");
+	Config_SetLimit(ent, 0, 10080);
+	Config_SetDefaultInt(ent, 0);
+
 	ent = Config_NewEntry(cfg, CFG_WORLDS_KEY, CONFIG_TYPE_STR);
-	Config_SetComment(ent, "List of worlds to load at startup (Can be \"*\" it means load all worlds in the folder)");
+	Config_SetComment(ent, "List of worlds to load at startup (Can be \"*\" it means load all worlds in the folder). A world name can end with @hugepages or @file to keep its blocks in huge pages or in a temporary file paged by the OS");
 	Config_SetDefaultStr(ent, "world:256x256x256:normal,flat_world:64x64x64:flat");
 
 	if(!Config_Load(cfg)) {
@@ -266,6 +348,29 @@ cs_bool Server_Init(void) {
 		}
 	}
 	Log_SetLevelStr(Config_GetStrByKey(cfg, CFG_LOGLEVEL_KEY));
+	NetBuffer_SetDefaultLimits(
+		(cs_uint32)Config_GetIntByKey(cfg, CFG_SENDLIMIT_KEY) * 1024,
+		(cs_uint32)Config_GetIntByKey(cfg, CFG_SENDLOWAT_KEY) * 1024
+	);
+	AOI_SetViewDistance((cs_uint16)Config_GetIntByKey(cfg, CFG_VIEWDIST_KEY));
+	ComprPool_SetLimit((cs_uint32)Config_GetIntByKey(cfg, CFG_COMPRPOOL_KEY));
+	Compr_SetLevel(COMPR_USE_SAVE, Config_GetIntByKey(cfg, CFG_SAVELEVEL_KEY));
+	Compr_SetLevel(COMPR_USE_NETWORK, Config_GetIntByKey(cfg, CFG_NETLEVEL_KEY));
+	cs_str format = Config_GetStrByKey(cfg, CFG_WORLDFMT_KEY);
+	if(String_CaselessCompare(format, "zstd"))
+		World_SetSaveCodec(COMPR_CODEC_ZSTD);
+	else if(String_CaselessCompare(format, "lz4"))
+		World_SetSaveCodec(COMPR_CODEC_LZ4);
+	else
+		World_SetSaveCodec(COMPR_CODEC_GZIP);
+	World_SetJournal(Config_GetBoolByKey(cfg, CFG_JOURNAL_KEY));
+	cs_uint64 budget = (cs_uint64)Config_GetIntByKey(cfg, CFG_MEMBUDGET_KEY) * 1024 * 1024;
+	World_SetMemoryBudget(budget);
+	cs_uint64 coldafter = (cs_uint64)Config_GetIntByKey(cfg, CFG_COLDAFTER_KEY) * 60 * 1000;
+	// Без быстрых кодеков холодные миры упаковываются в брики
+	if(coldafter > 0 && !Compr_HasCodec(COMPR_CODEC_LZ4) && !Compr_HasCodec(COMPR_CODEC_ZSTD))
+		Log_Warn(Sstor_Get("SV_COLD_NOCODEC"));
+	World_SetColdAfter(coldafter);
 	Config_Save(Server_Config, false);
 	Command_RegisterDefault();
 	Packet_RegisterDefault();
@@ -284,8 +389,21 @@ cs_bool Server_Init(void) {
 				} else continue;
 
 				World *tmp = World_Create(wname);
-				if(World_Load(tmp)) {
+				// С ограничением памяти блоки миров
+				// загружаются, только когда они нужны
+				if(budget > 0) {
+					if(World_LoadInfo(tmp)) {
+						World_Add(tmp);
+						wIndex++;
+					} else {
+						EWorldExtra extra = WORLD_EXTRA_NOINFO;
+						EWorldError code = World_PopError(tmp, &extra);
+						Log_Error(Sstor_Get("SV_WLOAD_ERR"), "load", World_GetName(tmp), code, extra);
+						World_Free(tmp);
+					}
+				} else if(World_Load(tmp)) {
 					World_Lock(tmp, 0);
+					World_Unlock(tmp);
 					if(World_HasError(tmp)) {
 						EWorldExtra extra = WORLD_EXTRA_NOINFO;
 						EWorldError code = World_PopError(tmp, &extra);
@@ -296,7 +414,6 @@ cs_bool Server_Init(void) {
 						World_Add(tmp);
 						wIndex++;
 					}
-					World_Unlock(tmp);
 				} else World_Free(tmp);
 			} while(Iter_Next(&wIter));
 		}
@@ -326,8 +443,18 @@ cs_bool Server_Init(void) {
 
 				if(state == 0) {
 					skip_creating = false;
+					cs_char *backend = String_FirstChar(buffer, '@');
+					if(backend) *backend++ = '\0';
 					(void)String_TrimExtension(buffer);
 					tmp = World_Create(buffer);
+					if(backend) {
+						if(String_CaselessCompare(backend, "hugepages"))
+							World_SetBackend(tmp, WORLD_BACKEND_HUGEPAGES);
+						else if(String_CaselessCompare(backend, "file"))
+							World_SetBackend(tmp, WORLD_BACKEND_FILE);
+						else if(!String_CaselessCompare(backend, "heap"))
+							Log_Error(Sstor_Get("WGEN_NOBACKEND"), backend, tmp->name);
+					}
 					if(World_Load(tmp)) {
 						World_Lock(tmp, 0);
 						if(World_HasError(tmp)) {
@@ -337,7 +464,9 @@ cs_bool Server_Init(void) {
 								skip_creating = true;
 								Log_Error(Sstor_Get("SV_WLOAD_ERR"), "load", World_GetName(tmp), code, extra);
 								World_FreeBlockArray(tmp);
+								World_Unlock(tmp);
 								World_Free(tmp);
+								tmp = NULL;
 							}
 						} else {
 							if(World_IsReadyToPlay(tmp)) {
@@ -346,7 +475,7 @@ cs_bool Server_Init(void) {
 								wIndex++;
 							}
 						}
-						World_Unlock(tmp);
+						if(tmp) World_Unlock(tmp);
 					}
 				} else if(!skip_creating && state == 1) {
 					cs_char *del = buffer, *prev = buffer;
@@ -412,36 +541,58 @@ cs_bool Server_Init(void) {
 	return false;
 }
 
-cs_uint64 prev, this = 0;
-
 INL static void DoStep(cs_int32 delta) {
-	DoNetTick();
 	Timer_Update(delta);
 	Event_Call(EVT_ONTICK, &delta);
+	// Изменённые за тик блоки рассылаются пачкой
+	Worlds_FlushBlockUpdates();
+	Worlds_CheckResidency();
+	// Передвижения за тик рассылаются одним пакетом на сущность
+	Clients_SendMovement();
+}
+
+INL static cs_int32 GetWaitTime(cs_bool idle, cs_int32 elapsed) {
+	cs_int32 wait = TICKS_PER_SECOND - elapsed;
+
+	// Пока на сервере нет клиентов, будить его имеет
+	// смысл только ради таймеров, но не реже, чем раз
+	// в SERVER_IDLE_WAIT мс, чтобы вовремя заметить
+	// остановку сервера из другого потока
+	if(idle) {
+		cs_int32 delay = Timer_GetNextDelay();
+		if(delay == -1 || delay > SERVER_IDLE_WAIT)
+			delay = SERVER_IDLE_WAIT;
+		wait = max(wait, delay - elapsed);
+	}
+
+	return max(wait, 0);
 }
 
 void Server_StartLoop(void) {
 	if(!Server_Active) return;
-	cs_uint64 start = Time_GetMSec(), end;
-	cs_int32 delta = 0;
+	cs_uint64 last = Time_GetMSec(), curr;
+	cs_bool idle = false;
 
 	while(Server_Active) {
-		end = start;
-		start = Time_GetMSec();
-		delta = (cs_int32)(start - end);
-		DoStep(delta);
+		curr = Time_GetMSec();
+		WaitEvents(GetWaitTime(idle, curr < last ? 0 : (cs_int32)(curr - last)));
+		idle = DoNetTick();
 
-		if(start < end) {
+		curr = Time_GetMSec();
+		if(curr < last) {
 			Log_Warn(Sstor_Get("SV_BADTICK_BW"));
-			delta = 0;
-			continue;
-		} else if(delta > 500) {
-			Log_Warn(Sstor_Get("SV_BADTICK"), delta);
-			delta = 500;
+			last = curr;
 			continue;
 		}
 
-		Thread_Sleep(TICKS_PER_SECOND);
+		cs_int32 delta = (cs_int32)(curr - last);
+		if(delta >= TICKS_PER_SECOND) {
+			DoStep(delta);
+			last = curr;
+			delta = (cs_int32)(Time_GetMSec() - curr);
+			if(delta > 500)
+				Log_Warn(Sstor_Get("SV_BADTICK"), delta);
+		}
 	}
 
 	Event_Call(EVT_ONSTOP, NULL);
@@ -520,9 +671,11 @@ void Server_Cleanup(void) {
 	ConsoleIO_Uninit();
 	Log_Info(Sstor_Get("SV_STOP_PL"));
 	KickAll(Sstor_Get("KICK_STOP"));
-	while(!ProcessClients());
+	while(!ProcessClients())
+		WaitEvents(TICKS_PER_SECOND);
 	Log_Info(Sstor_Get("SV_STOP_SW"));
 	UnloadAllWorlds();
+	Poll_Uninit();
 	Socket_Close(Server_Socket);
 	Log_Info(Sstor_Get("SV_STOP_SC"));
 	Config_Save(Server_Config, false);
@@ -15,6 +15,16 @@
 #define CFG_MAXPLAYERS_KEY "max-players"
 #define CFG_CONN_KEY "max-connections-per-ip"
 #define CFG_WORLDS_KEY "worlds-list"
+#define CFG_SENDLIMIT_KEY "client-send-limit"
+#define CFG_SENDLOWAT_KEY "client-send-lowat"
+#define CFG_VIEWDIST_KEY "entity-view-distance"
+#define CFG_COMPRPOOL_KEY "compressor-pool-size"
+#define CFG_SAVELEVEL_KEY "save-compression-level"
+#define CFG_NETLEVEL_KEY "network-compression-level"
+#define CFG_WORLDFMT_KEY "world-format"
+#define CFG_JOURNAL_KEY "world-journal"
+#define CFG_MEMBUDGET_KEY "world-memory-budget"
+#define CFG_COLDAFTER_KEY "world-cold-after"
 
 VAR cs_bool Server_Active, Server_Ready;
 VAR CStore *Server_Config;
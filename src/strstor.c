@@ -60,6 +60,8 @@ cs_bool Sstor_Defaults(void) {
 	Sstor_Set("WGEN_ERROR", "Oh! Error happened in the world generator for \"%s\"");
 	Sstor_Set("WGEN_INVDIM", "Invalid dimensions specified for \"%s\"");
 	Sstor_Set("WGEN_NOGEN", "Invalid generator specified for \"%s\"");
+	Sstor_Set("WGEN_NOBACKEND", "Unknown block storage \"%s\" specified for \"%s\", using heap");
+	Sstor_Set("WJ_BROKEN", "Failed to write block journal of world \"%s\", it will be restarted by the next save");
 
 	Sstor_Set("SV_START", "Server started on %s:%d");
 	Sstor_Set("SV_BIND_FAIL", "Failed to bind %s:%d");
@@ -73,6 +75,7 @@ cs_bool Sstor_Defaults(void) {
 	Sstor_Set("SV_STOPNOTE", "Press Ctrl+C to stop the server");
 	Sstor_Set("SV_BADTICK_BW", "Time ran backwards? Time between the last two ticks < 0ms");
 	Sstor_Set("SV_BADTICK", "Last server tick took %dms!");
+	Sstor_Set("SV_COLD_NOCODEC", "Neither LZ4 nor zstd library found, idle worlds will be packed into bricks instead");
 	Sstor_Set("SV_STOP_PL", "Kicking players...");
 	Sstor_Set("SV_STOP_SW", "Saving worlds...");
 	Sstor_Set("SV_STOP_SC", "Saving server config...");
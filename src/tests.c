@@ -1,12 +1,16 @@
 #include "core.h"
 #include "log.h"
 #include "tests.h"
+#include "strstor.h"
 
 #include "tests/memory.c"
 #include "tests/strings.c"
 #include "tests/client.c"
 #include "tests/world.c"
 #include "tests/config.c"
+#include "tests/netbuffer.c"
+#include "tests/aoi.c"
+#include "tests/compr.c"
 
 cs_uint16 Tests_CurrNum = 0;
 cs_str Tests_Current = NULL;
@@ -16,9 +20,16 @@ void Tests_NewTask(cs_str name) {
 }
 
 cs_bool Tests_PerformAll(void) {
-	return Tests_Memory() &&
+	// Ядро пишет в лог строки из хранилища
+	if(!Sstor_Defaults()) return false;
+	cs_bool ok = Tests_Memory() &&
 	Tests_Strings() &&
 	Tests_Client() &&
 	Tests_World() &&
-	Tests_Config();
+	Tests_Config() &&
+	Tests_NetBuffer() &&
+	Tests_AOI() &&
+	Tests_Compr();
+	Sstor_Cleanup();
+	return ok;
 }
@@ -0,0 +1,56 @@
+#include "core.h"
+#include "platform.h"
+#include "aoi.h"
+#include "tests.h"
+
+INL static cs_bool HasEntity(ClientID *ids, cs_uint32 count, ClientID id) {
+	for(cs_uint32 i = 0; i < count; i++)
+		if(ids[i] == id) return true;
+	return false;
+}
+
+cs_bool Tests_AOI(void) {
+	Tests_NewTask("Query entity grid");
+	AOIGrid *grid = Memory_TryAlloc(1, sizeof(AOIGrid));
+	Tests_Assert(grid != NULL, "allocate grid");
+	AOI_SetViewDistance(16);
+	ClientID ids[MAX_CLIENTS];
+	Vec origin = {0.0f, 0.0f, 0.0f}, near = {-15.0f, 64.0f, 3.0f},
+	far = {200.0f, 0.0f, -200.0f};
+	AOI_Update(grid, 0, &near);
+	AOI_Update(grid, 1, &far);
+	AOI_Update(grid, 2, &origin);
+	cs_uint32 count = AOI_Query(grid, &origin, ids);
+	Tests_Assert(HasEntity(ids, count, 0) && HasEntity(ids, count, 2), "find near entities");
+	Tests_Assert(AOI_InRange(&origin, &near, false), "check view distance");
+	Tests_Assert(!AOI_InRange(&origin, &far, true), "check far entity");
+	AOI_Update(grid, 0, &far);
+	count = AOI_Query(grid, &far, ids);
+	Tests_Assert(HasEntity(ids, count, 0) && HasEntity(ids, count, 1), "move entity between cells");
+	AOI_Remove(grid, 0);
+	AOI_Remove(grid, 1);
+	count = AOI_Query(grid, &far, ids);
+	Tests_Assert(!HasEntity(ids, count, 0) && !HasEntity(ids, count, 1), "remove entities");
+
+	Tests_NewTask("Query cells with negative coordinates");
+	// Ячейка здесь 24 блока: 16 блоков дальности и запас,
+	// сущность ровно на границе ячейки ещё остаётся видимой
+	Vec edge = {-24.0f, 0.0f, 0.0f};
+	AOI_Update(grid, 0, &edge);
+	count = AOI_Query(grid, &origin, ids);
+	Tests_Assert(AOI_InRange(&origin, &edge, true), "keep entity on cell border");
+	Tests_Assert(HasEntity(ids, count, 0), "find entity across negative cell border");
+	count = AOI_Query(grid, &edge, ids);
+	Tests_Assert(HasEntity(ids, count, 2), "find entity from negative cell border");
+	AOI_Remove(grid, 0);
+	AOI_Remove(grid, 2);
+
+	Tests_NewTask("Check view hysteresis");
+	Vec border = {16.0f + AOI_HYSTERESIS / 2, 0.0f, 0.0f};
+	Tests_Assert(!AOI_InRange(&origin, &border, false), "do not spawn beyond distance");
+	Tests_Assert(AOI_InRange(&origin, &border, true), "keep visible entity");
+	AOI_SetViewDistance(0);
+	Tests_Assert(AOI_InRange(&origin, &far, false), "unlimited distance");
+	Memory_Free(grid);
+	return true;
+}
@@ -0,0 +1,87 @@
+#include "core.h"
+#include "tests.h"
+#include "compr.h"
+
+static void TestTransform(void *arg, cs_uint32 offset, const cs_byte *src, cs_byte *dst, cs_uint32 size) {
+	(void)arg; (void)offset;
+	for(cs_uint32 i = 0; i < size; i++)
+		dst[i] = src[i] ^ 0x5A;
+}
+
+cs_bool Tests_Compr(void) {
+	Tests_NewTask("Reuse pooled compressor");
+	Compr ctx = {0};
+	ComprPoolStats before, after;
+	Tests_Assert(Compr_Init(&ctx, COMPR_TYPE_GZIP), "init compressor");
+	Compr_Reset(&ctx);
+	Tests_Assert(ctx.stream == NULL, "check context release");
+	ComprPool_GetStats(&before);
+	Tests_Assert(before.idle > 0, "check idle context");
+	Tests_Assert(Compr_Init(&ctx, COMPR_TYPE_GZIP), "init compressor again");
+	ComprPool_GetStats(&after);
+	Tests_Assert(after.hits == before.hits + 1, "check pool hit");
+
+	Tests_NewTask("Compress with reused context");
+	cs_byte in[4096], out[8192], back[4096];
+	for(cs_uint32 i = 0; i < sizeof(in); i++) in[i] = (cs_byte)(i % 7);
+	Compr_SetInBuffer(&ctx, in, sizeof(in));
+	Compr_SetOutBuffer(&ctx, out, sizeof(out));
+	cs_uint32 size = 0;
+	do {
+		Tests_Assert(Compr_Update(&ctx), "compress data");
+		size += Compr_GetWrittenSize(&ctx);
+		Compr_SetOutBuffer(&ctx, out + size, sizeof(out) - size);
+	} while(!Compr_IsInState(&ctx, COMPR_STATE_DONE));
+	Compr_Reset(&ctx);
+
+	Tests_Assert(Compr_Init(&ctx, COMPR_TYPE_UNGZIP), "init decompressor");
+	Compr_SetInBuffer(&ctx, out, size);
+	Compr_SetOutBuffer(&ctx, back, sizeof(back));
+	Tests_Assert(Compr_Update(&ctx), "decompress data");
+	Tests_Assert(Compr_GetWrittenSize(&ctx) == sizeof(in), "check decompressed size");
+	Tests_Assert(Memory_Compare(in, back, sizeof(in)), "check decompressed data");
+	Compr_Reset(&ctx);
+
+	Tests_NewTask("Compress whole buffer");
+	Tests_Assert(Compr_Bound(sizeof(in)) <= sizeof(out), "check output bound");
+	size = Compr_Whole(COMPR_TYPE_GZIP, COMPR_LEVEL_MAX, in, sizeof(in), out, sizeof(out));
+	Tests_Assert(size > 0, "compress data");
+	Tests_Assert(Compr_Init(&ctx, COMPR_TYPE_UNGZIP), "init decompressor");
+	Compr_SetInBuffer(&ctx, out, size);
+	Compr_SetOutBuffer(&ctx, back, sizeof(back));
+	Tests_Assert(Compr_Update(&ctx), "decompress data");
+	Tests_Assert(Compr_GetWrittenSize(&ctx) == sizeof(in), "check decompressed size");
+	Tests_Assert(Memory_Compare(in, back, sizeof(in)), "check decompressed data");
+	Compr_Reset(&ctx);
+
+	Tests_NewTask("Compress in parallel");
+	cs_uint32 bigsize = COMPR_PARALLEL_BLOCK * 3 + 12345,
+	bigbound = Compr_Bound(bigsize);
+	cs_byte *big = Memory_Alloc(1, bigsize),
+	*bigout = Memory_Alloc(1, bigbound),
+	*bigback = Memory_Alloc(1, bigsize);
+	for(cs_uint32 i = 0; i < bigsize; i++)
+		big[i] = (cs_byte)((i / 3) % 251);
+	size = Compr_Parallel(COMPR_TYPE_GZIP, COMPR_LEVEL_DEFAULT, big, bigsize, bigout, bigbound, TestTransform, NULL);
+	Tests_Assert(size > 0, "compress data");
+	Tests_Assert(Compr_Init(&ctx, COMPR_TYPE_UNGZIP), "init decompressor");
+	Compr_SetInBuffer(&ctx, bigout, size);
+	cs_uint32 total = 0;
+	do {
+		Compr_SetOutBuffer(&ctx, bigback + total, bigsize - total);
+		Tests_Assert(Compr_Update(&ctx), "decompress data");
+		total += Compr_GetWrittenSize(&ctx);
+	} while(Compr_GetWrittenSize(&ctx) > 0 && total < bigsize);
+	Tests_Assert(total == bigsize, "check decompressed size");
+	cs_bool same = true;
+	for(cs_uint32 i = 0; i < bigsize && same; i++)
+		same = bigback[i] == (big[i] ^ 0x5A);
+	Tests_Assert(same, "check decompressed data");
+	Compr_Reset(&ctx);
+	Compr_Cleanup(&ctx);
+	Memory_Free(big);
+	Memory_Free(bigout);
+	Memory_Free(bigback);
+
+	return true;
+}
@@ -0,0 +1,68 @@
+#include "core.h"
+#include "platform.h"
+#include "netbuffer.h"
+#include "websock.h"
+#include "tests.h"
+
+cs_bool Tests_NetBuffer(void) {
+	Tests_NewTask("Fill network buffer");
+	NetBuffer *nb = Memory_TryAlloc(1, sizeof(NetBuffer));
+	Tests_Assert(nb != NULL, "allocate network buffer");
+	NetBuffer_Init(nb, INVALID_SOCKET);
+	nb->write.limit = NETBUFFER_PAGE_SIZE * 4;
+	cs_uint32 written = 0;
+	cs_char *data;
+	while((data = NetBuffer_StartWrite(nb, 1000)) != NULL) {
+		Memory_Fill(data, 1000, (cs_byte)written);
+		Tests_Assert(NetBuffer_EndWrite(nb, 1000), "commit written data");
+		written += 1000;
+	}
+	Tests_Assert(written == (NETBUFFER_PAGE_SIZE * 4 / 1000) * 1000, "check buffer limit");
+	Tests_Assert(NetBuffer_AvailWrite(nb) == written, "check queued data size");
+	Tests_Assert(nb->write.count == 5, "check page count");
+
+	Tests_NewTask("Write oversized packet");
+	nb->write.limit = NETBUFFER_PAGE_SIZE * 8;
+	Tests_Assert((data = NetBuffer_StartWrite(nb, NETBUFFER_PAGE_SIZE * 2)) != NULL, "start big write");
+	Tests_Assert(NetBuffer_EndWrite(nb, NETBUFFER_PAGE_SIZE * 2), "commit big write");
+	Tests_Assert(!NetBuffer_EndWrite(nb, 1), "commit beyond the page");
+
+	Tests_NewTask("Append shared page");
+	NetPage *page = NetPool_Alloc(NETBUFFER_PAGE_SIZE);
+	Tests_Assert(page != NULL, "allocate shared page");
+	Memory_Fill(page->data, NETBUFFER_SHARE_MIN * 2, 0x55);
+	page->used = NETBUFFER_SHARE_MIN * 2;
+	cs_uint32 count = nb->write.count, queued = NetBuffer_AvailWrite(nb);
+	Tests_Assert(NetBuffer_AppendShared(nb, page, 0, 8), "copy small packet");
+	Tests_Assert(nb->write.count == count + 1 && page->refs == 1, "check copied packet");
+	Tests_Assert(NetBuffer_AppendShared(nb, page, 0, NETBUFFER_SHARE_MIN * 2), "attach big packet");
+	Tests_Assert(nb->write.count == count + 2 && page->refs == 2, "check attached page");
+	Tests_Assert(NetBuffer_AvailWrite(nb) == queued + 8 + NETBUFFER_SHARE_MIN * 2, "check queued data size");
+	Tests_Assert(NetBuffer_StartWrite(nb, 1) != page->data + page->used, "keep shared page intact");
+	NetPool_Release(page);
+
+	Tests_NewTask("Unmask websocket payload");
+	cs_char wsmask[4] = {0x12, 0x34, 0x56, 0x78}, payload[77];
+	cs_uint32 wskernels[] = {0, CPU_FEATURE_AVX2, CPU_FEATURE_NEON};
+	for(cs_uint32 k = 0; k < 3; k++) {
+		if(wskernels[k] && (CPU_GetFeatures() & wskernels[k]) == 0) continue;
+		WebSock_Bind(wskernels[k]);
+		for(cs_uint32 i = 0; i < 77; i++) payload[i] = (cs_char)(i ^ wsmask[i % 4]);
+		WebSock_Unmask(payload, 77, wsmask);
+		cs_bool unmasked = true;
+		for(cs_uint32 i = 0; i < 77; i++) unmasked &= payload[i] == (cs_char)i;
+		Tests_Assert(unmasked, "check unmasked payload");
+		// Данные фрейма в буфере не выровнены
+		for(cs_uint32 i = 0; i < 76; i++) payload[i + 1] = (cs_char)(i ^ wsmask[i % 4]);
+		WebSock_Unmask(payload + 1, 76, wsmask);
+		unmasked = true;
+		for(cs_uint32 i = 0; i < 76; i++) unmasked &= payload[i + 1] == (cs_char)i;
+		Tests_Assert(unmasked, "check unaligned unmasked payload");
+	}
+	WebSock_Bind(CPU_GetFeatures());
+
+	NetBuffer_ForceClose(nb);
+	Tests_Assert(NetBuffer_AvailWrite(nb) == 0, "check released buffer");
+	Memory_Free(nb);
+	return true;
+}
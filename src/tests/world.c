@@ -1,9 +1,14 @@
 #include "core.h"
 #include "str.h"
+#include "platform.h"
 #include "tests.h"
 #include "block.h"
 #include "vector.h"
 #include "world.h"
+#include "compr.h"
+#include "bricks.h"
+#include "remap.h"
+#include "mapcache.h"
 
 #define COMPARE_COLORS(c1, c2) ((c1).r == (c2).r || (c1).g == (c2).g || (c1).b == (c2).b)
 
@@ -95,7 +100,334 @@ cs_bool Tests_World(void) {
 	Tests_Assert(World_GetBlock(world, &p2) == BLOCK_LOG, "check second block");
 	Tests_Assert(World_GetBlockO(world, wsize - 1) == BLOCK_WATER_STILL, "check third block by offset");
 	Tests_Assert(World_GetBlockO(world, wsize) == (BlockID)-1, "check block outside world");
+
+	Tests_NewTask("Save world in framed format");
+	SVec p4 = {.x = 3, .y = 40, .z = 900};
+	for(ComprCodec codec = COMPR_CODEC_ZSTD; codec < COMPR_CODEC_COUNT; codec++) {
+		if(!Compr_HasCodec(codec)) continue;
+		World_SetSaveCodec(codec);
+		Tests_Assert(World_SetBlock(world, &p1, BLOCK_STONE + codec), "change first block");
+		Tests_Assert(World_Save(world), "save world");
+		World_Lock(world, 0);
+		World_Unlock(world);
+		Tests_Assert(!World_HasError(world), "check save status");
+		cs_uint64 fileend = world->regions.end;
+		Tests_Assert(World_SetBlock(world, &p4, BLOCK_GOLD + codec), "change block in one region");
+		Tests_Assert(World_Save(world), "save changed region");
+		World_Lock(world, 0);
+		World_Unlock(world);
+		Tests_Assert(!World_HasError(world), "check region save status");
+		Tests_Assert(world->regions.end > fileend && world->regions.end - fileend < fileend, "check region append");
+		World_Free(world);
+		world = World_Create(worldname);
+		Tests_Assert(World_Load(world), "load world");
+		World_Lock(world, 0);
+		World_Unlock(world);
+		Tests_Assert(!World_HasError(world), "check load status");
+		Tests_Assert(World_GetBlock(world, &p1) == BLOCK_STONE + codec, "check first block");
+		Tests_Assert(World_GetBlock(world, &p2) == BLOCK_LOG, "check second block");
+		Tests_Assert(World_GetBlockO(world, wsize - 1) == BLOCK_WATER_STILL, "check last block");
+		Tests_Assert(World_GetBlock(world, &p4) == BLOCK_GOLD + codec, "check changed region");
+	}
+	World_SetSaveCodec(COMPR_CODEC_GZIP);
+	World *oldworld = World_Create("__oldfmt");
+	cs_file oldfp = File_Open("worlds" PATH_DELIM "__oldfmt.cws", "wb");
+	cs_uint32 oldmagic = WORLD_MAGIC_V2;
+	EWorldExtra oldextra = WORLD_EXTRA_NOINFO;
+	Tests_Assert(oldfp != NULL, "create old framed file");
+	Tests_Assert(File_Write(&oldmagic, 4, 1, oldfp) == 1, "write old framed header");
+	File_Close(oldfp);
+	Tests_Assert(!World_LoadInfo(oldworld), "reject old framed format");
+	Tests_Assert(World_PopError(oldworld, &oldextra) == WORLD_ERROR_INFOREAD &&
+		oldextra == WORLD_EXTRA_UNKNOWN_VERSION, "check old format error");
+	Tests_Assert(World_Load(oldworld), "start loading old framed file");
+	World_Lock(oldworld, 0);
+	World_Unlock(oldworld);
+	oldextra = WORLD_EXTRA_NOINFO;
+	Tests_Assert(World_PopError(oldworld, &oldextra) == WORLD_ERROR_INFOREAD &&
+		oldextra == WORLD_EXTRA_UNKNOWN_VERSION, "check old format load error");
+	World_Free(oldworld);
+
+	Tests_NewTask("Reject truncated world");
+	World *cutworld = World_Create("__truncated");
+	SVec cutdims = {64, 64, 64}, cutpos = {1, 2, 3};
+	World_SetDimensions(cutworld, &cutdims);
+	World_AllocBlockArray(cutworld);
+	for(cs_int16 y = 0; y < cutdims.y; y += 2) {
+		cutpos.y = y;
+		Tests_Assert(World_SetBlock(cutworld, &cutpos, BLOCK_LOG), "fill world to truncate");
+	}
+	Tests_Assert(World_Save(cutworld), "save world to truncate");
+	World_Lock(cutworld, 0);
+	World_Unlock(cutworld);
+	Tests_Assert(!World_HasError(cutworld), "check truncated world save");
+	World_Free(cutworld);
+	cs_byte cutbuf[4096];
+	cs_file cutfp = File_Open("worlds" PATH_DELIM "__truncated.cws", "rb");
+	Tests_Assert(cutfp != NULL, "open saved world");
+	cs_size cutsize = File_Read(cutbuf, 1, sizeof(cutbuf), cutfp);
+	File_Close(cutfp);
+	Tests_Assert(cutsize > 0 && cutsize < sizeof(cutbuf), "read saved world");
+	cutfp = File_Open("worlds" PATH_DELIM "__truncated.cws", "wb");
+	Tests_Assert(cutfp != NULL && File_Write(cutbuf, 1, cutsize - 8, cutfp) == cutsize - 8, "truncate saved world");
+	File_Close(cutfp);
+	cutworld = World_Create("__truncated");
+	Tests_Assert(World_Load(cutworld), "start loading truncated world");
+	World_Lock(cutworld, 0);
+	World_Unlock(cutworld);
+	Tests_Assert(World_PopError(cutworld, NULL) != WORLD_ERROR_SUCCESS, "check truncated world error");
+	Tests_Assert(!World_IsReadyToPlay(cutworld) && World_GetMemoryUsage(cutworld) == 0, "check truncated world blocks freed");
+	World_Free(cutworld);
+
+	Tests_NewTask("Replay block journal");
+	SVec p5 = {.x = 7, .y = 7, .z = 7};
+	World_SetJournal(true);
+	// Журнал привязывается к файлу мира при его загрузке
+	World_Free(world);
+	world = World_Create(worldname);
+	Tests_Assert(World_Load(world), "load world");
+	World_Lock(world, 0);
+	World_Unlock(world);
+	Tests_Assert(World_SetBlock(world, &p5, BLOCK_GLASS), "change block");
+	World_FlushJournal(world);
+	Tests_Assert(world->journal.written > 0, "check journal write");
+	World_Free(world);
+	world = World_Create(worldname);
+	Tests_Assert(World_Load(world), "load world");
+	World_Lock(world, 0);
+	World_Unlock(world);
+	Tests_Assert(World_GetBlock(world, &p5) == BLOCK_GLASS, "check replayed block");
+	Tests_Assert(World_IsModified(world), "check replayed world is modified");
+	Tests_Assert(World_Save(world), "save world");
+	World_Lock(world, 0);
+	World_Unlock(world);
+	Tests_Assert(world->journal.written == sizeof(cs_uint32) * 2 + sizeof(cs_uint64), "check journal trim");
+	World *jworld = World_Create("__journal");
+	SVec jdims = {64, 64, 64};
+	World_SetDimensions(jworld, &jdims);
+	World_AllocBlockArray(jworld);
+	Tests_Assert(World_SetBlock(jworld, &p5, BLOCK_GLASS), "change journaled block");
+	World_FlushJournal(jworld);
+	World_Free(jworld);
+	// Мир того же размера создан заново, старый журнал к нему не относится
+	World_SetJournal(false);
+	jworld = World_Create("__journal");
+	World_SetDimensions(jworld, &jdims);
+	World_AllocBlockArray(jworld);
+	Tests_Assert(World_SetBlock(jworld, &p1, BLOCK_STONE), "change recreated world");
+	Tests_Assert(World_Save(jworld), "save recreated world");
+	World_Lock(jworld, 0);
+	World_Unlock(jworld);
+	World_Free(jworld);
+	World_SetJournal(true);
+	jworld = World_Create("__journal");
+	Tests_Assert(World_Load(jworld), "load recreated world");
+	World_Lock(jworld, 0);
+	World_Unlock(jworld);
+	Tests_Assert(World_GetBlock(jworld, &p1) == BLOCK_STONE, "check recreated world block");
+	Tests_Assert(World_GetBlock(jworld, &p5) == BLOCK_AIR, "ignore stale journal");
+	// Каталог на месте журнала не даст его записать
+	cs_str jpath = "worlds" PATH_DELIM "__journal.cwj", jaside = "worlds" PATH_DELIM "__journal.cwjdir";
+	File_Rename(jpath, "worlds" PATH_DELIM "__journal.cwjold");
+	Tests_Assert(Directory_Create(jpath), "block journal file");
+	for(cs_uint32 i = 0; i <= 4096; i++)
+		World_SetBlockO(jworld, i, BLOCK_LOG);
+	Tests_Assert(jworld->journal.broken && jworld->journal.used == 0, "check broken journal");
+	Tests_Assert(World_SetBlockO(jworld, 5000, BLOCK_LOG) && jworld->journal.used == 0, "check broken journal stops");
+	Tests_Assert(File_Rename(jpath, jaside), "unblock journal file");
+	Tests_Assert(World_Save(jworld), "save world with broken journal");
+	World_Lock(jworld, 0);
+	World_Unlock(jworld);
+	Tests_Assert(!jworld->journal.broken && jworld->journal.base != 0, "check journal restarted");
+	Tests_Assert(World_SetBlock(jworld, &p5, BLOCK_GLASS), "change block after restart");
+	World_FlushJournal(jworld);
+	World_Free(jworld);
+	jworld = World_Create("__journal");
+	Tests_Assert(World_Load(jworld), "load world with restarted journal");
+	World_Lock(jworld, 0);
+	World_Unlock(jworld);
+	Tests_Assert(World_GetBlock(jworld, &p5) == BLOCK_GLASS, "check block from restarted journal");
+	Tests_Assert(World_GetBlockO(jworld, 5000) == BLOCK_LOG, "check block saved with broken journal");
+	World_Free(jworld);
+	World_SetJournal(false);
+
+	Tests_NewTask("Read world snapshot");
+	BlockID snapblock = 0;
+	WorldSnapshot *snap = World_TakeSnapshot(world);
+	Tests_Assert(snap != NULL, "take snapshot");
+	Tests_Assert(World_TakeSnapshot(world) == snap, "reuse unchanged snapshot");
+	World_ReleaseSnapshot(snap);
+	Tests_Assert(World_SetBlock(world, &p5, BLOCK_STONE), "change block");
+	cs_uint32 o5 = World_GetOffset(world, &p5);
+	Tests_Assert(World_ReadSnapshot(snap, o5, &snapblock, 1) == 1, "read snapshot");
+	Tests_Assert(snapblock == BLOCK_GLASS, "check snapshot block");
+	Tests_Assert(World_GetBlock(world, &p5) == BLOCK_STONE, "check live block");
+	Tests_Assert(World_ReadSnapshot(snap, wsize, &snapblock, 1) == 0, "read outside snapshot");
+	World_ReleaseSnapshot(snap);
+
+	Tests_NewTask("Pack blocks into bricks");
+	BlockID bflat[20 * 17 * 19], bcheck[20 * 17 * 19];
+	SVec bdims = {20, 17, 19};
+	BrickStore bstore = {0};
+	for(cs_uint32 i = 0; i < sizeof(bflat); i++)
+		bflat[i] = (BlockID)(i < 20 * 19 * 16 ? i % 40 : BLOCK_AIR);
+	Tests_Assert(Bricks_Pack(&bstore, &bdims, bflat), "pack blocks");
+	Bricks_Flatten(&bstore, bcheck);
+	Tests_Assert(Memory_Compare(bflat, bcheck, sizeof(bflat)), "check flattened blocks");
+	for(cs_uint32 i = 0; i < sizeof(bflat); i += 7) {
+		bflat[i] = (BlockID)(i % 23);
+		Tests_Assert(Bricks_Set(&bstore, i, bflat[i]), "set packed block");
+	}
+	Tests_Assert(Bricks_Get(&bstore, 20 * 19 * 16 + 1) == BLOCK_AIR, "check uniform brick");
+	Bricks_Flatten(&bstore, bcheck);
+	Tests_Assert(Memory_Compare(bflat, bcheck, sizeof(bflat)), "check changed blocks");
+	Bricks_Free(&bstore);
+	Tests_Assert(World_PackBlocks(world), "pack world");
+	Tests_Assert(World_IsPacked(world) && !World_IsReadyToPlay(world), "check packed world");
+	Tests_Assert(world->bricks.memory < wsize / 16, "check packed world size");
+	Tests_Assert(World_GetBlock(world, &p5) == BLOCK_STONE, "check packed block");
+	Tests_Assert(World_SetBlock(world, &p5, BLOCK_GOLD), "change packed block");
+	Tests_Assert(World_GetBlockArray(world, NULL) == NULL && World_IsPacked(world), "check getter keeps world packed");
+	Tests_Assert(World_Load(world), "unpack world");
+	Tests_Assert(World_IsReadyToPlay(world), "check unpacked world");
+	Tests_Assert(World_GetBlock(world, &p5) == BLOCK_GOLD, "check unpacked block");
+	Tests_Assert(World_GetBlockO(world, wsize - 1) == BLOCK_WATER_STILL, "check last block");
+
+	Tests_NewTask("Compress world in memory");
+	Tests_Assert(World_CompressBlocks(world), "compress world");
+	Tests_Assert(World_IsPacked(world), "check compressed world");
+	Tests_Assert(World_GetMemoryUsage(world) < wsize / 8, "check compressed world size");
+	Tests_Assert(World_GetBlock(world, &p5) == BLOCK_GOLD, "check compressed block");
+	Tests_Assert(World_IsPacked(world), "check read keeps world compressed");
+	Tests_Assert(World_SetBlockO(world, wsize - 1, BLOCK_LAVA), "change compressed block");
+	Tests_Assert(World_GetBlock(world, &p5) == BLOCK_GOLD, "check block in another region");
+	Tests_Assert(World_GetBlockO(world, wsize - 1) == BLOCK_LAVA, "check recompressed block");
+	// Попеременная запись в два региона не должна раздувать буфер
+	for(cs_uint32 i = 0; i < 512; i++)
+		World_SetBlockO(world, (i & 1) ? wsize - 2 - i * 97 : i * 97 + 7, (BlockID)(1 + i % 40));
+	Tests_Assert(World_GetBlockO(world, 510 * 97 + 7) == (BlockID)(1 + 510 % 40) &&
+		World_GetBlockO(world, wsize - 2 - 511 * 97) == (BlockID)(1 + 511 % 40), "check blocks in alternating regions");
+	Tests_Assert(world->cold.size - world->cold.live <= world->cold.live, "check cold buffer holes");
+	Tests_Assert(World_SetBlockO(world, wsize - 1, BLOCK_WATER_STILL), "change compressed block back");
+	Tests_Assert(World_IsPacked(world), "check write keeps world compressed");
+	Tests_Assert(World_Load(world), "expand world");
+	Tests_Assert(World_GetBlock(world, &p5) == BLOCK_GOLD, "check block after expanding");
+	Tests_Assert(World_GetBlockO(world, wsize - 1) == BLOCK_WATER_STILL, "check last block");
+
+	Tests_NewTask("Load world info only");
+	World *infoworld = World_Create(worldname);
+	SVec infodims = {0, 0, 0};
+	Tests_Assert(World_LoadInfo(infoworld), "load world info");
+	World_GetDimensions(infoworld, &infodims);
+	Tests_Assert(infodims.x == dims.x && infodims.y == dims.y && infodims.z == dims.z, "check world dimensions");
+	Tests_Assert(World_GetMemoryUsage(infoworld) == 0, "check unloaded world memory");
+	Tests_Assert(World_GetMemoryUsage(world) == (cs_uint64)wsize + 4, "check loaded world memory");
+	World_Free(infoworld);
+
+	Tests_NewTask("Clone world from template");
+	World *inst = World_CloneFrom(world, "instance");
+	Tests_Assert(inst != NULL, "clone world");
+	Tests_Assert(World_IsReadyToPlay(inst) && World_IsInMemory(inst), "check instance state");
+	Tests_Assert(World_GetMemoryUsage(inst) == 0, "check unmodified instance memory");
+	Tests_Assert(World_GetBlock(inst, &p5) == BLOCK_GOLD, "check instance block");
+	Tests_Assert(World_SetBlock(inst, &p5, BLOCK_AIR), "modify instance");
+	Tests_Assert(World_GetBlock(world, &p5) == BLOCK_GOLD, "check template block");
+	MemoryImage img = world->image.handle;
+	World *inst2 = World_CloneFrom(world, "instance2");
+	Tests_Assert(inst2 != NULL && world->image.handle == img, "reuse image of unchanged template");
+	Tests_Assert(World_SetBlock(world, &p5, BLOCK_STONE), "modify template");
+	Tests_Assert(world->image.version != world->wdata.version, "check template edit invalidates image");
+	Tests_Assert(World_GetBlock(inst2, &p5) == BLOCK_GOLD, "check old instance keeps its blocks");
+	World_Free(inst2);
+	World_Free(inst);
+	inst = World_CloneFrom(world, "instance");
+	Tests_Assert(inst != NULL, "clone modified template");
+	Tests_Assert(world->image.version == world->wdata.version, "check image taken again");
+	Tests_Assert(World_GetBlock(inst, &p5) == BLOCK_STONE, "check new instance block");
+	World_Free(inst);
+
+	Tests_NewTask("Use mapped block backends");
+	for(EWorldBackend b = WORLD_BACKEND_HUGEPAGES; b <= WORLD_BACKEND_FILE; b++) {
+		World *mworld = World_Create("__mapped");
+		SVec mdims = {64, 64, 64}, mpos = {10, 20, 30};
+		Tests_Assert(World_SetBackend(mworld, b), "set world backend");
+		World_SetDimensions(mworld, &mdims);
+		World_AllocBlockArray(mworld);
+		Tests_Assert(World_GetBlock(mworld, &mpos) == BLOCK_AIR, "check mapped world is empty");
+		Tests_Assert(World_SetBlock(mworld, &mpos, BLOCK_LOG), "set mapped world block");
+		Tests_Assert(World_PackBlocks(mworld), "pack mapped world");
+		Tests_Assert(World_UnpackBlocks(mworld), "unpack mapped world");
+		Tests_Assert(World_GetBlock(mworld, &mpos) == BLOCK_LOG, "check mapped world block");
+		World_Free(mworld);
+	}
+	Tests_Assert(World_SetBackend(world, WORLD_BACKEND_INSTANCE) == false, "set instance backend");
+
+	Tests_NewTask("Remap blocks with fallback table");
+	const RemapTable *fbt = Block_GetFallbackTable(world);
+	Tests_Assert(fbt->lut[BLOCK_COBBLESLAB] == BLOCK_SLAB && fbt->lut[BLOCK_STONE] == BLOCK_STONE, "check fallback table");
+	RemapTable rt;
+	for(cs_uint32 i = 0; i < 256; i++) rt.lut[i] = (BlockID)(255 - i);
+	Remap_Update(&rt);
+	Tests_Assert(rt.rows == 0xFFFF, "check remap table rows");
+	// Каждое доступное ядро должно совпадать с обычным циклом
+	cs_uint32 kernels[] = {0, CPU_FEATURE_SSSE3, CPU_FEATURE_AVX2, CPU_FEATURE_NEON};
+	for(cs_uint32 k = 0; k < 4; k++) {
+		if(kernels[k] && (CPU_GetFeatures() & kernels[k]) == 0) continue;
+		Remap_Bind(kernels[k]);
+		BlockID rsrc[1000], rdst[1000];
+		for(cs_uint32 i = 0; i < 1000; i++) rsrc[i] = (BlockID)(i * 7);
+		Remap_Apply(fbt, rsrc, rdst, 1000);
+		cs_bool rok = true;
+		for(cs_uint32 i = 0; i < 1000; i++) rok &= rdst[i] == fbt->lut[rsrc[i]];
+		Tests_Assert(rok, "check remapped blocks");
+		Remap_Apply(&rt, rsrc, rsrc, 1000);
+		rok = true;
+		for(cs_uint32 i = 0; i < 1000; i++) rok &= rsrc[i] == (BlockID)(255 - (BlockID)(i * 7));
+		Tests_Assert(rok, "check blocks remapped in place");
+	}
+	Remap_Bind(CPU_GetFeatures());
+
+	Tests_NewTask("Compress map in background");
+	MapCache *mc = MapCache_Acquire(world, true, false);
+	Tests_Assert(mc != NULL, "acquire map cache");
+	Tests_Assert(MapCache_Step(mc) && MapCache_IsBusy(mc), "start background compression");
+	// Брошенный кеш дожимает и удаляет фоновый поток
+	MapCache_Release(mc);
+	MapCache_Invalidate(world);
+	World_WaitAllTasks(world);
+	mc = MapCache_Acquire(world, false, true);
+	Tests_Assert(mc != NULL, "acquire fallback map cache");
+	// Изменения после создания кеша не должны попасть в карту
+	BlockID mcold = World_GetBlockO(world, 0);
+	Tests_Assert(World_SetBlockO(world, 0, mcold == BLOCK_GOLD ? BLOCK_STONE : BLOCK_GOLD), "change world under map cache");
+	while(MapCache_Step(mc) && !MapCache_IsDone(mc))
+		Thread_Sleep(10);
+	Tests_Assert(MapCache_IsDone(mc), "finish background compression");
+	const cs_byte *mcdata = NULL;
+	cs_uint32 mcsize = MapCache_Peek(mc, 0, &mcdata);
+	cs_byte mchead[64];
+	Compr mcctx = {0};
+	Tests_Assert(Compr_Init(&mcctx, COMPR_TYPE_UNGZIP), "init map decompressor");
+	Compr_SetInBuffer(&mcctx, (void *)mcdata, mcsize);
+	Compr_SetOutBuffer(&mcctx, mchead, sizeof(mchead));
+	Tests_Assert(Compr_Update(&mcctx) && Compr_GetWrittenSize(&mcctx) == sizeof(mchead), "decompress map head");
+	Tests_Assert(mchead[4] == fbt->lut[mcold], "check map built from snapshot");
+	Compr_Reset(&mcctx);
+	Compr_Cleanup(&mcctx);
+	MapCache_Release(mc);
+
+	Tests_NewTask("Queue block updates");
+	cs_uint32 o1 = World_GetOffset(world, &p1);
+	Tests_Assert(World_QueueBlockUpdate(world, o1), "queue first block");
+	Tests_Assert(World_QueueBlockUpdate(world, World_GetOffset(world, &p2)), "queue second block");
+	Tests_Assert(World_QueueBlockUpdate(world, o1), "queue first block again");
+	Tests_Assert(World_QueueBlockUpdate(world, wsize) == false, "queue block outside world");
+	Tests_Assert(world->pending.count == 2, "check repeated updates collapse");
+	World_FlushBlockUpdates(world);
+	Tests_Assert(world->pending.count == 0, "check queue flush");
+	Tests_Assert(World_QueueBlockUpdate(world, o1), "queue first block after flush");
 	World_FreeBlockArray(world);
+	Tests_Assert(world->pending.count == 0, "check queue drop on unload");
 	World_Free(world);
 
 	return true;
@@ -53,6 +53,18 @@ void Timer_Update(cs_int32 delta) {
 	}
 }
 
+cs_int32 Timer_GetNextDelay(void) {
+	cs_int32 delay = -1;
+	AListField *field;
+	List_Iter(field, headTimer) {
+		Timer *timer = field->value.ptr;
+		cs_int32 left = max(timer->nexttick, 0);
+		if(delay == -1 || left < delay)
+			delay = left;
+	}
+	return delay;
+}
+
 void Timer_RemoveAll(void) {
 	while(headTimer) {
 		Memory_Free(headTimer->value.ptr);
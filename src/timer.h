@@ -15,6 +15,7 @@ typedef struct _Timer {
 #ifndef CORE_BUILD_PLUGIN
 	void Timer_RemoveAll(void);
 	void Timer_Update(cs_int32 delta);
+	cs_int32 Timer_GetNextDelay(void);
 #endif
 
 API Timer *Timer_Add(cs_int32 ticks, cs_uint32 delay, TimerCallback callback, void *ud);
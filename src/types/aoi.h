@@ -0,0 +1,16 @@
+#ifndef AOITYPES_H
+#define AOITYPES_H
+#include "core.h"
+
+#define AOI_BUCKETS 64
+#define AOI_HYSTERESIS 8
+#define AOI_SEEN_SIZE ((MAX_CLIENTS + 7) / 8)
+
+typedef struct _AOIGrid {
+	cs_byte head[AOI_BUCKETS]; // Первая сущность корзины (id + 1, 0 - корзина пуста)
+	cs_byte next[MAX_CLIENTS]; // Следующая сущность в корзине (id + 1)
+	cs_byte prev[MAX_CLIENTS]; // Предыдущая сущность в корзине (id + 1)
+	cs_byte bucket[MAX_CLIENTS]; // Корзина, в которой лежит сущность
+	cs_bool present[MAX_CLIENTS]; // Находится ли сущность в сетке
+} AOIGrid;
+#endif
@@ -0,0 +1,25 @@
+#ifndef BRICKSTYPES_H
+#define BRICKSTYPES_H
+#include "core.h"
+#include "vector.h"
+
+#define BRICK_SHIFT 4
+#define BRICK_SIZE (1 << BRICK_SHIFT)
+#define BRICK_VOLUME (BRICK_SIZE * BRICK_SIZE * BRICK_SIZE)
+#define BRICK_PALETTE 16
+
+typedef struct _Brick {
+	BlockID *data; // Индексы палитры или сами блоки, у однородного брика NULL
+	cs_byte bits; // 0 - брик однородный, 4 - индексы палитры, 8 - блоки без палитры
+	cs_byte count; // Количество блоков в палитре
+	BlockID palette[BRICK_PALETTE]; // Палитра, у однородного брика в ней один блок
+} Brick;
+
+typedef struct _BrickStore {
+	SVec dims; // Размеры мира в блоках
+	cs_uint32 bx, bz; // Количество бриков по осям X и Z
+	cs_uint32 count; // Общее количество бриков
+	cs_uint64 memory; // Память, занятая бриками и их данными
+	Brick *list; // Брики в порядке Y-Z-X, как и блоки мира
+} BrickStore;
+#endif
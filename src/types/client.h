@@ -37,27 +37,33 @@ typedef struct _PlayerData {
 	cs_char name[MAX_STR_LEN]; // Имя игрока
 	cs_char displayname[MAX_STR_LEN]; // Отображаемое имя игрока
 	World *world; // Мир, в котором игрок обитает
+	cs_uint16 worldSlot; // Позиция игрока в списке клиентов мира
 	Vec position; // Позиция игрока
 	Ang angle; // Угол вращения игрока
 	cs_bool isOP; // Является ли игрок оператором
 	cs_bool spawned; // Заспавнен ли игрок
 	cs_bool firstSpawn; // Был лы этот спавн первым с момента захода на сервер
+	cs_bool moved; // Позиция изменилась с последней рассылки
+	cs_bool absolute; // Следующая рассылка позиции должна быть абсолютной
+	cs_int32 sentPos[3]; // Последняя разосланная позиция, в 1/32 блока
+	cs_byte sentAng[2]; // Последний разосланный угол
+	cs_byte seen[AOI_SEEN_SIZE]; // Битовая маска сущностей, заспавненных у игрока
+	cs_byte seenby[AOI_SEEN_SIZE]; // Битовая маска игроков, у которых заспавнен этот игрок
 } PlayerData;
 
 typedef struct _PacketData {
 	Packet *packet;
 	cs_uint16 psize;
 	cs_bool isExtended;
+	cs_char *partial; // Пакет, разрезанный между фреймами вебсокета
+	cs_uint16 partlen, partcap; // Собранная часть пакета и размер буфера
 } PacketData;
 
 typedef struct _MapData {
-	Compr compr; // Штука для сжатия карты
 	World *world; // Передаваемая карта
-	BlockID *cbptr; // Указатель на место, с которого отправляем карту
-	cs_uint32 size; // Размер карты в байтах
-	cs_uint32 sent; // Количество отправленных байт
-	cs_bool fback; // Нужно ли заменять кастомные блоки
-	cs_bool fastmap; // Есть ли дополнение FastMap
+	MapCache *cache; // Общий кеш сжатой карты
+	cs_uint32 sent; // Количество отправленных сжатых байт
+	cs_bool loading; // Мир загружался специально для этого клиента
 } MapData;
 
 typedef struct _Client {
@@ -2,6 +2,13 @@
 #define COMPRTYPES_H
 #include "core.h"
 
+#define COMPR_POOL_DEFAULT 16
+#define COMPR_LEVEL_MIN 1
+#define COMPR_LEVEL_MAX 9
+#define COMPR_LEVEL_DEFAULT 6
+#define COMPR_PARALLEL_BLOCK (1024 * 1024)
+#define COMPR_PARALLEL_MAX 8
+
 typedef enum _ComprType {
 	COMPR_TYPE_NOTSET,
 	COMPR_TYPE_DEFLATE,
@@ -10,6 +17,21 @@ typedef enum _ComprType {
 	COMPR_TYPE_GZIP
 } ComprType;
 
+typedef enum _ComprCodec {
+	COMPR_CODEC_GZIP, // Один gzip поток через zlib
+	COMPR_CODEC_ZSTD, // Независимые zstd кадры
+	COMPR_CODEC_LZ4, // Независимые LZ4 кадры
+
+	COMPR_CODEC_COUNT
+} ComprCodec;
+
+typedef enum _ComprUse {
+	COMPR_USE_SAVE, // Сохранение миров на диск
+	COMPR_USE_NETWORK, // Сжатие карты для отправки клиентам
+
+	COMPR_USE_COUNT
+} ComprUse;
+
 typedef enum _ComprState {
 	COMPR_STATE_IDLE,
 	COMPR_STATE_INPROCESS,
@@ -25,4 +47,22 @@ typedef struct _Compr {
 	cs_uint32 queued;
 	void *stream;
 } Compr;
+
+/**
+ * @brief Преобразует кусок входных данных перед сжатием.
+ * 
+ * @param arg пользовательский аргумент
+ * @param offset смещение куска во входных данных
+ * @param src исходные данные
+ * @param dst буфер под преобразованные данные
+ * @param size размер куска
+ */
+typedef void(*ComprTransform)(void *arg, cs_uint32 offset, const cs_byte *src, cs_byte *dst, cs_uint32 size);
+
+typedef struct _ComprPoolStats {
+	cs_uint32 hits; // Сколько раз архиватор был взят из пула
+	cs_uint32 misses; // Сколько раз архиватор пришлось создавать заново
+	cs_uint32 idle; // Количество свободных архиваторов в пуле
+	cs_uint32 limit; // Максимальное количество свободных архиваторов
+} ComprPoolStats;
 #endif
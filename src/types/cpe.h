@@ -46,6 +46,8 @@
 #define CPE_MAX_PARTICLES 254
 #define CPE_MAX_EXTMESG_LEN 193
 #define CPE_MAX_CUBOIDS 16
+#define CPE_MAX_EXTENSIONS 64
+#define CPE_EXTTABLE_SIZE 128
 
 /*
  * Если какой-то из дефайнов ниже
@@ -113,6 +115,8 @@ typedef struct _CPEClExt {
 typedef struct _CPESvExt {
 	cs_str name; // Название дополнения
 	cs_int32 version; // Его версия
+	cs_ulong hash; // CRC32 названия дополнения
+	cs_int16 index; // Индекс дополнения в таблице версий клиента, -1 - не влезло
 	struct _CPESvExt *next; // Следующее дополнение
 } CPESvExt;
 
@@ -241,6 +245,7 @@ typedef struct _CPEData {
 		CPEClExt *list; // Список дополнений клиента
 		cs_int16 count; // Количество дополнений у клиента
 		cs_int16 current; // Количество обработанных дополнений
+		cs_int32 versions[CPE_MAX_EXTENSIONS]; // Версии дополнений по индексу серверного дополнения
 	} extensions;
 	cs_char appName[MAX_STR_LEN]; // Название игрового клиента
 	cs_char skin[MAX_STR_LEN]; // Скин игрока [ExtPlayerList]
@@ -0,0 +1,36 @@
+#ifndef MAPCACHETYPES_H
+#define MAPCACHETYPES_H
+#include "core.h"
+#include "types/compr.h"
+#include "types/platform.h"
+#include "types/remap.h"
+
+#define MAPCACHE_FLAG_FASTMAP BIT(0)
+#define MAPCACHE_FLAG_FALLBACK BIT(1)
+#define MAPCACHE_VARIANTS 4
+
+typedef struct _MapCache {
+	struct _World *world; // Мир, карта которого сжимается
+	cs_uint32 version; // Версия блоков мира на момент создания кеша
+	cs_uint32 refs; // Количество клиентов, получающих эту карту
+	cs_byte variant; // Комбинация флагов MAPCACHE_FLAG_*
+	cs_bool detached; // Кеш устарел и будет удалён вместе с последним клиентом
+	cs_bool failed; // При сжатии произошла ошибка
+	cs_bool done; // Карта сжата целиком
+	Compr compr; // Общий для всех получателей архиватор
+	struct _WorldSnapshot *snap; // Снимок блоков, из которого сжимается карта
+	cs_uint32 insize, inpos; // Размер несжатых данных и позиция архиватора в них
+	cs_byte *data; // Сжатые данные
+	cs_uint32 size, cap; // Количество сжатых данных и размер буфера под них
+	RemapTable fallback; // Таблица замены блоков, с которой строится кеш
+	struct _MapCacheBg {
+		Thread thread; // Поток, сжимающий большую карту целиком
+		Mutex *mutex;
+		cs_bool busy; // Поток запущен и ещё не присоединён
+		cs_bool finished; // Поток закончил работу
+		cs_bool orphan; // Кеш больше никому не нужен, поток удалит его сам
+		cs_byte *input; // Копия блоков, которую сжимает поток
+		cs_uint32 size; // Размер сжатых потоком данных, 0 - ошибка
+	} bg;
+} MapCache;
+#endif
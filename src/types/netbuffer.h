@@ -3,23 +3,46 @@
 #include "core.h"
 #include "types/platform.h"
 
-#define GROWINGBUFFER_ADDITIONAL 512
+#define NETBUFFER_PAGE_SIZE 16384
+#define NETBUFFER_SEGMENTS 256
+#define NETBUFFER_POOL_MAX 512
+#define NETBUFFER_DEFAULT_LIMIT (NETBUFFER_PAGE_SIZE * NETBUFFER_SEGMENTS)
+#define NETBUFFER_DEFAULT_LOWAT (64 * 1024)
+#define NETBUFFER_SHARE_MIN 512
 
-typedef struct _GrowingBuffer {
-	cs_uint32 offset, size;
-	cs_uint32 maxsize;
-	cs_char *buffer;
-} GrowingBuffer;
+typedef struct _NetPage {
+	struct _NetPage *next; // Следующая свободная страница в пуле
+	cs_uint32 refs; // Количество буферов, ссылающихся на страницу
+	cs_uint32 size; // Размер страницы
+	cs_uint32 used; // Количество записанных в страницу байт
+	cs_char *data; // Данные страницы
+} NetPage;
+
+typedef struct _NetSegment {
+	NetPage *page; // Страница с данными
+	cs_uint32 start, end; // Ещё не отправленная часть страницы
+} NetSegment;
 
 typedef struct _NetBuffer {
 	Socket fd;
-	cs_uint32 cread, cwrite;
-	GrowingBuffer write;
-	GrowingBuffer read;
+	struct _NetBufferRead {
+		NetPage *page; // Страница под входящие данные
+		cs_uint32 start, end; // Непрочитанная часть страницы
+	} read;
+	struct _NetBufferWrite {
+		NetSegment segs[NETBUFFER_SEGMENTS]; // Кольцо очереди отправки
+		cs_uint32 head, count; // Начало и длина кольца
+		cs_uint32 queued; // Количество байт в очереди
+		cs_uint32 limit; // Максимальный размер очереди
+		cs_uint32 lowat; // Размер очереди, ниже которого стоит досылать фоновые данные
+	} write;
 	cs_bool closed;
 	cs_bool shutdown;
 	cs_bool asframe;
 	cs_bool wsupgrade;
+	cs_bool polled, pollout;
+	cs_bool released;
+	cs_uint32 events;
 	cs_uint32 framesize;
 } NetBuffer;
 #endif
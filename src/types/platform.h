@@ -16,7 +16,9 @@
 	typedef CRITICAL_SECTION Mutex;
 	typedef SOCKET Socket;
 	typedef HANDLE Thread, ITER_DIR;
+	typedef HANDLE MemoryImage;
 	typedef BOOL TSHND_RET;
+#	define MEMORY_IMAGE_INVALID NULL
 #elif defined(CORE_USE_UNIX)
 #	include <pthread.h>
 #	include <sys/stat.h>
@@ -48,8 +50,20 @@
 		cs_bool signalled;
 	} Waitable;
 	typedef cs_int32 Socket;
+	typedef cs_int32 MemoryImage;
+#	define MEMORY_IMAGE_INVALID -1
 #endif
 
+#define POLL_EVENT_READ  BIT(0)
+#define POLL_EVENT_WRITE BIT(1)
+#define POLL_EVENT_CLOSE BIT(2)
+
+#define CPU_FEATURE_SSSE3  BIT(0)
+#define CPU_FEATURE_SSE42  BIT(1)
+#define CPU_FEATURE_AVX2   BIT(2)
+#define CPU_FEATURE_AVX512 BIT(3)
+#define CPU_FEATURE_NEON   BIT(4)
+
 typedef cs_int32 cs_error;
 typedef FILE *cs_file;
 typedef void *TARG;
@@ -63,6 +77,11 @@ typedef enum _EIterState {
 	ITER_ERROR
 } EIterState;
 
+typedef struct _PollEvent {
+	void *ud;
+	cs_uint32 events;
+} PollEvent;
+
 typedef struct _DirIter {
 	EIterState state;
 	cs_char fmt[256];
@@ -1,8 +1,10 @@
 #ifndef PROTOCOLTYPES_H
 #define PROTOCOLTYPES_H
 #include "core.h"
+#include "types/netbuffer.h"
 
 #define PROTOCOL_VERSION 0x07
+#define PROTO_SHARED_VARIANTS 4
 
 #define EXT_CLICKDIST 0x6DD2B567ul
 #define EXT_CUSTOMBLOCKS 0x98455F43ul
@@ -113,6 +115,14 @@ typedef struct _Packet {
 	void *extHandler;
 } Packet;
 
+typedef struct _SharedPacket {
+	NetPage *page; // Страница с закодированными вариантами пакета
+	cs_uint32 offset[PROTO_SHARED_VARIANTS]; // Начало каждого варианта в странице
+	cs_uint32 size[PROTO_SHARED_VARIANTS]; // Размер каждого варианта
+	cs_byte ready; // Битовая маска уже закодированных вариантов
+	cs_byte last; // Вариант, записанный в страницу последним
+} SharedPacket;
+
 typedef enum _ESetBlockMode {
 	SETBLOCK_MODE_DESTROY,
 	SETBLOCK_MODE_CREATE
@@ -0,0 +1,9 @@
+#ifndef REMAPTYPES_H
+#define REMAPTYPES_H
+#include "core.h"
+
+typedef struct _RemapTable {
+	BlockID lut[256]; // Замена для каждого номера блока
+	cs_uint16 rows; // Старшие полубайты номеров, которые заменяются не на себя
+} RemapTable;
+#endif
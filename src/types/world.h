@@ -6,6 +6,10 @@
 #include "types/platform.h"
 #include "types/compr.h"
 #include "types/cpe.h"
+#include "types/mapcache.h"
+#include "types/aoi.h"
+#include "types/bricks.h"
+#include "types/remap.h"
 
 #define WORLD_FLAG_NONE 0x00
 #define WORLD_FLAG_LOADED BIT(0)
@@ -16,6 +20,10 @@
 #define WORLD_MAX_SIZE 4000000000u
 #define WORLD_INVALID_OFFSET (cs_uint32)-1
 
+#define WORLD_PENDING_MAX 4096
+#define WORLD_PENDING_TABLE (WORLD_PENDING_MAX * 2)
+#define WORLD_BATCH_MAX 256
+
 typedef enum _EWorldError {
 	WORLD_ERROR_SUCCESS = 0,
 	WORLD_ERROR_IOFAIL,
@@ -32,9 +40,17 @@ typedef enum _EWorldExtra {
 	WORLD_EXTRA_IO_WRITE,
 	WORLD_EXTRA_IO_RENAME,
 	WORLD_EXTRA_COMPR_INIT,
-	WORLD_EXTRA_COMPR_PROC
+	WORLD_EXTRA_COMPR_PROC,
+	WORLD_EXTRA_UNKNOWN_VERSION
 } EWorldExtra;
 
+typedef enum _EWorldBackend {
+	WORLD_BACKEND_HEAP = 0, // Обычная куча процесса
+	WORLD_BACKEND_HUGEPAGES, // Отдельные страницы, по возможности большие
+	WORLD_BACKEND_FILE, // Временный файл, страницы вытесняет ядро
+	WORLD_BACKEND_INSTANCE // Страницы, общие с шаблоном (World_CloneFrom)
+} EWorldBackend;
+
 typedef struct _WorldInfo {
 	SVec dimensions;
 	BlockDef *bdefines[256];
@@ -49,6 +65,17 @@ typedef struct _WorldInfo {
 	cs_uint32 seed;
 } WorldInfo;
 
+typedef struct _WorldSnapshot {
+	struct _World *world; // Мир, с которого снят снимок
+	struct _WorldSnapshot *older, *newer; // Соседние снимки этого мира
+	BlockID **regions; // Копии регионов, сделанные перед их изменением
+	cs_uint32 count; // Количество регионов
+	cs_uint32 size; // Размер массива блоков на момент снимка
+	cs_uint32 version; // Версия блоков мира на момент снимка
+	cs_uint32 refs; // Количество владельцев снимка
+	cs_bool detached; // Массив блоков мира освобождён, все регионы скопированы
+} WorldSnapshot;
+
 typedef struct _World {
 	cs_uint32 flags;
 	cs_str name;
@@ -57,6 +84,8 @@ typedef struct _World {
 	Waitable *prgw;
 	Waitable *taskw;
 	cs_uint32 taskc;
+	cs_bool loading; // Блоки мира читаются в фоновом потоке
+	cs_uint64 lastuse; // Время, когда мир последний раз был нужен игрокам
 	Compr compr;
 	KListField *headNode;
 	struct _WorldError {
@@ -67,6 +96,67 @@ typedef struct _World {
 		cs_uint32 size;
 		void *ptr;
 		BlockID *blocks;
+		cs_uint32 version;
+		cs_bool mapped; // ptr - отображение, а не память из кучи
+		EWorldBackend backend; // Откуда берётся память под блоки
 	} wdata;
+	struct _WorldImage {
+		MemoryImage handle; // Образ блоков, с которого клонируются инстансы
+		cs_uint32 version; // Версия блоков, снятая в образ
+	} image;
+	BrickStore bricks; // Упакованные блоки, пока плоского массива нет
+	struct _WorldCold {
+		cs_byte *data; // Сжатые регионы блоков холодного мира
+		cs_uint32 *sizes; // Размеры сжатых регионов
+		cs_uint32 *offsets; // Смещения сжатых регионов в data
+		cs_uint32 size, cap; // Занятая часть data вместе с дырами и размер data
+		cs_uint32 live; // Общий размер сжатых регионов
+		ComprCodec codec; // Кодек, которым сжаты регионы
+		BlockID *region; // Разжатый регион для доступа к отдельным блокам
+		cs_uint32 current; // Номер разжатого региона
+		cs_bool dirty; // Разжатый регион изменён, но ещё не сжат обратно
+	} cold;
+	struct _WorldFallback {
+		RemapTable table; // Замена блоков для клиентов без CPE
+		cs_bool ready; // Таблица соответствует определениям блоков мира
+	} fallback;
+	MapCache *mcache[MAPCACHE_VARIANTS];
+	AOIGrid aoi;
+	struct _WorldClients {
+		struct _Client *list[MAX_CLIENTS]; // Плотный список игроков и ботов мира
+		cs_uint16 count; // Количество клиентов в списке
+		cs_byte players; // Количество игроков без учёта ботов
+	} clients;
+	struct _WorldPending {
+		cs_uint32 *offsets; // Смещения блоков, изменённых за текущий тик
+		cs_uint32 *table; // Хеш-таблица смещений (индекс в offsets + 1)
+		cs_uint32 count; // Количество изменённых блоков
+	} pending;
+	struct _WorldRegions {
+		cs_byte *dirty; // Регионы, изменённые после последнего сохранения
+		cs_byte *saving; // Регионы, которые записывает текущее сохранение
+		cs_uint32 count; // Количество регионов в массиве блоков
+		cs_uint64 *offsets; // Смещения сжатых регионов в файле мира
+		cs_uint32 *sizes; // Размеры сжатых регионов в файле мира
+		cs_uint64 live, end; // Объём актуальных регионов и конец файла
+		ComprCodec codec; // Кодек, которым сжаты регионы в файле
+		cs_uint64 *sums; // Контрольные суммы регионов в файле мира
+	} regions;
+	struct _WorldJournal {
+		Mutex *mutex; // Защищает файл журнала от обрезки во время записи
+		cs_file fp; // Файл журнала, открытый на дозапись
+		cs_byte *buffer; // Записи, ещё не сброшенные в файл
+		cs_uint32 used; // Количество байт в буфере
+		cs_uint64 written; // Размер файла журнала
+		cs_uint64 mark; // Размер журнала на момент начала сохранения
+		cs_uint64 base; // Контрольная сумма файла мира, к которому относятся записи
+		cs_bool broken; // Часть записей потеряна, журнал не пополняется до сохранения
+	} journal;
+	struct _WorldSnapshots {
+		Mutex *mutex; // Защищает копирование и чтение регионов снимков
+		WorldSnapshot *head; // Самый новый снимок
+		WorldSnapshot *cow; // Снимок, получающий копии изменяемых регионов
+		WorldSnapshot *save; // Снимок, из которого пишет текущее сохранение
+	} snaps;
 } World;
 #endif
@@ -6,6 +6,17 @@
 #include "strstor.h"
 #include "hash.h"
 
+#if defined(CPU_USE_X86)
+#	include <immintrin.h>
+#elif defined(CPU_USE_ARM64)
+#	include <arm_neon.h>
+#endif
+
+// Ядро снимает маску с начала данных целыми векторами
+// и возвращает, сколько байт обработало
+typedef cs_uint32(*UnmaskKernel)(cs_byte *data, cs_uint32 len, cs_uint32 mask);
+static UnmaskKernel Kernel = NULL;
+
 static cs_str ws_resp =
 "HTTP/1.1 101 Switching Protocols\r\n"
 "Connection: Upgrade\r\n"
@@ -38,6 +49,10 @@ INL static void ProcessHandshake(WebSock *ws, NetBuffer *nb) {
 			cs_str httpver = String_LastChar(ws->shake.line, 'H');
 			if(!httpver || !String_CaselessCompare(httpver, "HTTP/1.1")) {
 				cs_char *buffer = NetBuffer_StartWrite(nb, 1024);
+				if(!buffer) {
+					ws->error = WEBSOCK_ERROR_SOCKET;
+					return;
+				}
 				ret = String_FormatBuf(buffer, 1024,
 					ws_err, 505, "HTTP Version Not Supported", 0
 				);
@@ -82,6 +97,10 @@ INL static void ProcessHandshake(WebSock *ws, NetBuffer *nb) {
 			cs_char b64[30];
 			cs_byte hash[20];
 			cs_char *buffer = NetBuffer_StartWrite(nb, 1024);
+			if(!buffer) {
+				ws->error = WEBSOCK_ERROR_SOCKET;
+				return;
+			}
 
 			if(SHA1_Start(&ctx)) {
 				SHA1_PushData(&ctx, ws->shake.key, ws->shake.keylen);
@@ -111,6 +130,68 @@ INL static void ProcessHandshake(WebSock *ws, NetBuffer *nb) {
 		ws->error = WEBSOCK_ERROR_CONTINUE;
 }
 
+#if defined(CPU_USE_X86)
+CPU_TARGET("avx2")
+static cs_uint32 UnmaskAVX2(cs_byte *data, cs_uint32 len, cs_uint32 mask) {
+	__m256i vmask = _mm256_set1_epi32((cs_int32)mask);
+	cs_uint32 i = 0;
+
+	for(; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+		_mm256_storeu_si256((__m256i *)(data + i), _mm256_xor_si256(v, vmask));
+	}
+
+	return i;
+}
+#elif defined(CPU_USE_ARM64)
+static cs_uint32 UnmaskNEON(cs_byte *data, cs_uint32 len, cs_uint32 mask) {
+	uint8x16_t vmask = vreinterpretq_u8_u32(vdupq_n_u32(mask));
+	cs_uint32 i = 0;
+
+	for(; i + 16 <= len; i += 16)
+		vst1q_u8(data + i, veorq_u8(vld1q_u8(data + i), vmask));
+
+	return i;
+}
+#endif
+
+void WebSock_Bind(cs_uint32 features) {
+	Kernel = NULL;
+#if defined(CPU_USE_X86)
+	if(features & CPU_FEATURE_AVX2)
+		Kernel = UnmaskAVX2;
+#elif defined(CPU_USE_ARM64)
+	if(features & CPU_FEATURE_NEON)
+		Kernel = UnmaskNEON;
+#else
+	(void)features;
+#endif
+}
+
+/*
+ * Маска повторяется каждые 4 байта, поэтому её можно
+ * наложить сразу на машинное слово. Порядок байт в
+ * слове и в памяти совпадает, ведь маска в него
+ * скопирована прямо из памяти. Слова копируются, а не
+ * читаются через указатель: данные фрейма не выровнены.
+*/
+void WebSock_Unmask(cs_char *data, cs_uint32 len, const cs_char mask[4]) {
+	cs_byte *u8data = (cs_byte *)data;
+	cs_uint32 mask32, i = 0;
+	Memory_Copy(&mask32, mask, sizeof(mask32));
+	cs_uint64 mask64 = ((cs_uint64)mask32 << 32) | mask32;
+
+	if(Kernel) i = Kernel(u8data, len, mask32);
+	for(; i + 8 <= len; i += 8) {
+		cs_uint64 word;
+		Memory_Copy(&word, u8data + i, sizeof(word));
+		word ^= mask64;
+		Memory_Copy(u8data + i, &word, sizeof(word));
+	}
+	for(; i < len; i++)
+		u8data[i] ^= (cs_byte)mask[i & 3];
+}
+
 cs_bool WebSock_Tick(WebSock *ws, NetBuffer *nb) {
 	if(ws->state == WEBSOCK_STATE_HANDSHAKE) {
 		ProcessHandshake(ws, nb);
@@ -141,6 +222,10 @@ cs_bool WebSock_Tick(WebSock *ws, NetBuffer *nb) {
 				ws->error = WEBSOCK_ERROR_PAYLOAD_TOO_BIG;
 				return false;
 			}
+		} else {
+			// Клиент обязан маскировать каждый свой фрейм
+			ws->error = WEBSOCK_ERROR_MASK;
+			return false;
 		}
 	}
 
@@ -183,8 +268,7 @@ cs_bool WebSock_Tick(WebSock *ws, NetBuffer *nb) {
 		if(payload) {
 			ws->payload = payload;
 			ws->state = WEBSOCK_STATE_DONE;
-			for(cs_uint16 i = 0; i < ws->paylen; i++)
-				payload[i] ^= ws->mask[i % 4];
+			WebSock_Unmask(payload, ws->paylen, ws->mask);
 
 			return true;
 		}
@@ -19,6 +19,26 @@
  */
 API cs_bool WebSock_Tick(WebSock *ws, NetBuffer *sock);
 
+/**
+ * @brief Снимает маску с данных фрейма, начиная с
+ * первого байта полезной нагрузки.
+ * 
+ * @param data данные фрейма
+ * @param len длина данных
+ * @param mask маска из заголовка фрейма
+ */
+API void WebSock_Unmask(cs_char *data, cs_uint32 len, const cs_char mask[4]);
+
+#ifndef CORE_BUILD_PLUGIN
+	/**
+	 * @brief Выбирает самое быстрое ядро снятия маски из
+	 * тех, что поддерживает процессор.
+	 *
+	 * @param features комбинация флагов CPU_FEATURE_*
+	 */
+	void WebSock_Bind(cs_uint32 features);
+#endif
+
 /**
  * @brief Отправляет заголовок фрейма клиенту.
  * За заголовком должны следовать сырые данные
@@ -6,6 +6,11 @@
 #include "list.h"
 #include "compr.h"
 #include "client.h"
+#include "mapcache.h"
+#include "bricks.h"
+#include "protocol.h"
+#include "log.h"
+#include "strstor.h"
 
 enum _EWorldDataItems {
 	WDAT_DIMENSIONS,
@@ -30,6 +35,9 @@ World *World_Create(cs_str name) {
 	tmp->prgw = Waitable_Create();
 	tmp->taskw = Waitable_Create();
 	tmp->mtx = Mutex_Create();
+	tmp->journal.mutex = Mutex_Create();
+	tmp->snaps.mutex = Mutex_Create();
+	tmp->image.handle = MEMORY_IMAGE_INVALID;
 	Waitable_Signal(tmp->taskw);
 	Waitable_Signal(tmp->prgw);
 
@@ -199,11 +207,8 @@ cs_bool World_FinishEnvUpdate(World *world) {
 	};
 
 	if(Event_Call(EVT_PREWORLDENVUPDATE, &ev)) {
-		for(ClientID i = 0; i < MAX_CLIENTS; i++) {
-			Client *client = Clients_List[i];
-			if(client && Client_IsInWorld(client, world))
-				Client_UpdateWorldInfo(client, world, false);
-		}
+		for(cs_uint16 i = 0; i < world->clients.count; i++)
+			Client_UpdateWorldInfo(world->clients.list[i], world, false);
 
 		world->info.modclr = 0x00;
 		world->info.modprop = 0x00;
@@ -215,15 +220,7 @@ cs_bool World_FinishEnvUpdate(World *world) {
 }
 
 cs_byte World_CountPlayers(World *world) {
-	cs_byte count = 0;
-	for(ClientID i = 0; i < MAX_CLIENTS; i++) {
-		Client *client = Clients_List[i];
-		if(!client) continue;
-		if(!Client_IsInWorld(client, world)) continue;
-		if(Client_IsBot(client)) continue;
-		count++;
-	}
-	return count;
+	return world->clients.players;
 }
 
 cs_bool World_GetEnvColor(World *world, EColor type, Color3 *dst) {
@@ -242,23 +239,311 @@ cs_uint32 World_GetSeed(World *world) {
 	return world->info.seed;
 }
 
+#define REGION_BYTES(C) (((C) + 7) / 8)
+#define REGION_ISSET(M, I) (((M)[(I) >> 3] & BIT(((I) & 7))) != 0)
+// Столько регионов сжимается за один проход
+#define REGION_BATCH 32
+
+INL static void MarkRegion(World *world, cs_uint32 offset) {
+	cs_uint32 region = offset >> WORLD_REGION_SHIFT;
+	world->regions.dirty[region >> 3] |= (cs_byte)BIT((region & 7));
+}
+
+/*
+ * Снимки мира. Перед первым изменением региона его копия
+ * уходит в самый новый снимок. Снимки постарше берут
+ * недостающие регионы у более новых: если копии нет ни
+ * у одного из них, регион не менялся с момента снимка и
+ * читается прямо из массива блоков мира.
+*/
+static void CopyRegion(World *world, WorldSnapshot *snap, cs_uint32 region) {
+	cs_uint32 start = region << WORLD_REGION_SHIFT,
+	size = min(world->wdata.size - start, WORLD_FRAME_SIZE);
+	BlockID *copy = Memory_Alloc(1, size);
+	Memory_Copy(copy, world->wdata.blocks + start, size);
+	snap->regions[region] = copy;
+}
+
+INL static void PreserveRegion(World *world, cs_uint32 offset) {
+	WorldSnapshot *snap = world->snaps.cow;
+	cs_uint32 region = offset >> WORLD_REGION_SHIFT;
+	if(snap && !snap->regions[region]) {
+		Mutex_Lock(world->snaps.mutex);
+		CopyRegion(world, snap, region);
+		Mutex_Unlock(world->snaps.mutex);
+	}
+}
+
+// Копирует в снимки все ещё не скопированные регионы,
+// нужно перед записью в массив блоков в обход World_SetBlockO
+static void FreezeSnapshots(World *world, cs_bool detach) {
+	struct _WorldSnapshots *ws = &world->snaps;
+	WorldSnapshot *snap = ws->cow;
+	if(!snap) return;
+
+	Mutex_Lock(ws->mutex);
+	for(cs_uint32 i = 0; i < snap->count; i++)
+		if(!snap->regions[i]) CopyRegion(world, snap, i);
+	if(detach) {
+		for(snap = ws->head; snap; snap = snap->older)
+			snap->detached = true;
+		ws->cow = NULL;
+	}
+	Mutex_Unlock(ws->mutex);
+}
+
+static void FreeSnapshot(WorldSnapshot *snap) {
+	for(cs_uint32 i = 0; i < snap->count; i++)
+		if(snap->regions[i]) Memory_Free(snap->regions[i]);
+	Memory_Free(snap->regions);
+	Memory_Free(snap);
+}
+
+// Снимки освобождаются только основным потоком,
+// так как он без блокировки смотрит на ws->cow
+static void CollectSnapshots(World *world) {
+	struct _WorldSnapshots *ws = &world->snaps;
+	if(!ws->head) return;
+
+	Mutex_Lock(ws->mutex);
+	for(WorldSnapshot *snap = ws->head, *older; snap; snap = older) {
+		older = snap->older;
+		if(snap->refs > 0) continue;
+
+		// Если у более старого снимка нет копии региона,
+		// значит регион не менялся между этими снимками
+		for(cs_uint32 i = 0; i < snap->count; i++) {
+			if(snap->regions[i] && older && i < older->count && !older->regions[i]) {
+				older->regions[i] = snap->regions[i];
+				snap->regions[i] = NULL;
+			}
+		}
+
+		if(snap->newer) snap->newer->older = older;
+		else ws->head = older;
+		if(older) older->newer = snap->newer;
+		if(ws->cow == snap) ws->cow = older && !older->detached ? older : NULL;
+		FreeSnapshot(snap);
+	}
+	Mutex_Unlock(ws->mutex);
+}
+
+WorldSnapshot *World_TakeSnapshot(World *world) {
+	struct _WorldSnapshots *ws = &world->snaps;
+	if(!world->wdata.blocks) return NULL;
+	CollectSnapshots(world);
+
+	Mutex_Lock(ws->mutex);
+	WorldSnapshot *snap = ws->cow;
+	if(snap && snap->version == world->wdata.version) {
+		// С прошлого снимка мир не менялся
+		snap->refs++;
+		Mutex_Unlock(ws->mutex);
+		return snap;
+	}
+
+	if((snap = Memory_TryAlloc(1, sizeof(WorldSnapshot))) != NULL) {
+		snap->regions = Memory_TryAlloc(world->regions.count, sizeof(BlockID *));
+		if(snap->regions) {
+			snap->world = world;
+			snap->count = world->regions.count;
+			snap->size = world->wdata.size;
+			snap->version = world->wdata.version;
+			snap->refs = 1;
+			if((snap->older = ws->head) != NULL)
+				ws->head->newer = snap;
+			ws->head = ws->cow = snap;
+		} else {
+			Memory_Free(snap);
+			snap = NULL;
+		}
+	}
+
+	Mutex_Unlock(ws->mutex);
+	return snap;
+}
+
+cs_uint32 World_ReadSnapshot(WorldSnapshot *snap, cs_uint32 offset, BlockID *dst, cs_uint32 count) {
+	World *world = snap->world;
+	if(offset >= snap->size) return 0;
+	count = min(count, snap->size - offset);
+
+	for(cs_uint32 done = 0, n; done < count; done += n) {
+		cs_uint32 pos = offset + done, region = pos >> WORLD_REGION_SHIFT,
+		inner = pos & (WORLD_FRAME_SIZE - 1);
+		const BlockID *src = NULL;
+		n = min(count - done, WORLD_FRAME_SIZE - inner);
+
+		// Мьютекс держится на один регион, чтобы основной
+		// поток не ждал копирования всего снимка целиком
+		Mutex_Lock(world->snaps.mutex);
+		for(WorldSnapshot *s = snap; s && !src; s = s->newer)
+			if(region < s->count && s->regions[region])
+				src = s->regions[region] + inner;
+		Memory_Copy(dst + done, src ? src : world->wdata.blocks + pos, n);
+		Mutex_Unlock(world->snaps.mutex);
+	}
+
+	return count;
+}
+
+void World_ReleaseSnapshot(WorldSnapshot *snap) {
+	Mutex *mutex = snap->world->snaps.mutex;
+	Mutex_Lock(mutex);
+	snap->refs--;
+	Mutex_Unlock(mutex);
+}
+
+INL static void ClearPending(World *world) {
+	struct _WorldPending *wp = &world->pending;
+	if(wp->count == 0) return;
+	Memory_Zero(wp->table, WORLD_PENDING_TABLE * sizeof(cs_uint32));
+	wp->count = 0;
+}
+
+INL static void AllocRegions(World *world) {
+	struct _WorldRegions *wr = &world->regions;
+	wr->count = (world->wdata.size + WORLD_FRAME_SIZE - 1) >> WORLD_REGION_SHIFT;
+	wr->dirty = Memory_Alloc(REGION_BYTES(wr->count), 2);
+	wr->saving = wr->dirty + REGION_BYTES(wr->count);
+}
+
+/*
+ * Память под блоки в обход кучи. Большие страницы
+ * сокращают промахи TLB при генерации и отправке
+ * карты, а страницы временного файла ядро само
+ * вытесняет на диск, когда мир не влезает в память.
+ * Если отобразить память не вышло, блоки ляжут в кучу.
+*/
+static void *MapBlockData(World *world) {
+	cs_size size = (cs_size)world->wdata.size + 4;
+	void *data = NULL;
+
+	switch(world->wdata.backend) {
+		case WORLD_BACKEND_HUGEPAGES:
+			data = Memory_MapPages(size, true);
+			break;
+		case WORLD_BACKEND_FILE: {
+			cs_char path[256];
+			String_FormatBuf(path, 256, "worlds" PATH_DELIM "%s.blocks", world->name);
+			MemoryImage img = Memory_CreateFileImage(path, size);
+			if(img == MEMORY_IMAGE_INVALID) break;
+			data = Memory_MapImage(img, size, false);
+			Memory_CloseImage(img);
+			break;
+		}
+		default: break;
+	}
+
+	world->wdata.mapped = data != NULL;
+	return data;
+}
+
 void World_AllocBlockArray(World *world) {
-	void *data = Memory_Alloc(world->wdata.size + 4, 1);
+	void *data = MapBlockData(world);
+	if(!data) data = Memory_Alloc(world->wdata.size + 4, 1);
 	*(cs_uint32 *)data = htonl(world->wdata.size);
 	world->wdata.ptr = data;
 	world->wdata.blocks = (BlockID *)data + 4;
+	AllocRegions(world);
 	world->flags |= WORLD_FLAG_LOADED;
+	World_UpdateBlocks(world);
+}
+
+static void FreeBlockData(World *world) {
+	// Размер в заголовке не собьёт World_SetDimensions
+	if(world->wdata.mapped)
+		Memory_UnmapImage(world->wdata.ptr, ntohl(*(cs_uint32 *)world->wdata.ptr) + 4);
+	else
+		Memory_Free(world->wdata.ptr);
+	world->wdata.ptr = world->wdata.blocks = NULL;
+	world->wdata.mapped = false;
+}
+
+INL static void DropImage(World *world) {
+	if(world->image.handle != MEMORY_IMAGE_INVALID) {
+		// Уже созданные инстансы держат свои отображения
+		Memory_CloseImage(world->image.handle);
+		world->image.handle = MEMORY_IMAGE_INVALID;
+	}
+}
+
+/*
+ * Образ - копия блоков шаблона в разделяемой памяти.
+ * Инстансы отображают его с copy-on-write, так что
+ * страницы образа у них общие до первой записи.
+ * Менять образ на месте нельзя: ещё не тронутые
+ * страницы инстансов увидели бы изменения шаблона.
+ * Поэтому любое изменение шаблона делает образ
+ * недействительным, и следующий клон снимает новый
+ * образ, копируя блоки шаблона целиком.
+*/
+static cs_bool UpdateImage(World *world) {
+	struct _WorldImage *wi = &world->image;
+	cs_size size = (cs_size)world->wdata.size + 4;
+	if(wi->handle != MEMORY_IMAGE_INVALID && wi->version == world->wdata.version)
+		return true;
+
+	DropImage(world);
+	MemoryImage img = Memory_CreateImage(size);
+	if(img == MEMORY_IMAGE_INVALID) return false;
+	void *view = Memory_MapImage(img, size, false);
+	if(!view) {
+		Memory_CloseImage(img);
+		return false;
+	}
+
+	Memory_Copy(view, world->wdata.ptr, size);
+	Memory_UnmapImage(view, size);
+	wi->handle = img;
+	wi->version = world->wdata.version;
+	return true;
+}
+
+World *World_CloneFrom(World *tmpl, cs_str name) {
+	if(tmpl->loading || !World_UnpackBlocks(tmpl) ||
+		!World_IsReadyToPlay(tmpl) || !UpdateImage(tmpl))
+		return NULL;
+
+	cs_size size = (cs_size)tmpl->wdata.size + 4;
+	void *data = Memory_MapImage(tmpl->image.handle, size, true);
+	if(!data) return NULL;
+
+	World *world = World_Create(name);
+	if(!world) {
+		Memory_UnmapImage(data, size);
+		return NULL;
+	}
+
+	world->info = tmpl->info;
+	world->info.modval = 0;
+	world->info.modclr = 0;
+	world->info.modprop = 0;
+	world->wdata.size = tmpl->wdata.size;
+	world->wdata.ptr = data;
+	world->wdata.blocks = (BlockID *)data + 4;
+	world->wdata.mapped = true;
+	world->wdata.backend = WORLD_BACKEND_INSTANCE;
+	AllocRegions(world);
+	world->flags |= WORLD_FLAG_LOADED | WORLD_FLAG_INMEMORY;
+	world->lastuse = Time_GetMSec();
+	return world;
 }
 
 cs_bool World_CleanBlockArray(World *world) {
+	if(!World_UnpackBlocks(world)) return false;
 	if(World_IsReadyToPlay(world)) {
+		FreezeSnapshots(world, false);
 		Memory_Fill(world->wdata.blocks, world->wdata.size, 0);
+		World_UpdateBlocks(world);
 		return true;
 	}
 
 	return false;
 }
 
+// У упакованного мира плоского массива нет, распаковывать
+// его должен сам вызывающий через World_UnpackBlocks
 BlockID *World_GetBlockArray(World *world, cs_uint32 *size) {
 	if(size) *size = World_GetBlockArraySize(world);
 	return world->wdata.blocks;
@@ -269,18 +554,326 @@ void *World_GetData(World *world, cs_uint32 *size) {
 	return world->wdata.ptr;
 }
 
+cs_bool World_IsPacked(World *world) {
+	return world->bricks.list != NULL || world->cold.data != NULL;
+}
+
+cs_bool World_IsLoading(World *world) {
+	return world->loading;
+}
+
+// Блоки инстанса занимают память только в изменённых регионах
+INL static cs_uint64 MappedUsage(World *world) {
+	struct _WorldRegions *wr = &world->regions;
+	cs_uint64 count = 0;
+	for(cs_uint32 i = 0; i < wr->count; i++)
+		if(REGION_ISSET(wr->dirty, i)) count++;
+	return min(count << WORLD_REGION_SHIFT, (cs_uint64)world->wdata.size);
+}
+
+cs_uint64 World_GetMemoryUsage(World *world) {
+	if(world->wdata.mapped) {
+		if(world->wdata.backend == WORLD_BACKEND_INSTANCE)
+			return MappedUsage(world);
+		// Страницы файла ядро вытеснит и без нас
+		if(world->wdata.backend == WORLD_BACKEND_FILE)
+			return 0;
+	}
+
+	return (world->wdata.ptr ? (cs_uint64)world->wdata.size + 4 : 0) + world->bricks.memory +
+	(world->cold.data ? world->cold.cap + (cs_uint64)world->regions.count * sizeof(cs_uint32) * 2 : 0) +
+	(world->cold.region ? WORLD_FRAME_SIZE : 0);
+}
+
+// Упаковать можно только мир, карту которого сейчас
+// никто не получает и который не сохраняется
+static cs_bool BeginPack(World *world) {
+	if(!World_IsReadyToPlay(world) || world->clients.players > 0)
+		return false;
+	if(!World_Lock(world, 1)) return false;
+	if(world->taskc > 0) {
+		World_Unlock(world);
+		return false;
+	}
+
+	return true;
+}
+
+static void EndPack(World *world) {
+	MapCache_Invalidate(world);
+	ClearPending(world);
+	FreezeSnapshots(world, true);
+	FreeBlockData(world);
+	World_Unlock(world);
+}
+
+cs_bool World_PackBlocks(World *world) {
+	if(!BeginPack(world)) return false;
+	if(!Bricks_Pack(&world->bricks, &world->info.dimensions, world->wdata.blocks)) {
+		World_Unlock(world);
+		return false;
+	}
+
+	EndPack(world);
+	return true;
+}
+
+INL static void FreeCold(World *world) {
+	struct _WorldCold *wc = &world->cold;
+	if(wc->data) {
+		Memory_Free(wc->data);
+		wc->data = NULL;
+	}
+	if(wc->sizes) {
+		Memory_Free(wc->sizes);
+		wc->sizes = NULL;
+	}
+	if(wc->offsets) {
+		Memory_Free(wc->offsets);
+		wc->offsets = NULL;
+	}
+	if(wc->region) {
+		Memory_Free(wc->region);
+		wc->region = NULL;
+	}
+	wc->size = wc->cap = wc->live = 0;
+	wc->dirty = false;
+}
+
+/*
+ * Холодный мир хранит блоки в виде независимо сжатых
+ * регионов, лежащих в одном общем буфере.
+ * Быстрый кодек на минимальном уровне сжимает и
+ * разжимает регионы на всех ядрах за миллисекунды.
+*/
+static cs_bool CompressCold(World *world, ComprCodec codec) {
+	struct _WorldCold *wc = &world->cold;
+	cs_uint32 wsize = world->wdata.size, count = world->regions.count,
+	fbound = Compr_FrameBound(codec, WORLD_FRAME_SIZE), size = 0, cap = 0;
+	cs_byte *out = NULL, *data = NULL;
+	cs_uint32 *sizes = NULL, *offsets = NULL;
+
+	if(fbound == 0 || count == 0 ||
+		(sizes = Memory_TryAlloc(count, sizeof(cs_uint32))) == NULL ||
+		(offsets = Memory_TryAlloc(count, sizeof(cs_uint32))) == NULL ||
+		(out = Memory_TryAlloc(REGION_BATCH, fbound)) == NULL)
+		goto fail;
+
+	for(cs_uint32 i = 0; i < count; i += REGION_BATCH) {
+		cs_uint32 n = min(count - i, REGION_BATCH), start = i << WORLD_REGION_SHIFT;
+		if(!Compr_CompressFrames(codec, COMPR_LEVEL_MIN, world->wdata.blocks + start,
+			min(wsize - start, n << WORLD_REGION_SHIFT), WORLD_FRAME_SIZE, out, sizes + i))
+			goto fail;
+
+		for(cs_uint32 j = 0; j < n; j++) {
+			if(size + sizes[i + j] > cap) {
+				cs_uint32 newcap = max(cap * 2, size + sizes[i + j]);
+				cs_byte *tmp = data ? Memory_TryRealloc(data, newcap) : Memory_TryAlloc(1, newcap);
+				if(!tmp) goto fail;
+				data = tmp, cap = newcap;
+			}
+			Memory_Copy(data + size, out + (cs_size)j * fbound, sizes[i + j]);
+			offsets[i + j] = size;
+			size += sizes[i + j];
+		}
+	}
+
+	Memory_Free(out);
+	// Лишняя ёмкость буфера съела бы часть выигрыша
+	if(size < cap) {
+		cs_byte *tmp = Memory_TryRealloc(data, size);
+		if(tmp) data = tmp, cap = size;
+	}
+	wc->data = data;
+	wc->sizes = sizes;
+	wc->offsets = offsets;
+	wc->size = wc->live = size;
+	wc->cap = cap;
+	wc->codec = codec;
+	return true;
+
+	fail:
+	if(sizes) Memory_Free(sizes);
+	if(offsets) Memory_Free(offsets);
+	if(out) Memory_Free(out);
+	if(data) Memory_Free(data);
+	return false;
+}
+
+// Сдвигает регионы вплотную друг к другу, убирая дыры,
+// оставшиеся на месте пересжатых регионов
+static cs_bool CompactCold(World *world) {
+	struct _WorldCold *wc = &world->cold;
+	if(wc->size == wc->live) return true;
+	cs_byte *data = Memory_TryAlloc(1, wc->live);
+	if(!data) return false;
+
+	for(cs_uint32 i = 0, pos = 0; i < world->regions.count; i++) {
+		Memory_Copy(data + pos, wc->data + wc->offsets[i], wc->sizes[i]);
+		wc->offsets[i] = pos;
+		pos += wc->sizes[i];
+	}
+
+	Memory_Free(wc->data);
+	wc->data = data;
+	wc->size = wc->cap = wc->live;
+	return true;
+}
+
+/*
+ * Пересжатый регион ложится на старое место, если
+ * помещается в него, иначе дописывается в конец буфера.
+ * Так пересжатие стоит порядка размера одного региона,
+ * а дыры убираются, только когда их набирается больше,
+ * чем самих сжатых данных.
+*/
+static cs_bool FlushColdRegion(World *world) {
+	struct _WorldCold *wc = &world->cold;
+	if(!wc->dirty) return true;
+
+	cs_uint32 region = wc->current, start = region << WORLD_REGION_SHIFT, size = 0;
+	cs_byte *out = Memory_TryAlloc(1, Compr_FrameBound(wc->codec, WORLD_FRAME_SIZE));
+	if(!out || !Compr_CompressFrames(wc->codec, COMPR_LEVEL_MIN, wc->region,
+		min(world->wdata.size - start, WORLD_FRAME_SIZE), WORLD_FRAME_SIZE, out, &size)) {
+		if(out) Memory_Free(out);
+		return false;
+	}
+
+	if(size <= wc->sizes[region])
+		Memory_Copy(wc->data + wc->offsets[region], out, size);
+	else {
+		if(wc->size + size > wc->cap) {
+			cs_uint32 newcap = max(wc->cap + wc->cap / 2, wc->size + size);
+			cs_byte *data = Memory_TryRealloc(wc->data, newcap);
+			if(!data) {
+				Memory_Free(out);
+				return false;
+			}
+			wc->data = data;
+			wc->cap = newcap;
+		}
+		Memory_Copy(wc->data + wc->size, out, size);
+		wc->offsets[region] = wc->size;
+		wc->size += size;
+	}
+
+	Memory_Free(out);
+	wc->live = wc->live - wc->sizes[region] + size;
+	wc->sizes[region] = size;
+	wc->dirty = false;
+	// Не вышло - дыры просто подождут следующего раза
+	if(wc->size - wc->live > wc->live)
+		(void)CompactCold(world);
+	return true;
+}
+
+/*
+ * Отдельные блоки холодного мира читаются и меняются
+ * через один разжатый регион, так что случайное
+ * обращение к простаивающему миру не разжимает его
+ * целиком. Изменённый регион сжимается обратно, когда
+ * понадобится другой регион.
+*/
+static BlockID *GetColdBlock(World *world, cs_uint32 offset) {
+	struct _WorldCold *wc = &world->cold;
+	cs_uint32 region = offset >> WORLD_REGION_SHIFT,
+	start = region << WORLD_REGION_SHIFT;
+	if(wc->region && wc->current == region)
+		return wc->region + (offset - start);
+
+	if(!FlushColdRegion(world)) return NULL;
+	if(!wc->region && (wc->region = Memory_TryAlloc(1, WORLD_FRAME_SIZE)) == NULL)
+		return NULL;
+	if(!Compr_DecompressFrames(wc->codec, wc->data + wc->offsets[region], wc->sizes[region],
+		wc->sizes + region, WORLD_FRAME_SIZE, wc->region, min(world->wdata.size - start, WORLD_FRAME_SIZE))) {
+		Memory_Free(wc->region);
+		wc->region = NULL;
+		return NULL;
+	}
+
+	wc->current = region;
+	return wc->region + (offset - start);
+}
+
+cs_bool World_CompressBlocks(World *world) {
+	ComprCodec codec = Compr_HasCodec(COMPR_CODEC_LZ4) ? COMPR_CODEC_LZ4 : COMPR_CODEC_ZSTD;
+	// Без библиотек быстрых кодеков остаются брики
+	if(!Compr_HasCodec(codec)) return World_PackBlocks(world);
+	if(!BeginPack(world)) return false;
+	if(!CompressCold(world, codec)) {
+		World_Unlock(world);
+		return false;
+	}
+
+	EndPack(world);
+	return true;
+}
+
+cs_bool World_UnpackBlocks(World *world) {
+	if(!World_IsPacked(world)) return true;
+	// Регионы разжимаются из сплошного буфера
+	if(world->cold.data && !CompactCold(world)) return false;
+	void *data = MapBlockData(world);
+	if(!data && (data = Memory_TryAlloc(world->wdata.size + 4, 1)) == NULL)
+		return false;
+	*(cs_uint32 *)data = htonl(world->wdata.size);
+	world->wdata.ptr = data;
+	world->wdata.blocks = (BlockID *)data + 4;
+
+	if(world->cold.data) {
+		struct _WorldCold *wc = &world->cold;
+		if(!Compr_DecompressFrames(wc->codec, wc->data, wc->size, wc->sizes,
+			WORLD_FRAME_SIZE, world->wdata.blocks, world->wdata.size)) {
+			FreeBlockData(world);
+			return false;
+		}
+		if(wc->dirty) {
+			cs_uint32 start = wc->current << WORLD_REGION_SHIFT;
+			Memory_Copy(world->wdata.blocks + start, wc->region,
+				min(world->wdata.size - start, WORLD_FRAME_SIZE));
+		}
+		FreeCold(world);
+	} else {
+		Bricks_Flatten(&world->bricks, world->wdata.blocks);
+		Bricks_Free(&world->bricks);
+	}
+
+	// Иначе мир тут же снова сочли бы давно пустующим
+	world->lastuse = Time_GetMSec();
+	return true;
+}
+
 cs_uint32 World_GetBlockArraySize(World *world) {
 	return world->wdata.size;
 }
 
+void World_UpdateBlocks(World *world) {
+	world->wdata.version++;
+	// Массив мог измениться целиком, поэтому следующее
+	// сохранение перезапишет все его регионы
+	if(world->regions.dirty)
+		Memory_Fill(world->regions.dirty, REGION_BYTES(world->regions.count), 0xFF);
+}
+
 void World_Free(World *world) {
+	// Игроки не должны ссылаться на удалённый мир
+	for(cs_uint16 i = 0; i < world->clients.count; i++)
+		world->clients.list[i]->playerData.world = NULL;
 	while(world->headNode) {
 		Memory_Free(world->headNode->value.ptr);
 		KList_Remove(&world->headNode, world->headNode);
 	}
 	Compr_Cleanup(&world->compr);
 	World_FreeBlockArray(world);
+	if(world->pending.offsets) Memory_Free(world->pending.offsets);
 	if(world->mtx) Mutex_Free(world->mtx);
+	if(world->journal.mutex) Mutex_Free(world->journal.mutex);
+	while(world->snaps.head) {
+		WorldSnapshot *older = world->snaps.head->older;
+		FreeSnapshot(world->snaps.head);
+		world->snaps.head = older;
+	}
+	if(world->snaps.mutex) Mutex_Free(world->snaps.mutex);
 	if(world->prgw) Waitable_Free(world->prgw);
 	if(world->taskw) Waitable_Free(world->taskw);
 	if(world->name) Memory_Free((void *)world->name);
@@ -293,8 +886,8 @@ NOINL static cs_bool WriteWData(cs_file fp, cs_byte dataType, void *ptr, cs_int3
 
 #define _WriteWData(F, T, V) WriteWData(F, T, &V, sizeof(V))
 
-INL static cs_bool WriteInfo(World *world, cs_file fp) {
-	return File_Write((void *)&(cs_int32){WORLD_MAGIC}, 4, 1, fp) &&
+INL static cs_bool WriteInfo(World *world, cs_file fp, cs_uint32 magic) {
+	return File_Write(&magic, 4, 1, fp) &&
 	_WriteWData(fp, WDAT_DIMENSIONS, world->info.dimensions) &&
 	_WriteWData(fp, WDAT_SPAWNVEC, world->info.spawnVec) &&
 	_WriteWData(fp, WDAT_SPAWNANG, world->info.spawnAng) &&
@@ -308,17 +901,27 @@ INL static cs_bool WriteInfo(World *world, cs_file fp) {
 
 #define ReadWData(F, P) File_Read(&P, sizeof(P), 1, F)
 
-static cs_bool ReadInfo(World *world, cs_file fp) {
+static cs_bool ReadInfo(World *world, cs_file fp, cs_bool *framed) {
 	cs_byte id = 0;
 	cs_uint32 magic = 0;
 	if(!File_Read(&magic, 4, 1, fp))
 		return false;
 
-	if(WORLD_MAGIC != magic) {
+	// В заголовке второй версии ещё не было смещения
+	// таблицы регионов, такие файлы не прочитать
+	if(WORLD_MAGIC_V2 == magic) {
+		world->error.code = WORLD_ERROR_INFOREAD;
+		world->error.extra = WORLD_EXTRA_UNKNOWN_VERSION;
+		return false;
+	}
+
+	if(WORLD_MAGIC != magic && WORLD_MAGIC_V3 != magic) {
 		world->error.code = WORLD_ERROR_INFOREAD;
 		return false;
 	}
 
+	*framed = magic == WORLD_MAGIC_V3;
+
 	SVec dims;
 	while(File_Read(&id, 1, 1, fp) == 1) {
 		switch (id) {
@@ -371,36 +974,665 @@ static cs_bool ReadInfo(World *world, cs_file fp) {
 
 #define CHUNK_SIZE 16384
 
+// Поток сохранения читает блоки из снимка, сделанного
+// в World_Save, так что игроки могут менять мир, пока
+// он сохраняется, не ломая целостность файла
+INL static void ReadSaveBlocks(World *world, cs_uint32 offset, cs_byte *dst, cs_uint32 count) {
+	if(world->snaps.save)
+		World_ReadSnapshot(world->snaps.save, offset, dst, count);
+	else
+		Memory_Copy(dst, world->wdata.blocks + offset, count);
+}
+
+INL static void ReleaseSaveSnapshot(World *world) {
+	if(world->snaps.save) {
+		World_ReleaseSnapshot(world->snaps.save);
+		world->snaps.save = NULL;
+	}
+}
+
+// Блоки мира лежат в памяти целиком, поэтому их
+// выгоднее сжать за один вызов (и сразу на всех
+// ядрах), чем гонять zlib кусками в одном потоке
+INL static cs_bool WriteWhole(cs_byte *wdata, cs_uint32 wsize, cs_file fp, cs_bool *written) {
+	cs_uint32 bound, size;
+	*written = false;
+
+	if((bound = Compr_Bound(wsize)) == 0)
+		return false;
+
+	cs_byte *out = Memory_TryAlloc(1, bound);
+	if(!out) return false;
+
+	size = Compr_Parallel(COMPR_TYPE_GZIP, Compr_GetLevel(COMPR_USE_SAVE), wdata, wsize, out, bound, NULL, NULL);
+	if(size > 0) *written = File_Write(out, 1, size, fp) == size;
+	Memory_Free(out);
+	return size > 0;
+}
+
+static ComprCodec SaveCodec = COMPR_CODEC_GZIP;
+
+void World_SetSaveCodec(ComprCodec codec) {
+	SaveCodec = codec;
+}
+
+/*
+ * Формат третьей версии: после заголовка идут кодек,
+ * размер несжатого региона, количество регионов и
+ * смещение таблицы регионов. Таблица (смещения и
+ * размеры сжатых регионов) лежит после самих регионов.
+ * Каждый регион сжат независимо, поэтому при сохранении
+ * можно дописать в конец файла только изменённые регионы
+ * и новую таблицу, а затем переписать заголовок.
+*/
+INL static void FreeRegionTable(World *world) {
+	struct _WorldRegions *wr = &world->regions;
+	if(wr->offsets) {
+		Memory_Free(wr->offsets);
+		wr->offsets = NULL;
+	}
+	if(wr->sizes) {
+		Memory_Free(wr->sizes);
+		wr->sizes = NULL;
+	}
+	wr->live = wr->end = 0;
+}
+
+static void SetRegionTable(World *world, ComprCodec codec, cs_uint64 *offsets, cs_uint32 *sizes, cs_uint64 end) {
+	struct _WorldRegions *wr = &world->regions;
+	FreeRegionTable(world);
+	wr->codec = codec;
+	wr->offsets = offsets;
+	wr->sizes = sizes;
+	wr->end = end;
+	for(cs_uint32 i = 0; i < wr->count; i++)
+		wr->live += sizes[i];
+}
+
+INL static cs_uint64 RegionTableSize(cs_uint32 count) {
+	return (cs_uint64)count * (sizeof(cs_uint64) + sizeof(cs_uint32));
+}
+
+static cs_bool WriteRegionHeader(World *world, cs_file fp, ComprCodec codec,
+	cs_uint32 framesize, cs_uint32 count, cs_uint64 tableoff) {
+	cs_byte codecid = (cs_byte)codec;
+	return WriteInfo(world, fp, WORLD_MAGIC_V3) &&
+	File_Write(&codecid, 1, 1, fp) == 1 &&
+	File_Write(&framesize, 4, 1, fp) == 1 &&
+	File_Write(&count, 4, 1, fp) == 1 &&
+	File_Write(&tableoff, 8, 1, fp) == 1;
+}
+
+INL static cs_bool WriteRegionTable(cs_file fp, cs_uint64 *offsets, cs_uint32 *sizes, cs_uint32 count) {
+	return File_Write(offsets, sizeof(cs_uint64), count, fp) == count &&
+	File_Write(sizes, sizeof(cs_uint32), count, fp) == count;
+}
+
+static cs_bool WriteFrames(World *world, cs_file fp, ComprCodec codec) {
+	cs_uint32 wsize = world->wdata.size, fbound, count = world->regions.count;
+	cs_uint32 framesize = min(wsize, WORLD_FRAME_SIZE);
+	cs_uint64 *offsets = NULL, end;
+	cs_byte *in = NULL, *out = NULL;
+	cs_bool ok = false;
+	cs_long pos;
+
+	world->error.code = WORLD_ERROR_COMPR;
+	world->error.extra = WORLD_EXTRA_COMPR_INIT;
+	if(count == 0 || (fbound = Compr_FrameBound(codec, framesize)) == 0)
+		return false;
+
+	cs_uint32 *sizes = Memory_TryAlloc(count, sizeof(cs_uint32));
+	if(!sizes || (offsets = Memory_TryAlloc(count, sizeof(cs_uint64))) == NULL ||
+		(in = Memory_TryAlloc(REGION_BATCH, framesize)) == NULL ||
+		(out = Memory_TryAlloc(REGION_BATCH, fbound)) == NULL)
+		goto done;
+
+	world->error.code = WORLD_ERROR_IOFAIL;
+	world->error.extra = WORLD_EXTRA_IO_WRITE;
+	if(!WriteRegionHeader(world, fp, codec, framesize, count, 0) ||
+		(pos = File_Seek(fp, 0, SEEK_CUR)) < 0)
+		goto done;
+
+	end = (cs_uint64)pos;
+	for(cs_uint32 i = 0; i < count; i += REGION_BATCH) {
+		cs_uint32 n = min(count - i, REGION_BATCH), start = i * framesize,
+		insize = min(wsize - start, n * framesize);
+		ReadSaveBlocks(world, start, in, insize);
+		if(!Compr_CompressFrames(codec, Compr_GetLevel(COMPR_USE_SAVE), in, insize, framesize, out, sizes + i)) {
+			world->error.code = WORLD_ERROR_COMPR;
+			world->error.extra = WORLD_EXTRA_COMPR_PROC;
+			goto done;
+		}
+
+		for(cs_uint32 j = 0; j < n; j++) {
+			if(File_Write(out + (cs_size)j * fbound, 1, sizes[i + j], fp) != sizes[i + j])
+				goto done;
+			offsets[i + j] = end;
+			end += sizes[i + j];
+		}
+	}
+
+	// Смещение таблицы становится известно только
+	// после записи регионов, поэтому дописываем его
+	// в конец заголовка отдельно
+	if(!WriteRegionTable(fp, offsets, sizes, count) ||
+		File_Seek(fp, pos - 8, SEEK_SET) < 0 ||
+		File_Write(&end, 8, 1, fp) != 1)
+		goto done;
+
+	SetRegionTable(world, codec, offsets, sizes, end + RegionTableSize(count));
+	offsets = NULL, sizes = NULL;
+	world->error.code = WORLD_ERROR_SUCCESS;
+	world->error.extra = WORLD_EXTRA_NOINFO;
+	ok = true;
+
+	done:
+	if(offsets) Memory_Free(offsets);
+	if(sizes) Memory_Free(sizes);
+	if(in) Memory_Free(in);
+	if(out) Memory_Free(out);
+	return ok;
+}
+
+// Дописывает в конец файла только изменённые регионы.
+// Заголовок переписывается последним, до этого момента
+// файл целиком ссылается на старую таблицу регионов.
+static cs_bool UpdateFrames(World *world, ComprCodec codec, cs_str path) {
+	struct _WorldRegions *wr = &world->regions;
+	if(!wr->offsets || wr->codec != codec) return false;
+	// Мёртвых регионов больше, чем живых, пора переписать файл целиком
+	if(wr->end - wr->live > wr->live) return false;
+
+	cs_uint32 wsize = world->wdata.size, fbound, count = wr->count;
+	cs_uint32 framesize = min(wsize, WORLD_FRAME_SIZE);
+	if((fbound = Compr_FrameBound(codec, framesize)) == 0)
+		return false;
+
+	cs_uint64 *offsets = Memory_TryAlloc(count, sizeof(cs_uint64)), end = wr->end;
+	cs_uint32 *sizes = Memory_TryAlloc(count, sizeof(cs_uint32));
+	cs_byte *in = Memory_TryAlloc(REGION_BATCH, framesize),
+	*out = Memory_TryAlloc(REGION_BATCH, fbound);
+	cs_file fp = NULL;
+	cs_bool ok = false;
+
+	if(!offsets || !sizes || !in || !out) goto done;
+	Memory_Copy(offsets, wr->offsets, count * sizeof(cs_uint64));
+	Memory_Copy(sizes, wr->sizes, count * sizeof(cs_uint32));
+	if((fp = File_Open(path, "r+b")) == NULL) goto done;
+	if(File_Seek(fp, (cs_long)end, SEEK_SET) < 0) goto done;
+
+	for(cs_uint32 i = 0; i < count;) {
+		if(!REGION_ISSET(wr->saving, i)) {
+			i++;
+			continue;
+		}
+
+		cs_uint32 n = 1;
+		while(n < REGION_BATCH && i + n < count && REGION_ISSET(wr->saving, i + n)) n++;
+		cs_uint32 start = i * framesize, insize = min(wsize - start, n * framesize);
+		ReadSaveBlocks(world, start, in, insize);
+		if(!Compr_CompressFrames(codec, Compr_GetLevel(COMPR_USE_SAVE), in, insize, framesize, out, sizes + i))
+			goto done;
+
+		for(cs_uint32 j = 0; j < n; j++) {
+			if(File_Write(out + (cs_size)j * fbound, 1, sizes[i + j], fp) != sizes[i + j])
+				goto done;
+			offsets[i + j] = end;
+			end += sizes[i + j];
+		}
+
+		i += n;
+	}
+
+	if(!WriteRegionTable(fp, offsets, sizes, count) || !File_Flush(fp) ||
+		File_Seek(fp, 0, SEEK_SET) != 0 ||
+		!WriteRegionHeader(world, fp, codec, framesize, count, end) ||
+		!File_Flush(fp))
+		goto done;
+
+	SetRegionTable(world, codec, offsets, sizes, end + RegionTableSize(count));
+	offsets = NULL, sizes = NULL;
+	ok = true;
+
+	done:
+	if(fp) File_Close(fp);
+	if(offsets) Memory_Free(offsets);
+	if(sizes) Memory_Free(sizes);
+	if(in) Memory_Free(in);
+	if(out) Memory_Free(out);
+	return ok;
+}
+
+/*
+ * Журнал изменений блоков: заголовок (магическое число,
+ * размер массива блоков и контрольная сумма файла мира,
+ * поверх которого пишется журнал), за ним записи по 6 байт -
+ * смещение блока, старый и новый идентификатор. Записи копятся
+ * в буфере и сбрасываются в файл раз в тик, поэтому при падении
+ * сервера теряется не больше одного тика изменений.
+*/
+#define JOURNAL_RECORD 6
+#define JOURNAL_HEADER 16
+#define JOURNAL_BUFFER (JOURNAL_RECORD * 4096)
+
+typedef struct _JournalHeader {
+	cs_uint32 magic, size;
+	cs_uint64 base;
+} JournalHeader;
+
+static cs_bool JournalEnabled = false;
+
+void World_SetJournal(cs_bool state) {
+	JournalEnabled = state;
+}
+
+/*
+ * Контрольная сумма файла мира складывается из сумм его
+ * регионов, так что после сохранения пересчитываются
+ * только записанные регионы. По ней журнал, оставшийся
+ * от другого мира того же размера, не применится к этому.
+*/
+#define SUM_BASIS 0xCBF29CE484222325ull
+#define SUM_PRIME 0x100000001B3ull
+
+static cs_uint64 SumBlocks(const BlockID *data, cs_uint32 size) {
+	cs_uint64 sum = SUM_BASIS;
+	cs_uint32 i = 0;
+	for(; i + 8 <= size; i += 8)
+		sum = (sum ^ *(const cs_uint64 *)(data + i)) * SUM_PRIME;
+	for(; i < size; i++)
+		sum = (sum ^ data[i]) * SUM_PRIME;
+	return sum;
+}
+
+INL static cs_uint64 FoldSums(World *world) {
+	struct _WorldRegions *wr = &world->regions;
+	cs_uint64 sum = (SUM_BASIS ^ world->wdata.size) * SUM_PRIME;
+	for(cs_uint32 i = 0; i < wr->count; i++)
+		sum = (sum ^ wr->sums[i]) * SUM_PRIME;
+	return sum;
+}
+
+INL static void FreeSums(World *world) {
+	if(world->regions.sums) {
+		Memory_Free(world->regions.sums);
+		world->regions.sums = NULL;
+	}
+}
+
+// Считает суммы регионов, только что прочитанных из файла
+static void SumLoadedBlocks(World *world) {
+	struct _WorldRegions *wr = &world->regions;
+	if(!wr->sums && (wr->sums = Memory_TryAlloc(wr->count, sizeof(cs_uint64))) == NULL)
+		return;
+
+	for(cs_uint32 i = 0; i < wr->count; i++) {
+		cs_uint32 start = i << WORLD_REGION_SHIFT;
+		wr->sums[i] = SumBlocks(world->wdata.blocks + start, min(world->wdata.size - start, WORLD_FRAME_SIZE));
+	}
+	world->journal.base = FoldSums(world);
+}
+
+// Пересчитывает суммы регионов, записанных сохранением.
+// Вызывается потоком сохранения после записи файла.
+static cs_uint64 SumSavedBlocks(World *world) {
+	struct _WorldRegions *wr = &world->regions;
+	cs_bool all = wr->sums == NULL;
+	cs_byte *region = NULL;
+
+	if((all && (wr->sums = Memory_TryAlloc(wr->count, sizeof(cs_uint64))) == NULL) ||
+		(region = Memory_TryAlloc(1, WORLD_FRAME_SIZE)) == NULL) {
+		// Без сумм журнал не применится при загрузке,
+		// зато и не ляжет поверх чужого файла
+		FreeSums(world);
+		return 0;
+	}
+
+	for(cs_uint32 i = 0; i < wr->count; i++) {
+		if(!all && !REGION_ISSET(wr->saving, i)) continue;
+		cs_uint32 start = i << WORLD_REGION_SHIFT,
+		size = min(world->wdata.size - start, WORLD_FRAME_SIZE);
+		ReadSaveBlocks(world, start, region, size);
+		wr->sums[i] = SumBlocks(region, size);
+	}
+
+	Memory_Free(region);
+	return FoldSums(world);
+}
+
+INL static void JournalPath(World *world, cs_char *path, cs_str ext) {
+	String_FormatBuf(path, MAX_PATH_LEN, "worlds" PATH_DELIM "%s.%s", world->name, ext);
+}
+
+INL static cs_bool WriteJournalHeader(World *world, cs_file fp) {
+	JournalHeader header = {
+		.magic = WORLD_JOURNAL_MAGIC,
+		.size = world->wdata.size,
+		.base = world->journal.base
+	};
+	return File_Write(&header, sizeof(header), 1, fp) == 1;
+}
+
+// Заменяет журнал его частью [from, to) через временный файл,
+// чтобы падение посреди обрезки не потеряло нужные записи.
+// Вызывается с захваченным мьютексом журнала.
+static cs_bool RewriteJournal(World *world, cs_uint64 from, cs_uint64 to) {
+	struct _WorldJournal *wj = &world->journal;
+	cs_char path[MAX_PATH_LEN], tmpname[MAX_PATH_LEN];
+	cs_byte chunk[4096];
+	cs_bool ok = false;
+	JournalPath(world, path, "cwj");
+	JournalPath(world, tmpname, "cwj.tmp");
+
+	cs_file src = File_Open(path, "rb"), dst = File_Open(tmpname, "wb");
+	if(src && dst && File_Seek(src, (cs_long)from, SEEK_SET) >= 0 && WriteJournalHeader(world, dst)) {
+		cs_uint64 left = to - from;
+		ok = true;
+		while(left > 0) {
+			cs_size n = (cs_size)min(left, sizeof(chunk));
+			if(File_Read(chunk, 1, n, src) != n || File_Write(chunk, 1, n, dst) != n) {
+				ok = false;
+				break;
+			}
+			left -= n;
+		}
+	}
+
+	if(src) File_Close(src);
+	if(dst) File_Close(dst);
+	if(!ok) return false;
+
+	if(wj->fp) {
+		File_Close(wj->fp);
+		wj->fp = NULL;
+	}
+
+	if(!File_Rename(tmpname, path) || (wj->fp = File_Open(path, "ab")) == NULL)
+		return false;
+
+	wj->written = JOURNAL_HEADER + (to - from);
+	if(wj->mark > wj->written) wj->mark = wj->written;
+	return true;
+}
+
+// Вызывается с захваченным мьютексом журнала. Журнал,
+// уже открывавшийся для этого мира, открывается заново
+// на дозапись, а не перезаписывается с нуля.
+static cs_bool OpenJournal(World *world, cs_bool append) {
+	struct _WorldJournal *wj = &world->journal;
+	cs_char path[MAX_PATH_LEN];
+	JournalPath(world, path, "cwj");
+	Directory_Ensure("worlds");
+
+	if(append && (wj->fp = File_Open(path, "ab")) != NULL) {
+		cs_long size = File_Seek(wj->fp, 0, SEEK_END);
+		if(size >= JOURNAL_HEADER) {
+			cs_uint64 good = wj->written;
+			wj->written = (cs_uint64)size;
+			if(wj->mark > wj->written) wj->mark = wj->written;
+			// Неудавшаяся запись могла оставить в конце файла
+			// обрывок, его нужно отрезать до последней целой записи
+			if(good >= JOURNAL_HEADER && good < wj->written &&
+				!RewriteJournal(world, JOURNAL_HEADER, good)) {
+				if(wj->fp) File_Close(wj->fp);
+				wj->fp = NULL;
+				wj->written = good;
+				return false;
+			}
+			return true;
+		}
+		File_Close(wj->fp);
+	}
+
+	if((wj->fp = File_Open(path, "wb")) == NULL)
+		return false;
+	if(!WriteJournalHeader(world, wj->fp) || !File_Flush(wj->fp)) {
+		File_Close(wj->fp);
+		wj->fp = NULL;
+		return false;
+	}
+
+	wj->written = JOURNAL_HEADER;
+	wj->mark = 0;
+	return true;
+}
+
+void World_FlushJournal(World *world) {
+	struct _WorldJournal *wj = &world->journal;
+	if(wj->used == 0) return;
+
+	Mutex_Lock(wj->mutex);
+	if(wj->fp || OpenJournal(world, wj->written > 0)) {
+		if(File_Write(wj->buffer, 1, wj->used, wj->fp) == wj->used && File_Flush(wj->fp)) {
+			wj->written += wj->used;
+			wj->used = 0;
+		} else {
+			// Записи остаются в буфере, а обрывок, который
+			// успел попасть в файл, отрежется при следующей попытке
+			File_Close(wj->fp);
+			wj->fp = NULL;
+		}
+	}
+	Mutex_Unlock(wj->mutex);
+}
+
+/*
+ * Журнал с пропуском восстановил бы состояние мира,
+ * которого никогда не было, поэтому после потери записи
+ * он больше не пополняется. Записанное до пропуска
+ * остаётся в файле, а следующее сохранение начинает
+ * журнал заново.
+*/
+static void BreakJournal(World *world) {
+	struct _WorldJournal *wj = &world->journal;
+	if(!wj->broken) Log_Warn(Sstor_Get("WJ_BROKEN"), world->name);
+	wj->broken = true;
+	wj->used = 0;
+}
+
+// Сохранение захватит все изменения, которые не попали в
+// журнал. До его окончания у нового журнала нет контрольной
+// суммы файла, и при загрузке он не применяется
+static void RestartJournal(World *world) {
+	struct _WorldJournal *wj = &world->journal;
+	if(!wj->broken) return;
+	Mutex_Lock(wj->mutex);
+	if(wj->fp) {
+		File_Close(wj->fp);
+		wj->fp = NULL;
+	}
+	wj->base = 0;
+	if(OpenJournal(world, false)) wj->broken = false;
+	Mutex_Unlock(wj->mutex);
+}
+
+INL static void JournalBlock(World *world, cs_uint32 offset, BlockID old, BlockID id) {
+	struct _WorldJournal *wj = &world->journal;
+	if(!JournalEnabled || wj->broken || old == id || World_IsInMemory(world)) return;
+	if(!wj->buffer && (wj->buffer = Memory_TryAlloc(1, JOURNAL_BUFFER)) == NULL) {
+		BreakJournal(world);
+		return;
+	}
+	if(wj->used == JOURNAL_BUFFER) {
+		World_FlushJournal(world);
+		if(wj->used == JOURNAL_BUFFER) {
+			BreakJournal(world);
+			return;
+		}
+	}
+
+	cs_byte *rec = wj->buffer + wj->used;
+	Memory_Copy(rec, &offset, sizeof(offset));
+	rec[4] = old, rec[5] = id;
+	wj->used += JOURNAL_RECORD;
+}
+
+static void CloseJournal(World *world) {
+	struct _WorldJournal *wj = &world->journal;
+	World_FlushJournal(world);
+	if(wj->buffer) {
+		Memory_Free(wj->buffer);
+		wj->buffer = NULL;
+	}
+	Mutex_Lock(wj->mutex);
+	if(wj->fp) {
+		File_Close(wj->fp);
+		wj->fp = NULL;
+	}
+	wj->used = 0;
+	wj->written = wj->mark = 0;
+	wj->base = 0;
+	wj->broken = false;
+	Mutex_Unlock(wj->mutex);
+}
+
+// Записи до отметки уже попали в сохранённый файл, а
+// заголовок получает контрольную сумму нового файла
+static void TrimJournal(World *world, cs_uint64 base) {
+	struct _WorldJournal *wj = &world->journal;
+	Mutex_Lock(wj->mutex);
+	wj->base = base;
+	if(wj->fp || (wj->written > 0 && OpenJournal(world, true))) {
+		cs_uint64 from = min(max(wj->mark, JOURNAL_HEADER), wj->written);
+		RewriteJournal(world, from, wj->written);
+	}
+	wj->mark = 0;
+	Mutex_Unlock(wj->mutex);
+}
+
+static void ReplayJournal(World *world) {
+	struct _WorldJournal *wj = &world->journal;
+	cs_char path[MAX_PATH_LEN];
+	JournalHeader header = {0};
+	cs_byte recs[JOURNAL_RECORD * 256];
+	cs_uint32 count = 0;
+	cs_size n;
+
+	JournalPath(world, path, "cwj");
+	cs_file fp = File_Open(path, "rb");
+	if(!fp) return;
+
+	if(File_Read(&header, sizeof(header), 1, fp) != 1 ||
+		header.magic != WORLD_JOURNAL_MAGIC || header.size != world->wdata.size ||
+		header.base == 0 || header.base != wj->base) {
+		// Журнал от другого мира либо начатый заново и не
+		// дождавшийся конца сохранения, он будет перезаписан
+		File_Close(fp);
+		return;
+	}
+
+	while((n = File_Read(recs, JOURNAL_RECORD, 256, fp)) > 0) {
+		for(cs_size i = 0; i < n; i++) {
+			cs_byte *rec = recs + i * JOURNAL_RECORD;
+			cs_uint32 offset;
+			Memory_Copy(&offset, rec, sizeof(offset));
+			if(offset >= world->wdata.size) continue;
+			world->wdata.blocks[offset] = rec[5];
+			MarkRegion(world, offset);
+		}
+		count += (cs_uint32)n;
+	}
+	File_Close(fp);
+
+	if(count > 0 && !ISSET(world->flags, WORLD_FLAG_MODIGNORE))
+		world->flags |= WORLD_FLAG_MODIFIED;
+
+	// Оборванная при падении запись отрезается, иначе
+	// новые записи легли бы в журнал со сдвигом
+	Mutex_Lock(wj->mutex);
+	cs_uint64 valid = JOURNAL_HEADER + (cs_uint64)count * JOURNAL_RECORD;
+	if(OpenJournal(world, true) && wj->written != valid)
+		RewriteJournal(world, JOURNAL_HEADER, valid);
+	Mutex_Unlock(wj->mutex);
+}
+
+// Регионы, отмеченные для этого сохранения, уже сброшены,
+// так что после ошибки следующее сохранение будет полным
+INL static void SaveFailed(World *world) {
+	ReleaseSaveSnapshot(world);
+	FreeSums(world);
+	FreeRegionTable(world);
+	world->flags |= WORLD_FLAG_MODIFIED;
+	World_Unlock(world);
+}
+
 THREAD_FUNC(WorldSaveThread) {
 	World *world = (World *)param;
+	ComprCodec codec = SaveCodec;
 	cs_uint32 wsize = 0;
+	cs_byte *blocks = NULL;
 	cs_bool compr_ok;
 
-	if((compr_ok = Compr_Init(&world->compr, COMPR_TYPE_GZIP)) == false) {
-		world->error.code = WORLD_ERROR_COMPR;
-		world->error.extra = WORLD_EXTRA_COMPR_INIT;
+	if(codec != COMPR_CODEC_GZIP && !Compr_HasCodec(codec))
+		codec = COMPR_CODEC_GZIP;
+
+	cs_char path[MAX_PATH_LEN], tmpname[MAX_PATH_LEN], out[CHUNK_SIZE];
+	String_FormatBuf(path, MAX_PATH_LEN, "worlds" PATH_DELIM "%s.cws", world->name);
+	String_FormatBuf(tmpname, MAX_PATH_LEN, "worlds" PATH_DELIM "%s.tmp", world->name);
+
+	if(codec != COMPR_CODEC_GZIP && UpdateFrames(world, codec, path)) {
+		TrimJournal(world, JournalEnabled ? SumSavedBlocks(world) : 0);
+		ReleaseSaveSnapshot(world);
+		world->error.code = WORLD_ERROR_SUCCESS;
+		world->error.extra = WORLD_EXTRA_NOINFO;
 		World_Unlock(world);
 		return 0;
 	}
 
-	cs_byte *wdata = World_GetBlockArray(world, &wsize);
-	Compr_SetInBuffer(&world->compr, wdata, wsize);
+	// Дальше файл переписывается целиком
+	FreeRegionTable(world);
 
-	cs_char path[MAX_PATH_LEN], tmpname[MAX_PATH_LEN], out[CHUNK_SIZE];
-	String_FormatBuf(path, MAX_PATH_LEN, "worlds" PATH_DELIM "%s.cws", world->name);
-	String_FormatBuf(tmpname, MAX_PATH_LEN, "worlds" PATH_DELIM "%s.tmp", world->name);
+	if(codec == COMPR_CODEC_GZIP) {
+		// gzip сжимает массив целиком, так что снимок
+		// приходится собрать в отдельный буфер
+		wsize = world->wdata.size;
+		if(world->snaps.save) {
+			if((blocks = Memory_TryAlloc(1, wsize)) == NULL) {
+				world->error.code = WORLD_ERROR_COMPR;
+				world->error.extra = WORLD_EXTRA_COMPR_INIT;
+				SaveFailed(world);
+				return 0;
+			}
+			ReadSaveBlocks(world, 0, blocks, wsize);
+		}
+	}
 
 	Directory_Ensure("worlds");
 	cs_file fp = File_Open(tmpname, "wb");
 	if(!fp) {
 		world->error.code = WORLD_ERROR_IOFAIL;
 		world->error.extra = WORLD_EXTRA_IO_OPEN;
-		Compr_Reset(&world->compr);
-		World_Unlock(world);
+		if(blocks) Memory_Free(blocks);
+		SaveFailed(world);
 		return 0;
 	}
 
-	if((compr_ok = WriteInfo(world, fp)) == true) {
+	cs_bool whole_ok = false;
+	cs_byte *wdata = blocks ? blocks : world->wdata.blocks;
+	if(codec != COMPR_CODEC_GZIP) {
+		world->error.code = WORLD_ERROR_IOFAIL;
+		world->error.extra = WORLD_EXTRA_IO_WRITE;
+		if(!WriteFrames(world, fp, codec)) {
+			File_Close(fp);
+			SaveFailed(world);
+			return 0;
+		}
+		compr_ok = true;
+	} else if((compr_ok = WriteInfo(world, fp, WORLD_MAGIC)) == false) {
+		world->error.code = WORLD_ERROR_IOFAIL;
+		world->error.extra = WORLD_EXTRA_IO_WRITE;
+	} else if(WriteWhole(wdata, wsize, fp, &whole_ok)) {
+		if(!whole_ok) {
+			world->error.code = WORLD_ERROR_IOFAIL;
+			world->error.extra = WORLD_EXTRA_IO_WRITE;
+			compr_ok = false;
+		}
+	} else if((compr_ok = Compr_InitLevel(&world->compr, COMPR_TYPE_GZIP, Compr_GetLevel(COMPR_USE_SAVE))) == false) {
+		// Потоковый zlib нужен, только если не вышло сжать массив целиком
+		world->error.code = WORLD_ERROR_COMPR;
+		world->error.extra = WORLD_EXTRA_COMPR_INIT;
+	} else {
+		Compr_SetInBuffer(&world->compr, wdata, wsize);
 		do {
 			Compr_SetOutBuffer(&world->compr, out, CHUNK_SIZE);
 			if((compr_ok = Compr_Update(&world->compr)) == true) {
@@ -412,27 +1644,27 @@ THREAD_FUNC(WorldSaveThread) {
 				}
 			} else break;
 		} while(world->compr.state != COMPR_STATE_DONE);
-	} else {
-		world->error.code = WORLD_ERROR_IOFAIL;
-		world->error.extra = WORLD_EXTRA_IO_WRITE;
 		Compr_Reset(&world->compr);
-		File_Close(fp);
-		World_Unlock(world);
-		return 0;
 	}
 
 	File_Close(fp);
-	Compr_Reset(&world->compr);
-	if(compr_ok && !File_Rename(tmpname, path)) {
+	if(blocks) Memory_Free(blocks);
+	if(!compr_ok) {
+		SaveFailed(world);
+		return 0;
+	}
+
+	if(!File_Rename(tmpname, path)) {
 		world->error.code = WORLD_ERROR_IOFAIL;
 		world->error.extra = WORLD_EXTRA_IO_RENAME;
-		World_Unlock(world);
+		SaveFailed(world);
 		return 0;
 	}
 
+	TrimJournal(world, JournalEnabled ? SumSavedBlocks(world) : 0);
+	ReleaseSaveSnapshot(world);
 	world->error.code = WORLD_ERROR_SUCCESS;
 	world->error.extra = WORLD_EXTRA_NOINFO;
-	world->flags &= ~WORLD_FLAG_MODIFIED;
 	World_Unlock(world);
 	return 0;
 }
@@ -480,6 +1712,17 @@ void World_SetInMemory(World *world, cs_bool state) {
 		world->flags &= ~WORLD_FLAG_INMEMORY;
 }
 
+cs_bool World_SetBackend(World *world, EWorldBackend backend) {
+	// Инстансы получаются только через World_CloneFrom
+	if(backend >= WORLD_BACKEND_INSTANCE) return false;
+	world->wdata.backend = backend;
+	return true;
+}
+
+EWorldBackend World_GetBackend(World *world) {
+	return world->wdata.backend;
+}
+
 void World_SetIgnoreModifications(World *world, cs_bool state) {
 	if(state)
 		world->flags |= WORLD_FLAG_MODIGNORE;
@@ -494,10 +1737,30 @@ cs_bool World_Save(World *world) {
 		return false;
 	}
 
+	// Выгруженный мир без изменений сохранять не нужно
 	if(!World_IsModified(world))
-		return World_IsReadyToPlay(world);
+		return true;
+
+	// Поток сохранения читает плоский массив
+	if(!World_UnpackBlocks(world)) {
+		world->error.code = WORLD_ERROR_COMPR;
+		world->error.extra = WORLD_EXTRA_COMPR_PROC;
+		return false;
+	}
 
 	World_Lock(world, 0);
+	// Изменения, сделанные во время сохранения,
+	// попадут уже в следующее сохранение
+	world->flags &= ~WORLD_FLAG_MODIFIED;
+	struct _WorldRegions *wr = &world->regions;
+	if(wr->dirty) {
+		Memory_Copy(wr->saving, wr->dirty, REGION_BYTES(wr->count));
+		Memory_Zero(wr->dirty, REGION_BYTES(wr->count));
+	}
+	World_FlushJournal(world);
+	RestartJournal(world);
+	world->journal.mark = world->journal.written;
+	world->snaps.save = World_TakeSnapshot(world);
 	Thread_Create(WorldSaveThread, world, true);
 	return true;
 }
@@ -514,6 +1777,85 @@ EWorldError World_PopError(World *world, EWorldExtra *extra) {
 	return code;
 }
 
+static void ReadFrames(World *world, cs_file fp) {
+	cs_byte codecid = 0;
+	cs_uint32 framesize = 0, count = 0, wsize = 0, fbound;
+	cs_uint64 tableoff = 0, total = 0, *offsets = NULL;
+	cs_uint32 *sizes = NULL;
+	cs_byte *in = NULL;
+	cs_byte *data = World_GetBlockArray(world, &wsize);
+
+	world->error.code = WORLD_ERROR_DATAREAD;
+	world->error.extra = WORLD_EXTRA_NOINFO;
+	if(ReadWData(fp, codecid) != 1 || ReadWData(fp, framesize) != 1 ||
+		ReadWData(fp, count) != 1 || ReadWData(fp, tableoff) != 1 ||
+		framesize == 0 || count != (wsize + framesize - 1) / framesize)
+		return;
+
+	if((fbound = Compr_FrameBound((ComprCodec)codecid, framesize)) == 0) {
+		world->error.code = WORLD_ERROR_COMPR;
+		world->error.extra = WORLD_EXTRA_COMPR_INIT;
+		return;
+	}
+
+	sizes = Memory_TryAlloc(count, sizeof(cs_uint32));
+	offsets = Memory_TryAlloc(count, sizeof(cs_uint64));
+	if(!sizes || !offsets || File_Seek(fp, (cs_long)tableoff, SEEK_SET) < 0 ||
+		File_Read(offsets, sizeof(cs_uint64), count, fp) != count ||
+		File_Read(sizes, sizeof(cs_uint32), count, fp) != count)
+		goto done;
+
+	for(cs_uint32 i = 0; i < count; i++) {
+		if(sizes[i] > fbound || offsets[i] + sizes[i] > tableoff) goto done;
+		total += sizes[i];
+	}
+
+	if(total > 0xFFFFFFFFu || (in = Memory_TryAlloc(1, (cs_size)total)) == NULL)
+		goto done;
+
+	// После полного сохранения регионы лежат подряд и читаются
+	// одним потоком, после частичных сохранений приходится
+	// переходить к дописанным в конец файла регионам
+	cs_uint64 pos = (cs_uint64)-1, inpos = 0;
+	for(cs_uint32 i = 0; i < count; i++) {
+		if(offsets[i] != pos && File_Seek(fp, (cs_long)offsets[i], SEEK_SET) < 0)
+			goto done;
+		if(File_Read(in + inpos, 1, sizes[i], fp) != sizes[i])
+			goto done;
+		pos = offsets[i] + sizes[i];
+		inpos += sizes[i];
+	}
+
+	if(!Compr_DecompressFrames((ComprCodec)codecid, in, (cs_uint32)total, sizes, framesize, data, wsize)) {
+		world->error.code = WORLD_ERROR_COMPR;
+		world->error.extra = WORLD_EXTRA_COMPR_PROC;
+		goto done;
+	}
+
+	// Файл с другим размером региона загрузится,
+	// но при следующем сохранении будет переписан
+	if(framesize == min(wsize, WORLD_FRAME_SIZE)) {
+		SetRegionTable(world, (ComprCodec)codecid, offsets, sizes, tableoff + RegionTableSize(count));
+		offsets = NULL, sizes = NULL;
+	}
+
+	world->error.code = WORLD_ERROR_SUCCESS;
+
+	done:
+	if(offsets) Memory_Free(offsets);
+	if(sizes) Memory_Free(sizes);
+	if(in) Memory_Free(in);
+}
+
+// Мир, прочитанный не до конца, нельзя ни отдавать
+// игрокам, ни сохранять поверх исправного файла
+static void LoadFinished(World *world) {
+	if(world->error.code != WORLD_ERROR_SUCCESS)
+		World_FreeBlockArray(world);
+	world->loading = false;
+	World_Unlock(world);
+}
+
 THREAD_FUNC(WorldLoadThread) {
 	World *world = (World *)param;
 	cs_bool compr_ok;
@@ -521,7 +1863,7 @@ THREAD_FUNC(WorldLoadThread) {
 	if((compr_ok = Compr_Init(&world->compr, COMPR_TYPE_UNGZIP)) == false) {
 		world->error.code = WORLD_ERROR_COMPR;
 		world->error.extra = WORLD_EXTRA_COMPR_INIT;
-		World_Unlock(world);
+		LoadFinished(world);
 		return 0;
 	}
 
@@ -533,60 +1875,120 @@ THREAD_FUNC(WorldLoadThread) {
 		world->error.code = WORLD_ERROR_IOFAIL;
 		world->error.extra = WORLD_EXTRA_IO_OPEN;
 		Compr_Reset(&world->compr);
-		World_Unlock(world);
+		LoadFinished(world);
 		return 0;
 	}
 
-	if(ReadInfo(world, fp)) {
-		cs_uint32 wsize = 0;
-		cs_byte in[CHUNK_SIZE];
+	cs_bool framed = false;
+	if(ReadInfo(world, fp, &framed)) {
 		World_AllocBlockArray(world);
-		cs_byte *data = World_GetBlockArray(world, &wsize);
-		Compr_SetOutBuffer(&world->compr, data, wsize);
-		cs_uint32 indatasize;
-		while((indatasize = (cs_uint32)File_Read(in, 1, CHUNK_SIZE, fp)) > 0) {
-			Compr_SetInBuffer(&world->compr, in, indatasize);
-			if((compr_ok = Compr_Update(&world->compr)) == false) {
-				world->error.code = WORLD_ERROR_COMPR;
-				world->error.extra = WORLD_EXTRA_COMPR_PROC;
-				break;
+		if(framed) ReadFrames(world, fp);
+		else {
+			cs_uint32 wsize = 0, total = 0;
+			cs_byte in[CHUNK_SIZE];
+			cs_byte *data = World_GetBlockArray(world, &wsize);
+			Compr_SetOutBuffer(&world->compr, data, wsize);
+			cs_uint32 indatasize;
+			while((indatasize = (cs_uint32)File_Read(in, 1, CHUNK_SIZE, fp)) > 0) {
+				Compr_SetInBuffer(&world->compr, in, indatasize);
+				if((compr_ok = Compr_Update(&world->compr)) == false) {
+					world->error.code = WORLD_ERROR_COMPR;
+					world->error.extra = WORLD_EXTRA_COMPR_PROC;
+					break;
+				}
+				total += Compr_GetWrittenSize(&world->compr);
+			}
+			// Обрезанный файл оставил бы часть мира пустой
+			if(compr_ok && (total != wsize ||
+				!Compr_IsInState(&world->compr, COMPR_STATE_DONE))) {
+				world->error.code = WORLD_ERROR_DATAREAD;
+				world->error.extra = WORLD_EXTRA_NOINFO;
 			}
 		}
-		world->error.code = WORLD_ERROR_SUCCESS;
-		world->error.extra = WORLD_EXTRA_NOINFO;
-	} else {
+	} else if(world->error.code == WORLD_ERROR_SUCCESS) {
+		// ReadInfo мог уже указать причину ошибки
 		world->error.code = WORLD_ERROR_INFOREAD;
 		world->error.extra = WORLD_EXTRA_NOINFO;
 	}
 
 	if(fp) File_Close(fp);
 	Compr_Reset(&world->compr);
+	World_UpdateBlocks(world);
+	// Прочитанные регионы совпадают с файлом
+	if(world->regions.offsets && world->regions.dirty)
+		Memory_Zero(world->regions.dirty, REGION_BYTES(world->regions.count));
+	if(world->error.code == WORLD_ERROR_SUCCESS && JournalEnabled) {
+		SumLoadedBlocks(world);
+		ReplayJournal(world);
+	}
 	if(world->error.code == WORLD_ERROR_SUCCESS)
 		Event_Call(EVT_ONWORLDSTATUSCHANGE, world);
-	World_Unlock(world);
+	LoadFinished(world);
 	return 0;
 }
 
 cs_bool World_Load(World *world) {
+	// Упакованный мир уже в памяти, его достаточно распаковать
+	if(World_IsPacked(world)) {
+		if(World_UnpackBlocks(world)) return true;
+		world->error.code = WORLD_ERROR_COMPR;
+		world->error.extra = WORLD_EXTRA_COMPR_PROC;
+		return false;
+	}
 	if(World_IsInMemory(world)) {
 		world->error.code = WORLD_ERROR_INMEMORY;
 		world->error.extra = WORLD_EXTRA_NOINFO;
 		return false;
 	}
-	if(ISSET(world->flags, WORLD_FLAG_LOADED))
+	if(ISSET(world->flags, WORLD_FLAG_LOADED) || world->loading)
 		return false;
 
 	World_Lock(world, 0);
+	world->loading = true;
+	world->lastuse = Time_GetMSec();
+	world->error.code = WORLD_ERROR_SUCCESS;
+	world->error.extra = WORLD_EXTRA_NOINFO;
 	Thread_Create(WorldLoadThread, world, false);
 	return true;
 }
 
+cs_bool World_LoadInfo(World *world) {
+	cs_char path[256];
+	cs_bool framed = false, ok;
+	String_FormatBuf(path, 256, "worlds" PATH_DELIM "%s.cws", world->name);
+
+	cs_file fp = File_Open(path, "rb");
+	if(!fp) {
+		world->error.code = WORLD_ERROR_IOFAIL;
+		world->error.extra = WORLD_EXTRA_IO_OPEN;
+		return false;
+	}
+
+	if((ok = ReadInfo(world, fp, &framed)) == false && world->error.code == WORLD_ERROR_SUCCESS)
+		world->error.code = WORLD_ERROR_INFOREAD;
+	// Пока блоков нет, мир выглядит как выгруженный
+	world->wdata.size = 0;
+	File_Close(fp);
+	return ok;
+}
+
 void World_FreeBlockArray(World *world) {
-	if(world->wdata.size) {
-		Memory_Free(world->wdata.ptr);
-		world->wdata.size = 0;
-		world->wdata.ptr = world->wdata.blocks = NULL;
+	MapCache_Invalidate(world);
+	// Смещения в очереди относятся к старому массиву блоков
+	ClearPending(world);
+	FreezeSnapshots(world, true);
+	if(world->wdata.ptr) FreeBlockData(world);
+	DropImage(world);
+	Bricks_Free(&world->bricks);
+	FreeCold(world);
+	world->wdata.size = 0;
+	if(world->regions.dirty) {
+		Memory_Free(world->regions.dirty);
+		world->regions.dirty = world->regions.saving = NULL;
 	}
+	FreeRegionTable(world);
+	FreeSums(world);
+	CloseJournal(world);
 	world->flags &= ~WORLD_FLAG_LOADED;
 }
 
@@ -621,9 +2023,27 @@ cs_uint32 World_GetOffset(World *world, SVec *pos) {
 
 cs_bool World_SetBlockO(World *world, cs_uint32 offset, BlockID id) {
 	if(world->wdata.size <= offset) return false;
-	world->wdata.blocks[offset] = id;
-	if(!ISSET(world->flags, WORLD_FLAG_MODIGNORE))
+	BlockID old;
+	if(world->cold.data) {
+		BlockID *block = GetColdBlock(world, offset);
+		if(!block) return false;
+		old = *block;
+		*block = id;
+		world->cold.dirty = true;
+	} else if(world->bricks.list) {
+		old = Bricks_Get(&world->bricks, offset);
+		if(!Bricks_Set(&world->bricks, offset, id)) return false;
+	} else {
+		old = world->wdata.blocks[offset];
+		PreserveRegion(world, offset);
+		world->wdata.blocks[offset] = id;
+	}
+	world->wdata.version++;
+	if(!ISSET(world->flags, WORLD_FLAG_MODIGNORE)) {
+		JournalBlock(world, offset, old, id);
+		MarkRegion(world, offset);
 		world->flags |= WORLD_FLAG_MODIFIED;
+	}
 	return true;
 }
 
@@ -631,8 +2051,139 @@ cs_bool World_SetBlock(World *world, SVec *pos, BlockID id) {
 	return World_SetBlockO(world, World_GetOffset(world, pos), id);
 }
 
+cs_bool World_QueueBlockUpdate(World *world, cs_uint32 offset) {
+	if(offset >= world->wdata.size) return false;
+	struct _WorldPending *wp = &world->pending;
+
+	if(!wp->offsets) {
+		wp->offsets = Memory_TryAlloc(WORLD_PENDING_MAX + WORLD_PENDING_TABLE, sizeof(cs_uint32));
+		if(!wp->offsets) {
+			// Без очереди блок уходит игрокам сразу
+			Vanilla_BroadcastBlockUpdates(world, &offset, 1);
+			return true;
+		}
+		wp->table = wp->offsets + WORLD_PENDING_MAX;
+	}
+
+	cs_uint32 slot = (offset * 2654435761u) & (WORLD_PENDING_TABLE - 1);
+	while(wp->table[slot]) {
+		if(wp->offsets[wp->table[slot] - 1] == offset)
+			return true;
+		slot = (slot + 1) & (WORLD_PENDING_TABLE - 1);
+	}
+
+	wp->offsets[wp->count++] = offset;
+	wp->table[slot] = wp->count;
+	if(wp->count == WORLD_PENDING_MAX)
+		World_FlushBlockUpdates(world);
+
+	return true;
+}
+
+void World_FlushBlockUpdates(World *world) {
+	struct _WorldPending *wp = &world->pending;
+	if(wp->count == 0) return;
+
+	if(World_IsReadyToPlay(world)) {
+		for(cs_uint32 i = 0; i < wp->count; i += WORLD_BATCH_MAX)
+			Vanilla_BroadcastBlockUpdates(world, wp->offsets + i, min(wp->count - i, WORLD_BATCH_MAX));
+	}
+
+	ClearPending(world);
+}
+
+// Мир, только что нужный игрокам, не выгружается
+// сразу, иначе при нехватке памяти он мог бы выгрузиться,
+// пока игрок ещё не начал получать его карту
+#define WORLD_EVICT_GRACE 10000
+
+static cs_uint64 MemoryBudget = 0, ColdAfter = 0;
+
+void World_SetMemoryBudget(cs_uint64 bytes) {
+	MemoryBudget = bytes;
+}
+
+void World_SetColdAfter(cs_uint64 msec) {
+	ColdAfter = msec;
+}
+
+INL static cs_bool IsIdle(World *world, cs_uint64 now, cs_uint64 idle) {
+	return !world->loading && world->clients.players == 0 &&
+	world->taskc == 0 && now - world->lastuse >= idle;
+}
+
+INL static cs_bool CanEvict(World *world, cs_uint64 now) {
+	return World_GetMemoryUsage(world) > 0 && !World_IsInMemory(world) &&
+	!World_HasError(world) && IsIdle(world, now, WORLD_EVICT_GRACE);
+}
+
+// Сжатие инстанса лишь отняло бы у него общие с шаблоном
+// страницы, а страницы файла и так вытесняет ядро
+INL static cs_bool CanCompress(World *world) {
+	return World_IsReadyToPlay(world) && (!world->wdata.mapped ||
+	world->wdata.backend == WORLD_BACKEND_HUGEPAGES);
+}
+
+void Worlds_CheckResidency(void) {
+	cs_uint64 now = Time_GetMSec(), used = 0;
+	World *victim = NULL, *cold = NULL;
+	AListField *tmp;
+
+	List_Iter(tmp, World_Head) {
+		World *world = (World *)tmp->value.ptr;
+		if(!world) continue;
+		if(world->clients.players > 0 || world->taskc > 0)
+			world->lastuse = now;
+		used += World_GetMemoryUsage(world);
+		if(CanEvict(world, now) && (!victim || world->lastuse < victim->lastuse))
+			victim = world;
+		if(ColdAfter > 0 && CanCompress(world) && IsIdle(world, now, ColdAfter) &&
+		(!cold || world->lastuse < cold->lastuse))
+			cold = world;
+	}
+
+	if(MemoryBudget == 0 || used <= MemoryBudget || !victim) {
+		// Не сжавшийся мир попробуем сжать ещё раз попозже
+		if(cold && !World_CompressBlocks(cold))
+			cold->lastuse = now;
+		return;
+	}
+
+	// Изменённый мир сначала сохраняется, выгрузится
+	// он в один из следующих тиков, когда сохранение
+	// закончится. Если оно не удалось, мир снова будет
+	// помечен изменённым и попадёт сюда ещё раз
+	if(World_IsModified(victim)) {
+		(void)World_Save(victim);
+		return;
+	}
+
+	if(World_Lock(victim, 1)) {
+		if(!World_IsModified(victim))
+			World_Unload(victim);
+		World_Unlock(victim);
+	}
+}
+
+void Worlds_FlushBlockUpdates(void) {
+	AListField *tmp;
+	List_Iter(tmp, World_Head) {
+		World *world = (World *)tmp->value.ptr;
+		if(world) {
+			World_FlushBlockUpdates(world);
+			World_FlushJournal(world);
+			CollectSnapshots(world);
+		}
+	}
+}
+
 BlockID World_GetBlockO(World *world, cs_uint32 offset) {
 	if(offset >= world->wdata.size) return (BlockID)-1;
+	if(world->cold.data) {
+		BlockID *block = GetColdBlock(world, offset);
+		return block ? *block : (BlockID)-1;
+	}
+	if(world->bricks.list) return Bricks_Get(&world->bricks, offset);
 	return world->wdata.blocks[offset];
 }
 
@@ -5,19 +5,30 @@
 #include "types/list.h"
 #include "types/world.h"
 #include "types/cpe.h"
+#include "types/compr.h"
 
 #ifdef CORE_USE_LITTLE
 #	define WORLD_MAGIC 0x54414457u
+#	define WORLD_MAGIC_V2 0x32414457u
+#	define WORLD_MAGIC_V3 0x33414457u
+#	define WORLD_JOURNAL_MAGIC 0x324A4457u
 #else
 #	define WORLD_MAGIC 0x57444154u
+#	define WORLD_MAGIC_V2 0x57444132u
+#	define WORLD_MAGIC_V3 0x57444133u
+#	define WORLD_JOURNAL_MAGIC 0x57444A32u
 #endif
 
+#define WORLD_REGION_SHIFT 18
+#define WORLD_FRAME_SIZE (1u << WORLD_REGION_SHIFT)
+
 API cs_bool World_HasError(World *world);
 API EWorldError World_PopError(World *world, EWorldExtra *extra);
 
 API World *World_Create(cs_str name);
 API void World_AllocBlockArray(World *world);
 API cs_bool World_CleanBlockArray(World *world);
+API void World_UpdateBlocks(World *world);
 API void World_FreeBlockArray(World *world);
 API void World_Free(World *world);
 API void World_Add(World *world);
@@ -52,7 +63,27 @@ API void World_SetSeed(World *world, cs_uint32 seed);
 
 API cs_str World_GetName(World *world);
 API void World_GetSpawn(World *world, Vec *svec, Ang *sang);
+
+/**
+ * @brief Возвращает плоский массив блоков мира вместе
+ * с 4-байтовым заголовком, содержащим размер массива.
+ * 
+ * @param world мир
+ * @param size размер данных вместе с заголовком
+ * @return указатель на данные, NULL - мир не загружен, либо
+ * упакован и его нужно сначала распаковать через World_UnpackBlocks
+ */
 API void *World_GetData(World *world, cs_uint32 *size);
+
+/**
+ * @brief Возвращает плоский массив блоков мира. Функция
+ * ничего не распаковывает, упакованный мир нужно сначала
+ * распаковать через World_UnpackBlocks.
+ * 
+ * @param world мир
+ * @param size размер массива
+ * @return указатель на массив, NULL - мир не загружен или упакован
+ */
 API BlockID *World_GetBlockArray(World *world, cs_uint32 *size);
 API cs_uint32 World_GetBlockArraySize(World *world);
 API cs_uint32 World_GetOffset(World *world, SVec *pos);
@@ -67,6 +98,209 @@ API cs_uint32 World_GetSeed(World *world);
 
 API World *World_GetByName(cs_str name);
 
+/**
+ * @brief Снимает неизменяемую копию блоков мира. Копирование
+ * ленивое: регион копируется только перед первым его изменением
+ * через World_SetBlockO, поэтому снимок почти ничего не стоит,
+ * пока мир не меняется. Прямая запись в World_GetBlockArray
+ * снимки не видят. Функцию можно вызывать только из основного
+ * потока сервера, а читать и освобождать снимок - из любого.
+ * 
+ * @param world мир
+ * @return снимок, NULL - мир не загружен или не хватило памяти
+ */
+API WorldSnapshot *World_TakeSnapshot(World *world);
+
+/**
+ * @brief Копирует блоки из снимка.
+ * 
+ * @param snap снимок
+ * @param offset смещение первого блока
+ * @param dst буфер под блоки
+ * @param count количество блоков
+ * @return количество скопированных блоков
+ */
+API cs_uint32 World_ReadSnapshot(WorldSnapshot *snap, cs_uint32 offset, BlockID *dst, cs_uint32 count);
+
+/**
+ * @brief Отпускает снимок, полученный от World_TakeSnapshot.
+ * 
+ * @param snap снимок
+ */
+API void World_ReleaseSnapshot(WorldSnapshot *snap);
+
+/**
+ * @brief Упаковывает блоки мира в брики 16x16x16 с палитрой
+ * и освобождает плоский массив. Мир, состоящий в основном из
+ * воздуха, занимает так в разы меньше памяти. Брики хранят
+ * только простаивающие миры: мир с игроками, снимками и
+ * рассылкой карты всегда держит плоский массив, и World_Load
+ * с World_Save сначала распаковывают его обратно. World_GetBlock
+ * и World_SetBlock работают с упакованным миром напрямую,
+ * а World_GetBlockArray для него возвращает NULL.
+ * 
+ * @param world мир
+ * @return true - мир упакован, false - мир не загружен, в нём
+ * есть игроки или задачи, либо не хватило памяти
+ */
+API cs_bool World_PackBlocks(World *world);
+
+/**
+ * @brief Распаковывает брики или сжатые блоки мира обратно
+ * в плоский массив. Сами функции доступа к блокам мир не
+ * распаковывают, поэтому результат обязательно нужно проверить.
+ * 
+ * @param world мир
+ * @return true - мир не был упакован или успешно распакован, false - не хватило памяти
+ */
+API cs_bool World_UnpackBlocks(World *world);
+
+/**
+ * @brief Сжимает блоки мира в памяти быстрым кодеком (LZ4,
+ * либо zstd на минимальном уровне) и освобождает плоский массив.
+ * World_GetBlock и World_SetBlock разжимают только регион,
+ * в котором лежит блок, а World_Load и World_UnpackBlocks
+ * разжимают мир целиком без чтения файла с диска. Если
+ * библиотек этих кодеков нет, мир упаковывается в брики.
+ * 
+ * @param world мир
+ * @return true - мир сжат, false - мир не загружен, в нём
+ * есть игроки или задачи, либо не хватило памяти
+ */
+API cs_bool World_CompressBlocks(World *world);
+
+/**
+ * @brief Проверяет, упакован ли мир в брики или сжат в памяти.
+ * 
+ * @param world мир
+ * @return true - упакован или сжат, false - нет
+ */
+API cs_bool World_IsPacked(World *world);
+API cs_bool World_IsLoading(World *world);
+
+/**
+ * @brief Возвращает объём памяти, занятый блоками мира.
+ * 
+ * @param world мир
+ * @return количество байт, 0 - блоки мира не загружены
+ * либо лежат во временном файле, страницами которого
+ * распоряжается ядро
+ */
+API cs_uint64 World_GetMemoryUsage(World *world);
+
+/**
+ * @brief Выбирает, откуда брать память под блоки мира.
+ * Выбор учитывается при следующей загрузке, создании или
+ * распаковке массива блоков. Если система не дала память
+ * выбранным способом, блоки ложатся в обычную кучу.
+ * 
+ * @param world мир
+ * @param backend способ хранения блоков
+ * @return true - способ выбран, false - WORLD_BACKEND_INSTANCE
+ * выбрать нельзя, такие миры создаёт World_CloneFrom
+ */
+API cs_bool World_SetBackend(World *world, EWorldBackend backend);
+API EWorldBackend World_GetBackend(World *world);
+
+/**
+ * @brief Создаёт инстанс мира-шаблона. Блоки инстанса
+ * разделяются с шаблоном в режиме copy-on-write, поэтому
+ * новый инстанс почти не занимает памяти, пока в нём
+ * ничего не меняли. Инстанс не сохраняется на диск и
+ * не добавляется в список миров, для этого существуют
+ * World_SetInMemory и World_Add. Изменения шаблона видны
+ * только инстансам, созданным после них: первое изменение
+ * делает общий образ недействительным, и следующий вызов
+ * снимает новый, копируя все блоки шаблона в вызывающем
+ * потоке. Шаблон, с которого часто клонируют, лучше не менять.
+ * 
+ * @param tmpl мир-шаблон
+ * @param name имя инстанса
+ * @return инстанс, NULL - шаблон не загружен либо не
+ * удалось создать общий образ его блоков
+ */
+API World *World_CloneFrom(World *tmpl, cs_str name);
+
+/**
+ * @brief Читает из файла мира только его параметры (размеры,
+ * точку появления, окружение) без блоков. Блоки будут загружены
+ * через World_Load, когда мир понадобится игрокам.
+ * 
+ * @param world мир
+ * @return true - параметры прочитаны, false - произошла ошибка
+ */
+API cs_bool World_LoadInfo(World *world);
+
+/**
+ * @brief Ставит блок в очередь рассылки игрокам мира.
+ * Очередь отправляется раз в тик, повторные изменения
+ * одного и того же блока схлопываются в одно, игрокам
+ * уходит значение блока на момент отправки.
+ * 
+ * @param world мир
+ * @param offset смещение блока в массиве мира
+ * @return true - блок добавлен в очередь, false - смещение за пределами мира
+ */
+API cs_bool World_QueueBlockUpdate(World *world, cs_uint32 offset);
+
+#ifndef CORE_BUILD_PLUGIN
+	void World_FlushBlockUpdates(World *world);
+	void Worlds_FlushBlockUpdates(void);
+
+	/**
+	 * @brief Задаёт формат, в котором будут сохраняться миры.
+	 * COMPR_CODEC_GZIP - старый формат, zstd и LZ4 - формат
+	 * третьей версии с независимо сжатыми кадрами. Если библиотека
+	 * кодека недоступна, миры сохраняются в старом формате.
+	 * 
+	 * @param codec кодек
+	 */
+	void World_SetSaveCodec(ComprCodec codec);
+
+	/**
+	 * @brief Включает журнал изменений блоков. Каждый вызов
+	 * World_SetBlockO дописывается в файл worlds/<мир>.cwj,
+	 * при загрузке мира журнал применяется поверх .cws файла,
+	 * а после успешного сохранения обрезается. Журнал хранит
+	 * контрольную сумму файла, к которому относится, поэтому
+	 * включать его нужно до загрузки миров.
+	 * 
+	 * @param state true - вести журнал, false - не вести
+	 */
+	void World_SetJournal(cs_bool state);
+
+	/**
+	 * @brief Сбрасывает накопленные записи журнала в файл.
+	 * 
+	 * @param world мир
+	 */
+	void World_FlushJournal(World *world);
+
+	/**
+	 * @brief Задаёт объём памяти под блоки миров. Когда он
+	 * превышен, давно не посещавшиеся миры без игроков
+	 * сохраняются и выгружаются, начиная с самого старого.
+	 * 
+	 * @param bytes объём в байтах, 0 - без ограничений
+	 */
+	void World_SetMemoryBudget(cs_uint64 bytes);
+
+	/**
+	 * @brief Задаёт, через сколько времени без игроков
+	 * блоки мира сжимаются в памяти через World_CompressBlocks.
+	 * 
+	 * @param msec время в миллисекундах, 0 - не сжимать
+	 */
+	void World_SetColdAfter(cs_uint64 msec);
+
+	/**
+	 * @brief Выгружает миры, пока их блоки занимают
+	 * больше памяти, чем разрешено, и сжимает давно
+	 * пустующие миры. Вызывается раз в тик.
+	 */
+	void Worlds_CheckResidency(void);
+#endif
+
 VAR World *World_Main;
 VAR AListField *World_Head;
 #endif // WORLD_H